@@ -0,0 +1,105 @@
+// Compares Load1ui16/Save for ASCII PGM files against the previous implementation
+// which used getline, boost::split and boost::lexical_cast.
+
+#include <slimage/io.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace old
+{
+	using namespace slimage;
+
+	Image1ui16 Load1ui16(const std::string& filename) {
+		std::ifstream ifs(filename);
+		std::string line;
+		std::vector<std::string> tokens;
+		ReadDataLine(ifs, line);
+		ReadDataLine(ifs, line);
+		boost::split(tokens, line, boost::is_any_of(" "));
+		unsigned int w = boost::lexical_cast<unsigned int>(tokens[0]);
+		unsigned int h = boost::lexical_cast<unsigned int>(tokens[1]);
+		ReadDataLine(ifs, line);
+		Image1ui16 img(w, h);
+		unsigned int y = 0;
+		while(ReadDataLine(ifs, line)) {
+			boost::split(tokens, line, boost::is_any_of(" "));
+			if(tokens.back().empty()) {
+				tokens.pop_back();
+			}
+			if(tokens.size() != w) {
+				throw IoException(filename, "Width and number of tokens in line do not match");
+			}
+			for(unsigned int x=0; x<w; x++) {
+				img(x,y) = boost::lexical_cast<unsigned int>(tokens[x]);
+			}
+			y++;
+		}
+		return img;
+	}
+
+	void Save(const std::string& filename, const Image1ui16& img) {
+		std::ofstream ofs(filename);
+		ofs << "P2" << std::endl;
+		ofs << img.width() << " " << img.height() << std::endl;
+		ofs << "65535" << std::endl;
+		for(unsigned int y=0; y<img.height(); y++) {
+			for(unsigned int x=0; x<img.width(); x++) {
+				ofs << img(x,y);
+				if(x+1 < img.width()) {
+					ofs << " ";
+				}
+			}
+			if(y+1 < img.height()) {
+				ofs << std::endl;
+			}
+		}
+	}
+}
+
+template<typename F>
+double MeasureMs(unsigned repetitions, F f)
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	for(unsigned i=0; i<repetitions; i++) {
+		f();
+	}
+	const auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double,std::milli>(t1 - t0).count() / repetitions;
+}
+
+int main(int argc, char** argv)
+{
+	const std::string filename = (argc > 1) ? argv[1] : "/tmp/slimage_bench_1ui16.pgm";
+	const unsigned repetitions = 20;
+
+	// a depth frame like the ones recorded with a Kinect
+	slimage::Image1ui16 img(640, 480);
+	std::mt19937 rnd(0);
+	std::uniform_int_distribution<unsigned> dist(400, 8000);
+	for(auto& v : img) {
+		v = dist(rnd);
+	}
+
+	const double old_save = MeasureMs(repetitions, [&]() { old::Save(filename, img); });
+	const double new_save = MeasureMs(repetitions, [&]() { slimage::Save(filename, img); });
+	const double old_load = MeasureMs(repetitions, [&]() { old::Load1ui16(filename); });
+	const double new_load = MeasureMs(repetitions, [&]() { slimage::Load1ui16(filename); });
+
+	if(!std::equal(img.begin(), img.end(), slimage::Load1ui16(filename).begin())) {
+		std::cerr << "Loaded image does not match saved image!" << std::endl;
+		return 1;
+	}
+
+	std::cout << "640x480 ASCII PGM, average of " << repetitions << " runs" << std::endl;
+	std::cout << "Save: old " << old_save << " ms, new " << new_save << " ms" << std::endl;
+	std::cout << "Load: old " << old_load << " ms, new " << new_load << " ms" << std::endl;
+
+	return 0;
+}
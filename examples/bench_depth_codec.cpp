@@ -0,0 +1,63 @@
+// Measures compression ratio and throughput of the lossless depth codec (CompressDepth/DecompressDepth).
+
+#include <slimage/depth_codec.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template<typename F>
+double MeasureMs(unsigned repetitions, F f)
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	for(unsigned i=0; i<repetitions; i++) {
+		f();
+	}
+	const auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double,std::milli>(t1 - t0).count() / repetitions;
+}
+
+int main()
+{
+	const unsigned repetitions = 200;
+
+	// a smooth depth surface with sensor noise and invalid (zero) pixels like a Kinect frame
+	slimage::Image1ui16 img(640, 480);
+	std::mt19937 rnd(0);
+	std::uniform_int_distribution<unsigned> noise(0, 3);
+	std::uniform_int_distribution<unsigned> invalid(0, 19);
+	for(unsigned y=0; y<img.height(); y++) {
+		for(unsigned x=0; x<img.width(); x++) {
+			const double surface = 1500.0 + 300.0*std::sin(0.02*x)*std::cos(0.03*y);
+			img(x,y) = (invalid(rnd) == 0) ? 0 : static_cast<uint16_t>(surface) + noise(rnd);
+		}
+	}
+	const double megabytes = 2.0*img.size() / 1.0e6;
+
+	std::vector<uint8_t> data;
+	const double seq_encode = MeasureMs(repetitions, [&]() { data = slimage::CompressDepth(img.view()); });
+	const double par_encode = MeasureMs(repetitions, [&]() { data = slimage::CompressDepth(slimage::par, img.view()); });
+	slimage::Image1ui16 result;
+	const double seq_decode = MeasureMs(repetitions, [&]() { result = slimage::DecompressDepth(data.data(), data.size()); });
+	const double par_decode = MeasureMs(repetitions, [&]() { result = slimage::DecompressDepth(slimage::par, data.data(), data.size()); });
+	const slimage::SimdLevel level = slimage::GetSimdLevel();
+	slimage::SetSimdLevel(slimage::SimdLevel::Scalar);
+	slimage::Image1ui16 scalar_result;
+	const double scalar_decode = MeasureMs(repetitions, [&]() { scalar_result = slimage::DecompressDepth(data.data(), data.size()); });
+	slimage::SetSimdLevel(level);
+
+	if(!std::equal(img.begin(), img.end(), result.begin()) || !std::equal(img.begin(), img.end(), scalar_result.begin())) {
+		std::cerr << "Decompressed image does not match original image!" << std::endl;
+		return 1;
+	}
+
+	std::cout << "640x480 depth, average of " << repetitions << " runs, ratio " << 2.0*img.size()/data.size() << std::endl;
+	std::cout << "Encode: seq " << megabytes/seq_encode << " GB/s, par " << megabytes/par_encode << " GB/s" << std::endl;
+	std::cout << "Decode: seq " << megabytes/seq_decode << " GB/s, par " << megabytes/par_decode << " GB/s, seq without SIMD "
+		<< megabytes/scalar_decode << " GB/s" << std::endl;
+	std::cout << "par uses " << slimage::par.threads().size() << " thread(s)" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,143 @@
+// Counts heap allocations to check that images move through AnonymousImage without copying:
+// Load -> anonymous_take -> make_anonymous -> anonymous_take must not allocate a pixel buffer.
+// Returns a non-zero exit code if a pixel buffer is copied.
+//
+// Pixel buffers are allocated with posix_memalign (see slimage/allocator.hpp), thus the
+// example replaces posix_memalign as well as operator new. This works with glibc only.
+
+#include <slimage/io.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#if defined __GLIBC__
+#  include <malloc.h>
+#endif
+
+// allocations of at least this many bytes are counted, i.e. pixel buffers but not small bookkeeping
+std::size_t large_allocation_bytes = std::size_t(-1);
+std::atomic<unsigned> large_allocations(0);
+
+void CountAllocation(std::size_t size)
+{
+	if(size >= large_allocation_bytes) {
+		large_allocations++;
+	}
+}
+
+#if defined __GLIBC__
+extern "C" int posix_memalign(void** p, std::size_t alignment, std::size_t size) noexcept
+{
+	CountAllocation(size);
+	*p = memalign(alignment, size);
+	return *p ? 0 : ENOMEM;
+}
+#endif
+
+void* Allocate(std::size_t size)
+{
+	CountAllocation(size);
+	if(void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size)
+{ return Allocate(size); }
+
+void* operator new[](std::size_t size)
+{ return Allocate(size); }
+
+void operator delete(void* p) noexcept
+{ std::free(p); }
+
+void operator delete[](void* p) noexcept
+{ std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept
+{ std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept
+{ std::free(p); }
+
+int failures = 0;
+
+/** Runs 'f' and checks that it allocates 'expected' pixel buffers */
+template<typename F>
+void Expect(const std::string& what, unsigned expected, F f)
+{
+	const unsigned before = large_allocations;
+	f();
+	const unsigned n = large_allocations - before;
+	std::cout << what << ": " << n << " pixel buffer allocation(s)" << std::endl;
+	if(n != expected) {
+		std::cerr << "Expected " << expected << " allocation(s) for " << what << std::endl;
+		failures++;
+	}
+}
+
+void ExpectSame(const std::string& what, const void* a, const void* b)
+{
+	if(a != b) {
+		std::cerr << "Pixel buffer was not moved: " << what << std::endl;
+		failures++;
+	}
+}
+
+int main(int argc, char** argv)
+{
+#if !defined __GLIBC__
+	std::cout << "Counting pixel buffer allocations requires glibc" << std::endl;
+	return 0;
+#endif
+	const std::string fn = (argc > 1) ? argv[1] : "/tmp/slimage-check-anonymous.ppm";
+
+	const unsigned width = 640;
+	const unsigned height = 480;
+	{
+		slimage::Image3ub img(width, height);
+		for(unsigned y=0; y<height; y++) {
+			for(unsigned x=0; x<width; x++) {
+				unsigned char* p = img.pixel_pointer(x,y);
+				p[0] = static_cast<unsigned char>(x);
+				p[1] = static_cast<unsigned char>(y);
+				p[2] = static_cast<unsigned char>(x + y);
+			}
+		}
+		slimage::Save(fn, img);
+		// the first load also allocates buffers which are kept and reused by later loads
+		slimage::Load(fn);
+	}
+	large_allocation_bytes = 3*width*height;
+
+	slimage::AnonymousImage aimg;
+	Expect("Load", 1, [&]() { aimg = slimage::Load(fn); });
+	const void* pixels = aimg->data();
+
+	slimage::Image3ub img;
+	Expect("anonymous_take", 0, [&]() { img = slimage::anonymous_take<unsigned char,3>(std::move(aimg)); });
+	ExpectSame("anonymous_take", pixels, img.pixel_pointer());
+
+	Expect("make_anonymous(Image&&)", 0, [&]() { aimg = slimage::make_anonymous(std::move(img)); });
+	ExpectSame("make_anonymous(Image&&)", pixels, aimg->data());
+
+	Expect("anonymous_ref and anonymous_view", 0, [&]() {
+		ExpectSame("anonymous_ref", pixels, slimage::anonymous_ref<unsigned char,3>(aimg).pixel_pointer());
+		ExpectSame("anonymous_view", pixels, slimage::anonymous_view<unsigned char,3>(aimg).pixel_pointer());
+	});
+
+	Expect("anonymous_take", 0, [&]() { img = slimage::anonymous_take<unsigned char,3>(std::move(aimg)); });
+	ExpectSame("anonymous_take", pixels, img.pixel_pointer());
+
+	// a shared anonymous image must be copied, the other owner still sees the pixels
+	slimage::AnonymousImage shared = slimage::make_anonymous(std::move(img));
+	slimage::AnonymousImage other = shared;
+	Expect("anonymous_take of a shared image", 1, [&]() { img = slimage::anonymous_take<unsigned char,3>(std::move(shared)); });
+
+	Expect("Load3ub", 1, [&]() { img = slimage::Load3ub(fn); });
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+// Checks size and offset computations for an image with more than 2^32 elements.
+// The image needs about 4 GB of memory, thus the check only runs when called with --run:
+//   slimage-example-check_large_image --run [width height]
+// Returns a non-zero exit code if an offset or size is wrong.
+
+#include <slimage/image.hpp>
+#include <slimage/allocator.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+int failures = 0;
+
+void Expect(const std::string& what, uint64_t expected, uint64_t actual)
+{
+	std::cout << what << ": " << actual << std::endl;
+	if(expected != actual) {
+		std::cerr << "Expected " << expected << " for " << what << std::endl;
+		failures++;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2 || std::strcmp(argv[1], "--run") != 0) {
+		std::cout << "Skipped, the check allocates about 4 GB; use --run [width height] to run it" << std::endl;
+		return 0;
+	}
+	// a multiple of 64 bytes per line, thus lines are not padded and begin()/end() can be used
+	const unsigned width = (argc > 3) ? std::atoi(argv[2]) : 65600;
+	const unsigned height = (argc > 3) ? std::atoi(argv[3]) : 65536;
+	const uint64_t elements = static_cast<uint64_t>(width)*height;
+	if(elements <= (uint64_t(1) << 32)) {
+		std::cerr << "The image must have more than 2^32 elements" << std::endl;
+		return 1;
+	}
+
+	// huge pages reduce the TLB misses when touching every page of the buffer
+	slimage::SetHugePageThreshold(std::size_t(32) << 20);
+	slimage::Image1ub img(width, height);
+	const uint64_t stride = img.stride();
+
+	Expect("size()", elements, img.size());
+	Expect("index of the last pixel", elements - 1, img.index(width - 1, height - 1));
+	const unsigned char* first = img.pixel_pointer(0, 0);
+	const unsigned char* last = img.pixel_pointer(width - 1, height - 1);
+	Expect("offset of the last pixel", (height - 1)*stride + (width - 1), static_cast<uint64_t>(last - first));
+	Expect("pixel_pointer(size()-1) - pixel_pointer(0)", static_cast<uint64_t>(last - first),
+		static_cast<uint64_t>(img.pixel_pointer(img.size() - 1) - first));
+	if(img.isContiguous()) {
+		Expect("end() - begin()", elements, static_cast<uint64_t>(img.end() - img.begin()));
+	}
+	else {
+		std::cout << "Lines are padded, skipping end() - begin()" << std::endl;
+	}
+
+	// the last pixel must be reachable by coordinates, linear index and iterator
+	img(width - 1, height - 1) = 42;
+	Expect("img[size()-1]", 42, img[img.size() - 1]);
+	if(img.isContiguous()) {
+		Expect("*(end() - 1)", 42, *(img.end() - 1));
+	}
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+// Saves 16 bit depth images and a color PNG with AsyncSaver and checks that they load back unchanged.
+// Returns a non-zero exit code if an image could not be saved or differs.
+
+#include <slimage/opencv.hpp> // PNG files are saved with OpenCV
+#include <slimage/saver.hpp>
+#include <slimage/io.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+template<typename K, unsigned CC>
+bool Equal(const slimage::Image<K,CC>& a, const slimage::Image<K,CC>& b)
+{
+	if(a.width() != b.width() || a.height() != b.height()) {
+		return false;
+	}
+	for(unsigned y=0; y<a.height(); y++) {
+		if(!std::equal(a.pixel_pointer(0,y), a.pixel_pointer(0,y) + a.width()*CC, b.pixel_pointer(0,y))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const std::string prefix = (argc > 1) ? argv[1] : "/tmp/slimage-check-saver";
+
+	slimage::Image1ui16 img(37, 11);
+	for(unsigned y=0; y<img.height(); y++) {
+		for(unsigned x=0; x<img.width(); x++) {
+			img(x,y) = static_cast<uint16_t>(1000 + 97*x + 1013*y);
+		}
+	}
+
+	slimage::Image3ub color(29, 13);
+	for(unsigned y=0; y<color.height(); y++) {
+		for(unsigned x=0; x<color.width(); x++) {
+			color(x,y) = slimage::Pixel3ub{static_cast<unsigned char>(9*x), static_cast<unsigned char>(19*y), static_cast<unsigned char>(x*y)};
+		}
+	}
+
+	slimage::AsyncSaver saver(2);
+	saver.save(prefix + ".simg", slimage::Image1ui16(img));
+	saver.save(prefix + ".sdepth", slimage::Image1ui16(img));
+	saver.save(prefix + ".pgm", slimage::Image1ui16(img));
+	saver.save(prefix + "-anonymous.simg", slimage::make_anonymous(img));
+	// goes through the backend which takes over the pixels of the queued image
+	saver.save(prefix + ".png", slimage::Image3ub(color));
+	try {
+		saver.flush();
+	}
+	catch(const slimage::IoException& e) {
+		std::cerr << "AsyncSaver failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	int failures = 0;
+	auto report = [&](const std::string& fn, bool ok) {
+		std::cout << fn << ": " << (ok ? "ok" : "MISMATCH") << std::endl;
+		failures += ok ? 0 : 1;
+	};
+	auto check = [&](const std::string& fn, const slimage::Image1ui16& loaded) {
+		report(fn, Equal(img, loaded));
+	};
+	check(prefix + ".simg", slimage::Load<uint16_t,1>(prefix + ".simg"));
+	check(prefix + ".sdepth", slimage::Load<uint16_t,1>(prefix + ".sdepth"));
+	check(prefix + ".pgm", slimage::Load1ui16(prefix + ".pgm"));
+	check(prefix + "-anonymous.simg", slimage::Load<uint16_t,1>(prefix + "-anonymous.simg"));
+	report(prefix + ".png", Equal(color, slimage::Load3ub(prefix + ".png")));
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+// Compares the SIMD channel swizzles (Copy_*) and planar (de)interleaving bit for bit
+// against scalar loops for every supported SIMD level and widths 0 to 70.
+// Returns a non-zero exit code on any mismatch.
+
+#include <slimage/algorithm.hpp>
+#include <slimage/planar.hpp>
+#include <slimage/simd.hpp>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// guard elements after the destination which must not be written
+const unsigned Guard = 64;
+
+int failures = 0;
+
+template<typename K>
+std::vector<K> RandomElements(size_t n, std::mt19937& rnd)
+{
+	std::vector<K> v(n);
+	// random bytes, thus every bit of the element is checked
+	std::uniform_int_distribution<unsigned> byte(0, 255);
+	unsigned char* p = reinterpret_cast<unsigned char*>(v.data());
+	for(size_t i=0; i<n*sizeof(K); i++) {
+		p[i] = static_cast<unsigned char>(byte(rnd));
+	}
+	return v;
+}
+
+template<typename K>
+void Compare(const std::vector<K>& expected, const std::vector<K>& actual, const std::string& what, unsigned width)
+{
+	if(expected.size() != actual.size()
+		|| std::memcmp(expected.data(), actual.data(), expected.size()*sizeof(K)) != 0) {
+		std::cerr << "Mismatch: " << what << " for width " << width << std::endl;
+		failures++;
+	}
+}
+
+/** Scalar reference: swaps channels 0 and 2 and sets a new alpha channel to 'alpha' */
+template<typename K>
+void ReferenceSwizzle(const K* src, unsigned n, unsigned src_cc, K* dst, unsigned dst_cc, K alpha)
+{
+	for(unsigned i=0; i<n; i++) {
+		dst[dst_cc*i] = src[src_cc*i + 2];
+		dst[dst_cc*i + 1] = src[src_cc*i + 1];
+		dst[dst_cc*i + 2] = src[src_cc*i];
+		if(dst_cc == 4) {
+			dst[dst_cc*i + 3] = (src_cc == 4) ? src[src_cc*i + 3] : alpha;
+		}
+	}
+}
+
+template<typename K>
+void CheckSwizzles(const std::string& type, std::mt19937& rnd)
+{
+	for(unsigned w=0; w<=70; w++) {
+		const std::vector<K> rgba = RandomElements<K>(4*w, rnd);
+		const std::vector<K> rgb = RandomElements<K>(3*w, rnd);
+		const K alpha = RandomElements<K>(1, rnd)[0];
+		// the guard is initialized identically in the expected and the actual buffers
+		std::vector<K> expected4 = RandomElements<K>(4*w + Guard, rnd);
+		std::vector<K> expected3 = RandomElements<K>(3*w + Guard, rnd);
+		std::vector<K> actual;
+
+		ReferenceSwizzle(rgba.data(), w, 4, expected4.data(), 4, alpha);
+		actual = RandomElements<K>(4*w + Guard, rnd);
+		std::copy(expected4.begin() + 4*w, expected4.end(), actual.begin() + 4*w);
+		slimage::Copy_RGBA_to_BGRA(rgba.data(), rgba.data() + 4*w, actual.data());
+		Compare(expected4, actual, "Copy_RGBA_to_BGRA " + type, w);
+
+		ReferenceSwizzle(rgba.data(), w, 4, expected3.data(), 3, alpha);
+		actual = RandomElements<K>(3*w + Guard, rnd);
+		std::copy(expected3.begin() + 3*w, expected3.end(), actual.begin() + 3*w);
+		slimage::Copy_RGBA_to_BGR(rgba.data(), rgba.data() + 4*w, actual.data());
+		Compare(expected3, actual, "Copy_RGBA_to_BGR " + type, w);
+
+		ReferenceSwizzle(rgb.data(), w, 3, expected4.data(), 4, alpha);
+		actual = RandomElements<K>(4*w + Guard, rnd);
+		std::copy(expected4.begin() + 4*w, expected4.end(), actual.begin() + 4*w);
+		slimage::Copy_RGB_to_BGRA(rgb.data(), rgb.data() + 3*w, actual.data(), alpha);
+		Compare(expected4, actual, "Copy_RGB_to_BGRA " + type, w);
+
+		ReferenceSwizzle(rgb.data(), w, 3, expected3.data(), 3, alpha);
+		actual = RandomElements<K>(3*w + Guard, rnd);
+		std::copy(expected3.begin() + 3*w, expected3.end(), actual.begin() + 3*w);
+		slimage::Copy_RGB_to_BGR(rgb.data(), rgb.data() + 3*w, actual.data());
+		Compare(expected3, actual, "Copy_RGB_to_BGR " + type, w);
+	}
+}
+
+template<typename K, unsigned CC>
+void CheckPlanar(const std::string& type, std::mt19937& rnd)
+{
+	for(unsigned w=0; w<=70; w++) {
+		const std::vector<K> interleaved = RandomElements<K>(CC*w, rnd);
+		std::vector<std::vector<K>> planes(CC);
+		std::vector<K*> rows(CC);
+		std::vector<const K*> crows(CC);
+		for(unsigned c=0; c<CC; c++) {
+			planes[c].resize(w + Guard);
+			rows[c] = planes[c].data();
+			crows[c] = planes[c].data();
+		}
+		slimage::detail::PlanarRow<K,CC>::deinterleave(interleaved.data(), rows.data(), w);
+		for(unsigned c=0; c<CC; c++) {
+			std::vector<K> expected(w + Guard);
+			for(unsigned i=0; i<w; i++) {
+				expected[i] = interleaved[CC*i + c];
+			}
+			Compare(expected, planes[c], "Deinterleave " + type, w);
+		}
+		std::vector<K> actual(CC*w + Guard);
+		std::vector<K> expected(CC*w + Guard);
+		std::copy(interleaved.begin(), interleaved.end(), expected.begin());
+		slimage::detail::PlanarRow<K,CC>::interleave(crows.data(), actual.data(), w);
+		Compare(expected, actual, "Interleave " + type, w);
+	}
+}
+
+int main()
+{
+	const slimage::SimdLevel levels[] = {
+		slimage::SimdLevel::Scalar, slimage::SimdLevel::SSSE3, slimage::SimdLevel::AVX2, slimage::SimdLevel::NEON
+	};
+	const char* names[] = { "Scalar", "SSSE3", "AVX2", "NEON" };
+	const slimage::SimdLevel detected = slimage::GetSimdLevel();
+	for(unsigned i=0; i<4; i++) {
+		slimage::SetSimdLevel(levels[i]);
+		if(slimage::GetSimdLevel() != levels[i]) {
+			std::cout << names[i] << ": not supported" << std::endl;
+			continue;
+		}
+		const int before = failures;
+		std::mt19937 rnd(i);
+		CheckSwizzles<unsigned char>("1 byte", rnd);
+		CheckSwizzles<uint16_t>("2 bytes", rnd);
+		CheckSwizzles<float>("4 bytes", rnd);
+		CheckSwizzles<double>("8 bytes", rnd);
+		CheckPlanar<unsigned char,3>("3 x 1 byte", rnd);
+		CheckPlanar<unsigned char,4>("4 x 1 byte", rnd);
+		CheckPlanar<uint16_t,3>("3 x 2 bytes", rnd);
+		CheckPlanar<uint16_t,4>("4 x 2 bytes", rnd);
+		CheckPlanar<float,3>("3 x 4 bytes", rnd);
+		CheckPlanar<float,4>("4 x 4 bytes", rnd);
+		CheckPlanar<double,3>("3 x 8 bytes", rnd);
+		std::cout << names[i] << ": " << (failures == before ? "ok" : "MISMATCH") << std::endl;
+		slimage::SetSimdLevel(detected);
+	}
+	return (failures == 0) ? 0 : 1;
+}
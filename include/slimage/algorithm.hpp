@@ -2,7 +2,12 @@
 
 #include <slimage/pixel.hpp>
 #include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/simd.hpp>
 #include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <utility>
 #include <cmath>
 
 namespace slimage
@@ -23,36 +28,113 @@ namespace slimage
 		};
 	}
 
+	namespace detail
+	{
+		template<typename K, unsigned CC, typename IMG>
+		void CopyInto(const ImageView<K,CC>& src, IMG& dst)
+		{
+			for(unsigned y=0; y<src.height(); y++) {
+				std::copy(src.pixel_pointer(0,y), src.pixel_pointer(0,y) + src.numElementsScanline(), dst.pixel_pointer(0,y));
+			}
+		}
+
+		/** Start values of a min/max reduction such that any value replaces them */
+		template<typename K>
+		std::pair<K,K> EmptyMinMax()
+		{
+			using limits = std::numeric_limits<K>;
+			return limits::has_infinity ? std::pair<K,K>(limits::infinity(), static_cast<K>(-limits::infinity()))
+				: std::pair<K,K>(limits::max(), limits::lowest());
+		}
+
+		/** Minimum and maximum element of the lines y0 to y1-1; NaN values are skipped */
+		template<typename K, unsigned CC>
+		std::pair<typename std::remove_const<K>::type, typename std::remove_const<K>::type> MinMaxRows(const ImageView<K,CC>& img, unsigned y0, unsigned y1)
+		{
+			using base_t = typename std::remove_const<K>::type;
+			std::pair<base_t,base_t> range = EmptyMinMax<base_t>();
+			for(unsigned y=y0; y<y1; y++) {
+				MinMax<base_t>(img.pixel_pointer(0,y), img.numElementsScanline(), range.first, range.second);
+			}
+			return range;
+		}
+
+		/** Applies Convert to the lines y0 to y1-1 */
+		template<typename SRC, unsigned CC, typename IMG, typename F>
+		void ConvertRows(const ImageView<SRC,CC>& src, IMG& dst, F& fnc, unsigned y0, unsigned y1)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				auto it = dst.beginScanline(y);
+				for(auto p=src.beginScanline(y), p_end=src.endScanline(y); p!=p_end; ++p, ++it) {
+					*it = fnc(*p);
+				}
+			}
+		}
+
+		template<typename SRC, unsigned CC, typename IMG, typename F>
+		void ConvertInto(const ImageView<SRC,CC>& src, IMG& dst, F fnc)
+		{ ConvertRows(src, dst, fnc, 0, src.height()); }
+
+		/** Applies ConvertUV to the lines y0 to y1-1 */
+		template<typename SRC, unsigned CC, typename IMG, typename F>
+		void ConvertUVRows(const ImageView<SRC,CC>& src, IMG& dst, F& fnc, unsigned y0, unsigned y1)
+		{
+			const unsigned width = src.width();
+			for(unsigned y=y0; y<y1; y++) {
+				auto p = src.beginScanline(y);
+				auto it = dst.beginScanline(y);
+				for(unsigned x=0; x<width; x++, ++p, ++it) {
+					*it = fnc(x,y,*p);
+				}
+			}
+		}
+
+		template<typename SRC, unsigned CC, typename IMG, typename F>
+		void ConvertUVInto(const ImageView<SRC,CC>& src, IMG& dst, F fnc)
+		{ ConvertUVRows(src, dst, fnc, 0, src.height()); }
+	}
+
+	/** Copies the pixels of a view into a new image */
+	template<typename K, unsigned CC>
+	Image<typename std::remove_const<K>::type,CC> Copy(const ImageView<K,CC>& src)
+	{
+		Image<typename std::remove_const<K>::type,CC> dst{src.dimensions()};
+		detail::CopyInto(src, dst);
+		return dst;
+	}
+
 	template<typename SRC, unsigned CC, typename F>
-	auto Convert(const Image<SRC,CC>& src, F fnc)
+	auto Convert(const ImageView<SRC,CC>& src, F fnc)
 	-> typename detail::ImageFromPixelType<typename std::decay<decltype(fnc(src[0]))>::type>::type
 	{
 		using img_t = typename detail::ImageFromPixelType<typename std::decay<decltype(fnc(src[0]))>::type>::type;
 		img_t dst{src.dimensions()};
-		for(size_t i=0; i<src.size(); i++) {
-			dst[i] = fnc(src[i]);
-		}
+		detail::ConvertInto(src, dst, fnc);
 		return dst;
 	}
 
 	template<typename SRC, unsigned CC, typename F>
-	auto ConvertUV(const Image<SRC,CC>& src, F fnc)
+	auto Convert(const Image<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src.view(), fnc))
+	{ return Convert(src.view(), fnc); }
+
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(const ImageView<SRC,CC>& src, F fnc)
 	-> typename detail::ImageFromPixelType<typename std::decay<decltype(fnc(0,0,src[0]))>::type>::type
 	{
 		using img_t = typename detail::ImageFromPixelType<typename std::decay<decltype(fnc(0,0,src[0]))>::type>::type;
-		const unsigned width = src.width();
-		const unsigned height = src.height();
-		img_t dst{width, height};
-		for(unsigned y=0, i=0; y<height; y++) {
-			for(unsigned x=0; x<width; x++, i++) {
-				dst[i] = fnc(x,y,src[i]);
-			}
-		}
+		img_t dst{src.dimensions()};
+		detail::ConvertUVInto(src, dst, fnc);
 		return dst;
 	}
 
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(const Image<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src.view(), fnc))
+	{ return ConvertUV(src.view(), fnc); }
+
 	template<typename K>
-	Image1f Rescale(const Image<K,1>& img, float min, float max)
+	Image1f Rescale(const ImageView<K,1>& img, float min, float max)
 	{
 		if(min == max) {
 			return Image1f(img.dimensions(), 0.5f);
@@ -62,24 +144,36 @@ namespace slimage
 	}
 
 	template<typename K>
-	Image1f Rescale(const Image<K,1>& img)
+	Image1f Rescale(const Image<K,1>& img, float min, float max)
+	{ return Rescale(img.view(), min, max); }
+
+	template<typename K>
+	Image1f Rescale(const ImageView<K,1>& img)
 	{
-		float min = img[0], max = img[0];
-		for(float v : img) {
-			min = std::min(min, v);
-			max = std::max(max, v);
-		}
-		if(min == max) {
+		const auto range = detail::MinMaxRows(img, 0, img.height());
+		const float min = range.first, max = range.second;
+		if(!(min < max)) {
 			return Image1f(img.dimensions(), 0.5f);
 		}
 		float scl = 1.0f / (max - min);
 		return Convert(img, [scl,min](float v) { return scl*(v - min); });
 	}
 
+	template<typename K>
+	Image1f Rescale(const Image<K,1>& img)
+	{ return Rescale(img.view()); }
+
+	// The channel swizzles process as many pixels as possible with the SIMD kernels from
+	// simd.hpp (for element types of size 1, 2 or 4) and handle the rest with scalar code.
+
 	template<typename K>
 	void Copy_RGBA_to_BGRA(const K* src, const K* src_end, K* dst)
 	{
-		// FIXME this is probably not very performant
+		if(std::is_arithmetic<K>::value) {
+			const size_t n = detail::SimdSwizzle(detail::SwizzleOp::RGBA_to_BGRA, sizeof(K), src, (src_end - src)*sizeof(K), dst, nullptr) / sizeof(K);
+			src += n;
+			dst += n;
+		}
 		for(; src != src_end; src+=4, dst+=4) {
 			dst[0] = src[2];
 			dst[1] = src[1];
@@ -91,7 +185,11 @@ namespace slimage
 	template<typename K>
 	void Copy_RGBA_to_BGR(const K* src, const K* src_end, K* dst)
 	{
-		// FIXME this is probably not very performant
+		if(std::is_arithmetic<K>::value) {
+			const size_t n = detail::SimdSwizzle(detail::SwizzleOp::RGBA_to_BGR, sizeof(K), src, (src_end - src)*sizeof(K), dst, nullptr) / sizeof(K);
+			src += n;
+			dst += n/4*3;
+		}
 		for(; src != src_end; src+=4, dst+=3) {
 			dst[0] = src[2];
 			dst[1] = src[1];
@@ -102,7 +200,11 @@ namespace slimage
 	template<typename K>
 	void Copy_RGB_to_BGRA(const K* src, const K* src_end, K* dst, K alpha)
 	{
-		// FIXME this is probably not very performant
+		if(std::is_arithmetic<K>::value) {
+			const size_t n = detail::SimdSwizzle(detail::SwizzleOp::RGB_to_BGRA, sizeof(K), src, (src_end - src)*sizeof(K), dst, &alpha) / sizeof(K);
+			src += n;
+			dst += n/3*4;
+		}
 		for(; src != src_end; src+=3, dst+=4) {
 			dst[0] = src[2];
 			dst[1] = src[1];
@@ -114,7 +216,11 @@ namespace slimage
 	template<typename K>
 	void Copy_RGB_to_BGR(const K* src, const K* src_end, K* dst)
 	{
-		// FIXME this is probably not very performant
+		if(std::is_arithmetic<K>::value) {
+			const size_t n = detail::SimdSwizzle(detail::SwizzleOp::RGB_to_BGR, sizeof(K), src, (src_end - src)*sizeof(K), dst, nullptr) / sizeof(K);
+			src += n;
+			dst += n;
+		}
 		for(; src != src_end; src+=3, dst+=3) {
 			dst[0] = src[2];
 			dst[1] = src[1];
@@ -123,7 +229,7 @@ namespace slimage
 	}
 
 	template<typename K, unsigned CC, typename F1, typename F2>
-	void CopyScanlines(const Image<K,CC>& src, F1 fdst, F2 fcpy)
+	void CopyScanlines(const ImageView<K,CC>& src, F1 fdst, F2 fcpy)
 	{
 		const size_t n = src.numElementsScanline();
 		for(unsigned y=0; y<src.height(); y++) {
@@ -132,19 +238,23 @@ namespace slimage
 		}
 	}
 
+	template<typename K, unsigned CC, typename F1, typename F2>
+	void CopyScanlines(const Image<K,CC>& src, F1 fdst, F2 fcpy)
+	{ CopyScanlines(src.view(), fdst, fcpy); }
+
 	template<typename K, unsigned CC, typename F1>
-	void CopyScanlines(const Image<K,CC>& src, F1 fdst)
+	void CopyScanlines(const ImageView<K,CC>& src, F1 fdst)
 	{
-		CopyScanlines(src, fdst, std::copy<const K*,K*>);
-		// const size_t n = src.numElementsScanline();
-		// for(unsigned y=0; y<src.height(); y++) {
-		// 	const K* p = src.pixel_pointer(0,y);
-		// 	std::copy(p, p+n, fdst(y));
-		// }
+		using base_t = typename std::remove_const<K>::type;
+		CopyScanlines(src, fdst, std::copy<const base_t*,base_t*>);
 	}
 
+	template<typename K, unsigned CC, typename F1>
+	void CopyScanlines(const Image<K,CC>& src, F1 fdst)
+	{ CopyScanlines(src.view(), fdst); }
+
 	template<typename K, unsigned CC, typename F1, typename F2>
-	void CopyScanlines(F1 fsrc, Image<K,CC>& dst, F2 fcpy)
+	void CopyScanlines(F1 fsrc, const ImageView<K,CC>& dst, F2 fcpy)
 	{
 		const size_t n = dst.numElementsScanline();
 		for(unsigned y=0; y<dst.height(); y++) {
@@ -153,24 +263,37 @@ namespace slimage
 		}
 	}
 
+	template<typename K, unsigned CC, typename F1, typename F2>
+	void CopyScanlines(F1 fsrc, Image<K,CC>& dst, F2 fcpy)
+	{ CopyScanlines(fsrc, dst.view(), fcpy); }
+
 	template<typename K, unsigned CC, typename F1>
-	void CopyScanlines(F1 fsrc, const Image<K,CC>& dst)
-	{
-		CopyScanlines(fsrc, dst, std::copy<const K*,K*>);
-		// const size_t n = dst.numElementsScanline();
-		// for(unsigned y=0; y<dst.height(); y++) {
-		// 	const K* p = dst.pixel_pointer(0,y);
-		// 	 std::copy(fsrc(y), fsrc(y)+n, p);
-		// }
-	}
+	void CopyScanlines(F1 fsrc, const ImageView<K,CC>& dst)
+	{ CopyScanlines(fsrc, dst, std::copy<const K*,K*>); }
+
+	template<typename K, unsigned CC, typename F1>
+	void CopyScanlines(F1 fsrc, Image<K,CC>& dst)
+	{ CopyScanlines(fsrc, dst.view()); }
 
 	template<typename K, unsigned CC>
-	Image<K,1> PickChannel(const Image<K,CC>& img, unsigned c)
+	Image<typename std::remove_const<K>::type,1> PickChannel(const ImageView<K,CC>& img, unsigned c)
 	{
+		using base_t = typename std::remove_const<K>::type;
 		assert(c < CC);
-		return Convert(img, [c](const Pixel<K,CC>& v) { return v[c]; });
+		return Convert(img, [c](const Pixel<base_t,CC>& v) { return v[c]; });
+	}
+
+	template<typename K>
+	Image<typename std::remove_const<K>::type,1> PickChannel(const ImageView<K,1>& img, unsigned c)
+	{
+		assert(c == 0);
+		return Copy(img);
 	}
 
+	template<typename K, unsigned CC>
+	Image<K,1> PickChannel(const Image<K,CC>& img, unsigned c)
+	{ return PickChannel(img.view(), c); }
+
 	template<typename K>
 	Image<K,1> PickChannel(const Image<K,1>& img, unsigned c)
 	{
@@ -179,33 +302,49 @@ namespace slimage
 	}
 
 	template<typename K, unsigned CC>
-	void Fill(Image<K,CC>& img, const Pixel<K,CC>& v)
+	void Fill(const ImageView<K,CC>& img, const Pixel<K,CC>& v)
 	{
-		std::fill(img.begin(), img.end(), v);
+		for(unsigned y=0; y<img.height(); y++) {
+			std::fill(img.beginScanline(y), img.endScanline(y), v);
+		}
 	}
 
+	template<typename K, unsigned CC>
+	void Fill(Image<K,CC>& img, const Pixel<K,CC>& v)
+	{ Fill(img.view(), v); }
+
+	template<typename K, unsigned CC>
+	Image<typename std::remove_const<K>::type,CC> SubImage(const ImageView<K,CC>& img, unsigned x, unsigned y, unsigned w, unsigned h)
+	{ return Copy(img.sub(x, y, w, h)); }
+
 	template<typename K, unsigned CC>
 	Image<K,CC> SubImage(const Image<K,CC>& img, unsigned x, unsigned y, unsigned w, unsigned h)
+	{ return SubImage(img.view(), x, y, w, h); }
+
+	namespace detail
 	{
-		Image<K,CC> result(w, h);	
-		for(unsigned i=0; i<h; i++) {
-			auto p = img.pixel_pointer(x,y+i);
-			std::copy(p, p+CC*w, result.pixel_pointer(0,i));
+		template<typename K, unsigned CC, typename IMG>
+		void FlipYInto(const ImageView<K,CC>& img, IMG& result)
+		{
+			const unsigned height = img.height();
+			CopyScanlines(img, [&result,height](unsigned y) { return result.pixel_pointer(0,height-1-y); });
 		}
-		return result;
 	}
 
 	template<typename K, unsigned CC>
-	Image<K,CC> FlipY(const Image<K,CC>& img)
+	Image<typename std::remove_const<K>::type,CC> FlipY(const ImageView<K,CC>& img)
 	{
-		const unsigned height = img.height();
-		Image<K,CC> result(img.dimensions());
-		CopyScanlines(img, [&result,height](unsigned y) { return result.pixel_pointer(0,height-1-y); });
+		Image<typename std::remove_const<K>::type,CC> result(img.dimensions());
+		detail::FlipYInto(img, result);
 		return result;
 	}
 
+	template<typename K, unsigned CC>
+	Image<K,CC> FlipY(const Image<K,CC>& img)
+	{ return FlipY(img.view()); }
+
 	template<typename K>
-	Image<K,3> ConvertToOpenGl(const Image<K,3>& img)
+	Image<typename std::remove_const<K>::type,3> ConvertToOpenGl(const ImageView<K,3>& img)
 	{
 		unsigned int size = 1;
 		unsigned int w = img.width();
@@ -213,27 +352,31 @@ namespace slimage
 		while(size < w || size < h) {
 			size <<= 1;
 		}
-		Image<K,3> glImg(size, size);
+		Image<typename std::remove_const<K>::type,3> glImg(size, size);
 		for(unsigned int i=0; i<size; i++) {
-			K* dst = glImg.pixel_pointer(0, i);
-			const K* src = img.pixel_pointer(0, i);
-			unsigned int a;
+			auto dst = glImg.pixel_pointer(0, i);
+			size_t a;
 			if( i < h ) {
 				// copy first part of line with src data
-				a = 3 * img.width();
+				const K* src = img.pixel_pointer(0, i);
+				a = img.numElementsScanline();
 				std::copy(src, src + a, dst);
 			} else {
 				// first part is empty because no src data for this line
 				a = 0;
 			}
 			// fill rest of line with zeros
-			std::fill(dst + a, dst + 3 * glImg.width(), 0);
+			std::fill(dst + a, dst + glImg.numElementsScanline(), 0);
 		}
 		return glImg;
 	}
 
+	template<typename K>
+	Image<K,3> ConvertToOpenGl(const Image<K,3>& img)
+	{ return ConvertToOpenGl(img.view()); }
+
 	template<typename K, unsigned CC>
-	void PaintPoint(Image<K,CC>& img, int px, int py, const Pixel<K,CC>& color, int size=1)
+	void PaintPoint(const ImageView<K,CC>& img, int px, int py, const Pixel<K,CC>& color, int size=1)
 	{
 		if(px < 0 || int(img.width()) <= px || py < 0 || int(img.height()) <= py) {
 			return;
@@ -296,7 +439,7 @@ namespace slimage
 
 	/** Paints a line */
 	template<typename K, unsigned CC>
-	void PaintLine(Image<K,CC>& img, int x0, int y0, int x1, int y1, const Pixel<K,CC>& color)
+	void PaintLine(const ImageView<K,CC>& img, int x0, int y0, int x1, int y1, const Pixel<K,CC>& color)
 	{
 	//	assert(0 <= x0 && x0 < img.width());
 	//	assert(0 <= x1 && x1 < img.width());
@@ -351,7 +494,7 @@ namespace slimage
 	}
 
 	template<typename K, unsigned CC>
-	void PaintEllipse(Image<K,CC>& img, int cx, int cy, int ux, int uy, int vx, int vy, const Pixel<K,CC>& color, unsigned N=16)
+	void PaintEllipse(const ImageView<K,CC>& img, int cx, int cy, int ux, int uy, int vx, int vy, const Pixel<K,CC>& color, unsigned N=16)
 	{
 		int last_x = cx + ux;
 		int last_y = cy + uy;
@@ -368,20 +511,20 @@ namespace slimage
 	}
 
 	template<typename K, unsigned CC>
-	void FillEllipse(Image<K,CC>& img, int cx, int cy, int ux, int uy, int vx, int vy, const Pixel<K,CC>& color, unsigned N=16)
+	void FillEllipse(const ImageView<K,CC>& img, int cx, int cy, int ux, int uy, int vx, int vy, const Pixel<K,CC>& color, unsigned N=16)
 	{
 		// FIXME implement filling!
-		FillEllipse(img, cx, cy, ux, uy, vx, vy, color, N);
+		PaintEllipse(img, cx, cy, ux, uy, vx, vy, color, N);
 	}
 
 	template<typename K, unsigned CC>
-	void FillCircle(Image<K,CC>& img, int cx, int cy, int r, const Pixel<K,CC>& color, unsigned N=16)
+	void FillCircle(const ImageView<K,CC>& img, int cx, int cy, int r, const Pixel<K,CC>& color, unsigned N=16)
 	{
 		FillEllipse(img, cx, cy, r, 0, 0, r, color, N);
 	}
 
 	template<typename K, unsigned CC>
-	void PaintBox(Image<K,CC>& img, int x, int y, int w, int h, const Pixel<K,CC>& color)
+	void PaintBox(const ImageView<K,CC>& img, int x, int y, int w, int h, const Pixel<K,CC>& color)
 	{
 		const int x0 = std::max<int>(0, x);
 		const int x1 = std::min<int>(img.width(), x+w+1);
@@ -402,7 +545,7 @@ namespace slimage
 	}
 
 	template<typename K, unsigned CC>
-	void FillBox(Image<K,CC>& img, int x, int y, int w, int h, const Pixel<K,CC>& color)
+	void FillBox(const ImageView<K,CC>& img, int x, int y, int w, int h, const Pixel<K,CC>& color)
 	{
 		const int x0 = std::max<int>(0, x);
 		const int x1 = std::min<int>(img.width(), x+w+1);
@@ -415,4 +558,32 @@ namespace slimage
 		}
 	}
 
+	template<typename K, unsigned CC>
+	void PaintPoint(Image<K,CC>& img, int px, int py, const Pixel<K,CC>& color, int size=1)
+	{ PaintPoint(img.view(), px, py, color, size); }
+
+	template<typename K, unsigned CC>
+	void PaintLine(Image<K,CC>& img, int x0, int y0, int x1, int y1, const Pixel<K,CC>& color)
+	{ PaintLine(img.view(), x0, y0, x1, y1, color); }
+
+	template<typename K, unsigned CC>
+	void PaintEllipse(Image<K,CC>& img, int cx, int cy, int ux, int uy, int vx, int vy, const Pixel<K,CC>& color, unsigned N=16)
+	{ PaintEllipse(img.view(), cx, cy, ux, uy, vx, vy, color, N); }
+
+	template<typename K, unsigned CC>
+	void FillEllipse(Image<K,CC>& img, int cx, int cy, int ux, int uy, int vx, int vy, const Pixel<K,CC>& color, unsigned N=16)
+	{ FillEllipse(img.view(), cx, cy, ux, uy, vx, vy, color, N); }
+
+	template<typename K, unsigned CC>
+	void FillCircle(Image<K,CC>& img, int cx, int cy, int r, const Pixel<K,CC>& color, unsigned N=16)
+	{ FillCircle(img.view(), cx, cy, r, color, N); }
+
+	template<typename K, unsigned CC>
+	void PaintBox(Image<K,CC>& img, int x, int y, int w, int h, const Pixel<K,CC>& color)
+	{ PaintBox(img.view(), x, y, w, h, color); }
+
+	template<typename K, unsigned CC>
+	void FillBox(Image<K,CC>& img, int x, int y, int w, int h, const Pixel<K,CC>& color)
+	{ FillBox(img.view(), x, y, w, h, color); }
+
 }
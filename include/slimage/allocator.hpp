@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#if defined _WIN32
+#  include <malloc.h>
+#elif defined __linux__
+#  include <sys/mman.h>
+#endif
+
+namespace slimage
+{
+
+	namespace detail
+	{
+		inline
+		void* AlignedMalloc(std::size_t size, std::size_t alignment)
+		{
+			if(size == 0) {
+				return nullptr;
+			}
+#if defined _WIN32
+			void* p = _aligned_malloc(size, alignment);
+#else
+			void* p = nullptr;
+			if(posix_memalign(&p, alignment, size) != 0) {
+				p = nullptr;
+			}
+#endif
+			if(!p) {
+				throw std::bad_alloc();
+			}
+			return p;
+		}
+
+		inline
+		void AlignedFree(void* p)
+		{
+#if defined _WIN32
+			_aligned_free(p);
+#else
+			std::free(p);
+#endif
+		}
+
+		/** Size of a transparent huge page on x86-64 and most aarch64 kernels */
+		constexpr std::size_t HugePageSize = std::size_t(2) << 20;
+
+		inline
+		std::atomic<std::size_t>& HugePageThresholdStorage()
+		{
+			static std::atomic<std::size_t> threshold{std::size_t(32) << 20};
+			return threshold;
+		}
+
+		/** Like AlignedMalloc but backs large buffers with transparent huge pages where available
+		 * Buffers of at least HugePageThreshold() bytes are aligned to and padded to
+		 * whole huge pages such that the kernel can map them with huge pages only.
+		 */
+		inline
+		void* LargeMalloc(std::size_t size, std::size_t alignment)
+		{
+#if defined __linux__ && defined MADV_HUGEPAGE
+			const std::size_t threshold = HugePageThresholdStorage();
+			if(threshold != 0 && size >= threshold && alignment <= HugePageSize) {
+				const std::size_t padded = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+				void* p = AlignedMalloc(padded, HugePageSize);
+				// only a hint, the buffer works with normal pages if THP is disabled
+				madvise(p, padded, MADV_HUGEPAGE);
+				return p;
+			}
+#endif
+			return AlignedMalloc(size, alignment);
+		}
+
+		/** Allocator for std::vector which returns memory aligned to ALIGN bytes */
+		template<typename T, std::size_t ALIGN=64>
+		struct AlignedAllocator
+		{
+			using value_type = T;
+
+			template<typename U>
+			struct rebind
+			{
+				using other = AlignedAllocator<U,ALIGN>;
+			};
+
+			AlignedAllocator() {}
+
+			template<typename U>
+			AlignedAllocator(const AlignedAllocator<U,ALIGN>&) {}
+
+			T* allocate(std::size_t n)
+			{
+				if(n > static_cast<std::size_t>(-1) / sizeof(T)) {
+					throw std::bad_alloc();
+				}
+				return static_cast<T*>(LargeMalloc(n*sizeof(T), ALIGN));
+			}
+
+			void deallocate(T* p, std::size_t)
+			{ AlignedFree(p); }
+		};
+
+		template<typename T, typename U, std::size_t ALIGN>
+		bool operator==(const AlignedAllocator<T,ALIGN>&, const AlignedAllocator<U,ALIGN>&)
+		{ return true; }
+
+		template<typename T, typename U, std::size_t ALIGN>
+		bool operator!=(const AlignedAllocator<T,ALIGN>&, const AlignedAllocator<U,ALIGN>&)
+		{ return false; }
+	}
+
+	/** Minimal size in bytes of pixel buffers which are backed by transparent huge pages
+	 * Huge pages reduce TLB misses when traversing very large images. Only has an effect
+	 * on Linux with transparent huge pages in 'madvise' or 'always' mode. Use 0 to disable.
+	 */
+	inline
+	void SetHugePageThreshold(std::size_t bytes)
+	{ detail::HugePageThresholdStorage() = bytes; }
+
+	inline
+	std::size_t GetHugePageThreshold()
+	{ return detail::HugePageThresholdStorage(); }
+
+}
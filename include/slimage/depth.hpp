@@ -0,0 +1,261 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+
+namespace slimage
+{
+
+	/** Pinhole camera model of a depth sensor: focal lengths and principal point in pixels */
+	struct PinholeIntrinsics
+	{
+		float fx;
+		float fy;
+		float cx;
+		float cy;
+	};
+
+	/** How raw depth values are interpreted */
+	struct DepthParameters
+	{
+		DepthParameters()
+		:	scale(0.001f),
+			min_raw(1),
+			max_raw(65535),
+			max_hole(0),
+			max_hole_step(0.05f)
+		{}
+
+		/** Metres per raw unit, e.g. 0.001 for millimetres */
+		float scale;
+
+		/** Raw values outside of [min_raw,max_raw] are invalid; 0 is always invalid */
+		uint16_t min_raw;
+		uint16_t max_raw;
+
+		/** Holes of at most this many pixels along a line are filled; 0 disables hole filling */
+		unsigned max_hole;
+
+		/** Holes are only filled if the depth on both sides differs by at most this many metres
+		 * Larger steps are object edges where interpolation would create phantom surfaces.
+		 */
+		float max_hole_step;
+	};
+
+	/** All results of ConvertDepth */
+	struct DepthFrame
+	{
+		/** Depth in metres; 0 for invalid pixels */
+		Image1f depth;
+
+		/** 255 for measured pixels, 128 for pixels filled by hole filling and 0 for invalid pixels */
+		Image1ub mask;
+
+		/** Camera coordinates in metres; NaN for invalid pixels */
+		Image3f points;
+	};
+
+	namespace detail
+	{
+		/** Linearly interpolates runs of zeros which have similar valid depth on both sides */
+		inline
+		void FillDepthHoles(float* z, unsigned n, unsigned max_hole, float max_step)
+		{
+			unsigned x = 0;
+			while(x < n && z[x] == 0.0f) {
+				x++;
+			}
+			while(x < n) {
+				// z[a] is the last valid value before a hole and z[b] the first one after it
+				unsigned a = x;
+				while(a + 1 < n && z[a + 1] != 0.0f) {
+					a++;
+				}
+				unsigned b = a + 1;
+				while(b < n && z[b] == 0.0f) {
+					b++;
+				}
+				if(b >= n) {
+					break;
+				}
+				if(b - a - 1 <= max_hole && std::abs(z[b] - z[a]) <= max_step) {
+					const float step = (z[b] - z[a]) / static_cast<float>(b - a);
+					for(unsigned i=a+1; i<b; i++) {
+						z[i] = z[a] + step*static_cast<float>(i - a);
+					}
+				}
+				x = b;
+			}
+		}
+
+		/** Converts lines [y0,y1) and writes all outputs with a non-null pixel pointer */
+		inline
+		void DepthRows(const ImageView<const uint16_t,1>& raw, const DepthParameters& params, const PinholeIntrinsics& intrinsics,
+			const ImageView<float,1>& depth, const ImageView<unsigned char,1>& mask, const ImageView<float,3>& points,
+			unsigned y0, unsigned y1)
+		{
+			const unsigned width = raw.width();
+			if(width == 0) {
+				return;
+			}
+			std::vector<float> line(width);
+			// (u - cx)/fx is the same for every line
+			std::vector<float> xf;
+			if(points.pixel_pointer()) {
+				xf.resize(width);
+				for(unsigned u=0; u<width; u++) {
+					xf[u] = (static_cast<float>(u) - intrinsics.cx) / intrinsics.fx;
+				}
+			}
+			const float nan = std::numeric_limits<float>::quiet_NaN();
+			const bool fill = params.max_hole > 0;
+			for(unsigned y=y0; y<y1; y++) {
+				float* z = depth.pixel_pointer() ? depth.pixel_pointer(0,y) : line.data();
+				DepthToFloat(raw.pixel_pointer(0,y), width, params.scale, std::max<uint16_t>(1, params.min_raw), params.max_raw, z);
+				unsigned char* m = mask.pixel_pointer() ? mask.pixel_pointer(0,y) : nullptr;
+				if(m) {
+					for(unsigned u=0; u<width; u++) {
+						m[u] = (z[u] != 0.0f) ? 255 : 0;
+					}
+				}
+				if(fill) {
+					FillDepthHoles(z, width, params.max_hole, params.max_hole_step);
+					if(m) {
+						for(unsigned u=0; u<width; u++) {
+							m[u] = (m[u] == 0 && z[u] != 0.0f) ? 128 : m[u];
+						}
+					}
+				}
+				if(points.pixel_pointer()) {
+					const float yf = (static_cast<float>(y) - intrinsics.cy) / intrinsics.fy;
+					float* p = points.pixel_pointer(0,y);
+					for(unsigned u=0; u<width; u++, p+=3) {
+						const float d = z[u];
+						const bool valid = (d != 0.0f);
+						p[0] = valid ? xf[u]*d : nan;
+						p[1] = valid ? yf*d : nan;
+						p[2] = valid ? d : nan;
+					}
+				}
+			}
+		}
+
+		template<typename V>
+		void CheckDepthOutput(const ImageView<const uint16_t,1>& raw, const V& out)
+		{
+			if(out.pixel_pointer() && (out.width() != raw.width() || out.height() != raw.height())) {
+				throw ConversionException("Depth conversion: outputs must have the size of the raw depth image");
+			}
+		}
+
+		inline
+		void CheckDepthOutputs(const ImageView<const uint16_t,1>& raw, const ImageView<float,1>& depth,
+			const ImageView<unsigned char,1>& mask, const ImageView<float,3>& points)
+		{
+			CheckDepthOutput(raw, depth);
+			CheckDepthOutput(raw, mask);
+			CheckDepthOutput(raw, points);
+		}
+	}
+
+	/** Converts raw depth to metres, masks invalid pixels, fills holes and back-projects to points in one pass
+	 * Outputs with a null pixel pointer, e.g. default constructed views, are skipped. Points
+	 * can be written to a packed float array by wrapping it with ImageView<float,3>.
+	 */
+	inline
+	void ConvertDepth(const ImageView<const uint16_t,1>& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params,
+		const ImageView<float,1>& depth, const ImageView<unsigned char,1>& mask, const ImageView<float,3>& points)
+	{
+		detail::CheckDepthOutputs(raw, depth, mask, points);
+		detail::DepthRows(raw, params, intrinsics, depth, mask, points, 0, raw.height());
+	}
+
+	/** ConvertDepth with bands of lines converted in parallel */
+	inline
+	void ConvertDepth(const ParallelPolicy& policy, const ImageView<const uint16_t,1>& raw, const PinholeIntrinsics& intrinsics,
+		const DepthParameters& params, const ImageView<float,1>& depth, const ImageView<unsigned char,1>& mask, const ImageView<float,3>& points)
+	{
+		detail::CheckDepthOutputs(raw, depth, mask, points);
+		ParallelRows(policy, raw.height(), [&](unsigned y0, unsigned y1) {
+			detail::DepthRows(raw, params, intrinsics, depth, mask, points, y0, y1);
+		});
+	}
+
+	/** Computes all outputs of a depth frame and reuses the memory of 'frame' */
+	inline
+	void ConvertDepth(const Image1ui16& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params, DepthFrame& frame)
+	{
+		frame.depth.resize(raw.dimensions());
+		frame.mask.resize(raw.dimensions());
+		frame.points.resize(raw.dimensions());
+		ConvertDepth(raw.view(), intrinsics, params, frame.depth.view(), frame.mask.view(), frame.points.view());
+	}
+
+	inline
+	void ConvertDepth(const ParallelPolicy& policy, const Image1ui16& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params, DepthFrame& frame)
+	{
+		frame.depth.resize(raw.dimensions());
+		frame.mask.resize(raw.dimensions());
+		frame.points.resize(raw.dimensions());
+		ConvertDepth(policy, raw.view(), intrinsics, params, frame.depth.view(), frame.mask.view(), frame.points.view());
+	}
+
+	inline
+	DepthFrame ConvertDepth(const Image1ui16& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params=DepthParameters())
+	{
+		DepthFrame frame;
+		ConvertDepth(raw, intrinsics, params, frame);
+		return frame;
+	}
+
+	inline
+	DepthFrame ConvertDepth(const ParallelPolicy& policy, const Image1ui16& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params=DepthParameters())
+	{
+		DepthFrame frame;
+		ConvertDepth(policy, raw, intrinsics, params, frame);
+		return frame;
+	}
+
+	/** Depth in metres with 0 for invalid pixels */
+	inline
+	Image1f DepthToMeters(const Image1ui16& raw, const DepthParameters& params=DepthParameters())
+	{
+		Image1f depth(raw.dimensions());
+		ConvertDepth(raw.view(), PinholeIntrinsics(), params, depth.view(), ImageView<unsigned char,1>(), ImageView<float,3>());
+		return depth;
+	}
+
+	inline
+	Image1f DepthToMeters(const ParallelPolicy& policy, const Image1ui16& raw, const DepthParameters& params=DepthParameters())
+	{
+		Image1f depth(raw.dimensions());
+		ConvertDepth(policy, raw.view(), PinholeIntrinsics(), params, depth.view(), ImageView<unsigned char,1>(), ImageView<float,3>());
+		return depth;
+	}
+
+	/** Points in camera coordinates with NaN for invalid pixels */
+	inline
+	Image3f DepthToPoints(const Image1ui16& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params=DepthParameters())
+	{
+		Image3f points(raw.dimensions());
+		ConvertDepth(raw.view(), intrinsics, params, ImageView<float,1>(), ImageView<unsigned char,1>(), points.view());
+		return points;
+	}
+
+	inline
+	Image3f DepthToPoints(const ParallelPolicy& policy, const Image1ui16& raw, const PinholeIntrinsics& intrinsics, const DepthParameters& params=DepthParameters())
+	{
+		Image3f points(raw.dimensions());
+		ConvertDepth(policy, raw.view(), intrinsics, params, ImageView<float,1>(), ImageView<unsigned char,1>(), points.view());
+		return points;
+	}
+
+}
@@ -0,0 +1,429 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Lossless compression for 16 bit depth images (.sdepth).
+// Every pixel is predicted from the pixel above (from the left in the first line of a
+// band) and the zigzag coded residuals are bit packed in groups of 16 with the number
+// of bits per group stored in one byte. Bands of lines are coded independently, thus
+// encoding and decoding run in parallel. All values are stored little endian.
+
+namespace slimage
+{
+
+	namespace detail
+	{
+		struct DepthCodecHeader
+		{
+			char magic[8]; // "SLDEPTH" and a terminating zero
+			uint32_t width;
+			uint32_t height;
+			uint32_t band_lines;
+			uint32_t num_bands;
+			// followed by num_bands+1 uint64_t offsets of the bands relative to the end of the offset table
+		};
+
+		static_assert(sizeof(DepthCodecHeader) == 24, "DepthCodecHeader must have a size of 24 bytes");
+
+		constexpr unsigned DepthGroupSize = 16;
+
+		/** Zero bytes at the end of every band so that groups can be unpacked with 32 bit loads */
+		constexpr unsigned DepthPadding = 4;
+
+		inline
+		uint16_t ZigZag(uint16_t residual)
+		{
+			const int16_t r = static_cast<int16_t>(residual);
+			return static_cast<uint16_t>((static_cast<uint16_t>(r) << 1) ^ static_cast<uint16_t>(r >> 15));
+		}
+
+		inline
+		uint16_t UnZigZag(uint16_t z)
+		{ return static_cast<uint16_t>((z >> 1) ^ static_cast<uint16_t>(-(z & 1))); }
+
+		/** Packs 16 values with B bits each into 2*B bytes */
+		template<unsigned B>
+		uint8_t* PackGroup(const uint16_t* src, uint8_t* dst)
+		{
+			uint32_t acc = 0;
+			unsigned bits = 0;
+			for(unsigned i=0; i<DepthGroupSize; i++) {
+				acc |= static_cast<uint32_t>(src[i]) << bits;
+				bits += B;
+				while(bits >= 8) {
+					*dst++ = static_cast<uint8_t>(acc);
+					acc >>= 8;
+					bits -= 8;
+				}
+			}
+			return dst;
+		}
+
+		/** Unpacks 16 values with B bits each from 2*B bytes
+		 * Reads up to DepthPadding bytes past the group, thus every band ends with padding.
+		 */
+		template<unsigned B>
+		const uint8_t* UnpackGroup(const uint8_t* src, uint16_t* dst)
+		{
+			for(unsigned i=0; i<DepthGroupSize; i++) {
+				uint32_t word;
+				std::memcpy(&word, src + i*B/8, sizeof(word));
+				dst[i] = static_cast<uint16_t>((word >> (i*B%8)) & ((1u << B) - 1));
+			}
+			return src + 2*B;
+		}
+
+		template<>
+		inline
+		const uint8_t* UnpackGroup<0>(const uint8_t* src, uint16_t* dst)
+		{
+			std::fill(dst, dst + DepthGroupSize, 0);
+			return src;
+		}
+
+		template<>
+		inline
+		uint8_t* PackGroup<0>(const uint16_t*, uint8_t* dst)
+		{ return dst; }
+
+		/** Calls the kernel instantiated for the given number of bits */
+		template<template<unsigned> class OP, typename... Args>
+		auto DispatchBits(unsigned bits, Args... args) -> decltype(OP<0>::apply(args...))
+		{
+			switch(bits) {
+			case 0: return OP<0>::apply(args...);
+			case 1: return OP<1>::apply(args...);
+			case 2: return OP<2>::apply(args...);
+			case 3: return OP<3>::apply(args...);
+			case 4: return OP<4>::apply(args...);
+			case 5: return OP<5>::apply(args...);
+			case 6: return OP<6>::apply(args...);
+			case 7: return OP<7>::apply(args...);
+			case 8: return OP<8>::apply(args...);
+			case 9: return OP<9>::apply(args...);
+			case 10: return OP<10>::apply(args...);
+			case 11: return OP<11>::apply(args...);
+			case 12: return OP<12>::apply(args...);
+			case 13: return OP<13>::apply(args...);
+			case 14: return OP<14>::apply(args...);
+			case 15: return OP<15>::apply(args...);
+			default: return OP<16>::apply(args...);
+			}
+		}
+
+		template<unsigned B>
+		struct PackOp
+		{
+			static uint8_t* apply(const uint16_t* src, uint8_t* dst)
+			{ return PackGroup<B>(src, dst); }
+		};
+
+		template<unsigned B>
+		struct UnpackOp
+		{
+			static const uint8_t* apply(const uint8_t* src, uint16_t* dst)
+			{ return UnpackGroup<B>(src, dst); }
+		};
+
+		inline
+		unsigned BitWidth(uint16_t v)
+		{
+			unsigned n = 0;
+			while(v != 0) {
+				v >>= 1;
+				n++;
+			}
+			return n;
+		}
+
+		/** Number of bytes needed in the worst case to encode 'lines' lines of 'width' pixels */
+		inline
+		size_t DepthBandCapacity(unsigned width, unsigned lines)
+		{
+			const size_t groups = (width + DepthGroupSize - 1) / DepthGroupSize;
+			return groups*(1 + 2*DepthGroupSize)*lines + DepthPadding;
+		}
+
+		/** Encodes lines [y0,y1) and returns the end of the written data */
+		inline
+		uint8_t* EncodeDepthBand(const ImageView<const uint16_t,1>& img, unsigned y0, unsigned y1, uint8_t* dst)
+		{
+			const unsigned width = img.width();
+			const unsigned groups = (width + DepthGroupSize - 1) / DepthGroupSize;
+			std::vector<uint16_t> residuals(groups*DepthGroupSize, 0);
+			// lines of width 0 have no groups
+			for(unsigned y=y0; y<y1 && width > 0; y++) {
+				const uint16_t* src = img.pixel_pointer(0,y);
+				if(y == y0) {
+					uint16_t left = 0;
+					for(unsigned x=0; x<width; x++) {
+						residuals[x] = ZigZag(static_cast<uint16_t>(src[x] - left));
+						left = src[x];
+					}
+				}
+				else {
+					const uint16_t* above = img.pixel_pointer(0,y-1);
+					for(unsigned x=0; x<width; x++) {
+						residuals[x] = ZigZag(static_cast<uint16_t>(src[x] - above[x]));
+					}
+				}
+				for(unsigned g=0; g<groups; g++) {
+					const uint16_t* group = residuals.data() + g*DepthGroupSize;
+					uint16_t any = 0;
+					for(unsigned i=0; i<DepthGroupSize; i++) {
+						any |= group[i];
+					}
+					const unsigned bits = BitWidth(any);
+					*dst++ = static_cast<uint8_t>(bits);
+					dst = DispatchBits<PackOp>(bits, group, dst);
+				}
+			}
+			std::fill(dst, dst + DepthPadding, 0);
+			return dst + DepthPadding;
+		}
+
+		/** Decodes lines [y0,y1) from [src,end)
+		 * Groups are unpacked and reconstructed in one pass, with SIMD instructions for all
+		 * groups except the last ones of a band and the partial group at the end of a line.
+		 */
+		inline
+		void DecodeDepthBand(const uint8_t* src, const uint8_t* end, const ImageView<uint16_t,1>& img, unsigned y0, unsigned y1)
+		{
+			const unsigned width = img.width();
+			const unsigned groups = (width + DepthGroupSize - 1) / DepthGroupSize;
+			uint16_t residuals[DepthGroupSize];
+			for(unsigned y=y0; y<y1 && width > 0; y++) {
+				uint16_t* dst = img.pixel_pointer(0,y);
+				// the first line of a band is predicted from the left
+				const uint16_t* above = (y == y0) ? nullptr : img.pixel_pointer(0,y-1);
+				unsigned g = SimdDecodeDepthGroups(src, end, width / DepthGroupSize, above, dst);
+				for(; g<groups; g++) {
+					if(static_cast<size_t>(end - src) < 1 + DepthPadding) {
+						throw ConversionException("Corrupt depth image data");
+					}
+					const unsigned bits = *src++;
+					if(bits > 16 || static_cast<size_t>(end - src) < 2*bits + DepthPadding) {
+						throw ConversionException("Corrupt depth image data");
+					}
+					src = DispatchBits<UnpackOp>(bits, src, residuals);
+					const unsigned x = g*DepthGroupSize;
+					const unsigned n = std::min(DepthGroupSize, width - x);
+					if(above) {
+						for(unsigned i=0; i<n; i++) {
+							dst[x+i] = static_cast<uint16_t>(above[x+i] + UnZigZag(residuals[i]));
+						}
+					}
+					else {
+						uint16_t left = (x == 0) ? 0 : dst[x-1];
+						for(unsigned i=0; i<n; i++) {
+							left = static_cast<uint16_t>(left + UnZigZag(residuals[i]));
+							dst[x+i] = left;
+						}
+					}
+				}
+			}
+		}
+
+		/** Reads the offset of band 'b' from the offset table */
+		inline
+		uint64_t DepthBandOffset(const uint8_t* table, unsigned b)
+		{
+			uint64_t offset;
+			std::memcpy(&offset, table + sizeof(uint64_t)*b, sizeof(offset));
+			return offset;
+		}
+
+		/** Calls fnc(b0,b1) for ranges of bands; every band is a separate task as bands are large */
+		template<typename F>
+		void ForEachDepthBand(const ParallelPolicy& policy, unsigned num_bands, F fnc)
+		{ ParallelRows(ParallelPolicy(policy.threads(), 1), num_bands, fnc); }
+
+		template<typename F>
+		void ForEachDepthBand(const SequentialPolicy& policy, unsigned num_bands, F fnc)
+		{ ParallelRows(policy, num_bands, fnc); }
+
+		template<typename POLICY>
+		std::vector<uint8_t> CompressDepthImpl(const POLICY& policy, const ImageView<const uint16_t,1>& img, unsigned band_lines)
+		{
+			if(!IsLittleEndian()) {
+				throw ConversionException("Depth compression is only supported on little endian machines");
+			}
+			band_lines = std::max(1u, band_lines);
+			const unsigned num_bands = (img.height() + band_lines - 1) / band_lines;
+			std::vector<std::vector<uint8_t>> bands(num_bands);
+			ForEachDepthBand(policy, num_bands, [&](unsigned b0, unsigned b1) {
+				for(unsigned b=b0; b<b1; b++) {
+					const unsigned y0 = b*band_lines;
+					const unsigned y1 = std::min(img.height(), y0 + band_lines);
+					bands[b].resize(DepthBandCapacity(img.width(), y1 - y0));
+					uint8_t* end = EncodeDepthBand(img, y0, y1, bands[b].data());
+					bands[b].resize(end - bands[b].data());
+				}
+			});
+			DepthCodecHeader h;
+			std::memcpy(h.magic, "SLDEPTH", 8);
+			h.width = img.width();
+			h.height = img.height();
+			h.band_lines = band_lines;
+			h.num_bands = num_bands;
+			std::vector<uint64_t> offsets(num_bands + 1, 0);
+			for(unsigned b=0; b<num_bands; b++) {
+				offsets[b+1] = offsets[b] + bands[b].size();
+			}
+			const size_t table = sizeof(uint64_t)*offsets.size();
+			std::vector<uint8_t> out(sizeof(h) + table + offsets.back());
+			std::memcpy(out.data(), &h, sizeof(h));
+			std::memcpy(out.data() + sizeof(h), offsets.data(), table);
+			for(unsigned b=0; b<num_bands; b++) {
+				std::copy(bands[b].begin(), bands[b].end(), out.begin() + sizeof(h) + table + offsets[b]);
+			}
+			return out;
+		}
+
+		template<typename POLICY>
+		void DecompressDepthImpl(const POLICY& policy, const uint8_t* data, size_t size, Image<uint16_t,1>& img)
+		{
+			DepthCodecHeader h;
+			if(!IsLittleEndian() || size < sizeof(h)) {
+				throw ConversionException("Not a compressed depth image");
+			}
+			std::memcpy(&h, data, sizeof(h));
+			if(std::memcmp(h.magic, "SLDEPTH", 8) != 0 || h.band_lines == 0
+				|| h.num_bands != (h.height + static_cast<uint64_t>(h.band_lines) - 1) / h.band_lines) {
+				throw ConversionException("Not a compressed depth image");
+			}
+			const size_t table = sizeof(uint64_t)*(static_cast<size_t>(h.num_bands) + 1);
+			if(size - sizeof(h) < table) {
+				throw ConversionException("Corrupt depth image data");
+			}
+			const uint8_t* offsets = data + sizeof(h);
+			const uint8_t* payload = data + sizeof(h) + table;
+			const size_t payload_size = size - sizeof(h) - table;
+			for(unsigned b=0; b<h.num_bands; b++) {
+				if(DepthBandOffset(offsets, b) > DepthBandOffset(offsets, b+1) || DepthBandOffset(offsets, b+1) > payload_size) {
+					throw ConversionException("Corrupt depth image data");
+				}
+			}
+			if(img.width() != h.width || img.height() != h.height) {
+				img.resize(h.width, h.height);
+			}
+			const ImageView<uint16_t,1> view = img.view();
+			ForEachDepthBand(policy, h.num_bands, [&](unsigned b0, unsigned b1) {
+				for(unsigned b=b0; b<b1; b++) {
+					const unsigned y0 = b*h.band_lines;
+					const unsigned y1 = std::min(h.height, y0 + h.band_lines);
+					DecodeDepthBand(payload + DepthBandOffset(offsets, b), payload + DepthBandOffset(offsets, b+1), view, y0, y1);
+				}
+			});
+		}
+	}
+
+	/** Compresses a 16 bit depth image losslessly
+	 * Bands of 'band_lines' lines are coded independently which allows parallel decoding.
+	 */
+	inline
+	std::vector<uint8_t> CompressDepth(const ImageView<const uint16_t,1>& img, unsigned band_lines=16)
+	{ return detail::CompressDepthImpl(seq, img, band_lines); }
+
+	/** CompressDepth with bands encoded in parallel */
+	inline
+	std::vector<uint8_t> CompressDepth(const ParallelPolicy& policy, const ImageView<const uint16_t,1>& img, unsigned band_lines=16)
+	{ return detail::CompressDepthImpl(policy, img, band_lines); }
+
+	/** Decompresses data created with CompressDepth into 'img' which is only reallocated if its size differs
+	 * Throws a ConversionException for corrupt data.
+	 */
+	inline
+	void DecompressDepthInto(const uint8_t* data, size_t size, Image<uint16_t,1>& img)
+	{ detail::DecompressDepthImpl(seq, data, size, img); }
+
+	/** DecompressDepthInto with bands decoded in parallel */
+	inline
+	void DecompressDepthInto(const ParallelPolicy& policy, const uint8_t* data, size_t size, Image<uint16_t,1>& img)
+	{ detail::DecompressDepthImpl(policy, data, size, img); }
+
+	/** Decompresses data created with CompressDepth; throws a ConversionException for corrupt data */
+	inline
+	Image<uint16_t,1> DecompressDepth(const uint8_t* data, size_t size)
+	{
+		Image<uint16_t,1> img;
+		DecompressDepthInto(data, size, img);
+		return img;
+	}
+
+	/** DecompressDepth with bands decoded in parallel */
+	inline
+	Image<uint16_t,1> DecompressDepth(const ParallelPolicy& policy, const uint8_t* data, size_t size)
+	{
+		Image<uint16_t,1> img;
+		DecompressDepthInto(policy, data, size, img);
+		return img;
+	}
+
+	/** True if the filename has the extension .sdepth used for compressed depth images */
+	inline
+	bool IsDepthFilename(const std::string& fn)
+	{ return fn.size() >= 7 && fn.compare(fn.size() - 7, 7, ".sdepth") == 0; }
+
+	/** Saves a compressed depth image; bands are encoded in parallel */
+	inline
+	void SaveDepth(const std::string& fn, const ImageView<const uint16_t,1>& img, const ParallelPolicy& policy=par)
+	{
+		const std::vector<uint8_t> data = CompressDepth(policy, img);
+		std::ofstream ofs(fn, std::ios::binary);
+		if(!ofs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+		if(!ofs) {
+			throw IoException(fn, "Could not write file");
+		}
+	}
+
+	inline
+	void SaveDepth(const std::string& fn, const Image<uint16_t,1>& img, const ParallelPolicy& policy=par)
+	{ SaveDepth(fn, img.view(), policy); }
+
+	/** Loads a compressed depth image into 'img' which is only reallocated if its size differs
+	 * The file is read into a buffer which is kept per thread and reused by later calls.
+	 */
+	inline
+	void LoadDepthInto(const std::string& fn, Image<uint16_t,1>& img, const ParallelPolicy& policy=par)
+	{
+		std::ifstream ifs(fn, std::ios::binary);
+		if(!ifs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		static thread_local std::vector<char> buffer;
+		ifs.seekg(0, std::ios::end);
+		buffer.resize(static_cast<size_t>(ifs.tellg()));
+		ifs.seekg(0, std::ios::beg);
+		ifs.read(buffer.data(), buffer.size());
+		try {
+			DecompressDepthInto(policy, reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(), img);
+		}
+		catch(const ConversionException& e) {
+			throw IoException(fn, e.what());
+		}
+	}
+
+	/** Loads a compressed depth image; bands are decoded in parallel */
+	inline
+	Image<uint16_t,1> LoadDepth(const std::string& fn, const ParallelPolicy& policy=par)
+	{
+		Image<uint16_t,1> img;
+		LoadDepthInto(fn, img, policy);
+		return img;
+	}
+
+}
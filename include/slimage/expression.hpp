@@ -0,0 +1,415 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/algorithm.hpp>
+#include <slimage/parallel.hpp>
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+// Lazy pixel expressions: Lazy(img) wraps an image without touching its pixels and
+// Map, Pick and the arithmetic operators compose new expressions. Nothing is computed
+// until the expression is assigned to an image, which then happens in a single pass
+// without intermediate images:
+//
+//   Image1ub out = Pick(Map(Lazy(img), colormap), 0) * 0.5f;
+//
+// Expressions are evaluated line by line with a cursor per line, which keeps the
+// inner loop free of index computations. Expressions refer to their source images,
+// thus the images must outlive the expressions.
+
+namespace slimage
+{
+
+	/** Base class of all lazy pixel expressions */
+	template<typename E>
+	struct Expression
+	{
+		const E& self() const
+		{ return static_cast<const E&>(*this); }
+
+		/** Evaluates the expression into a new image with element type K */
+		template<typename K, unsigned CC>
+		operator Image<K,CC>() const;
+	};
+
+	namespace detail
+	{
+		template<typename T>
+		struct PixelInfo
+		{
+			using element_t = T;
+			static constexpr unsigned channels = 1;
+		};
+
+		template<typename T, std::size_t CC>
+		struct PixelInfo<std::array<T,CC>>
+		{
+			using element_t = T;
+			static constexpr unsigned channels = CC;
+		};
+
+		/** Applies a binary operation to scalars or element-wise to pixels */
+		template<typename OP>
+		struct ElementWise
+		{
+			template<typename A, typename B>
+			static auto apply(const A& a, const B& b) -> decltype(OP::apply(a,b))
+			{ return OP::apply(a,b); }
+
+			template<typename A, typename B, std::size_t CC>
+			static auto apply(const std::array<A,CC>& a, const std::array<B,CC>& b)
+			-> std::array<decltype(OP::apply(a[0],b[0])),CC>
+			{
+				std::array<decltype(OP::apply(a[0],b[0])),CC> r;
+				for(std::size_t i=0; i<CC; i++) {
+					r[i] = OP::apply(a[i], b[i]);
+				}
+				return r;
+			}
+
+			template<typename A, typename B, std::size_t CC>
+			static auto apply(const std::array<A,CC>& a, const B& b)
+			-> std::array<decltype(OP::apply(a[0],b)),CC>
+			{
+				std::array<decltype(OP::apply(a[0],b)),CC> r;
+				for(std::size_t i=0; i<CC; i++) {
+					r[i] = OP::apply(a[i], b);
+				}
+				return r;
+			}
+
+			template<typename A, typename B, std::size_t CC>
+			static auto apply(const A& a, const std::array<B,CC>& b)
+			-> std::array<decltype(OP::apply(a,b[0])),CC>
+			{
+				std::array<decltype(OP::apply(a,b[0])),CC> r;
+				for(std::size_t i=0; i<CC; i++) {
+					r[i] = OP::apply(a, b[i]);
+				}
+				return r;
+			}
+		};
+
+		#define SLIMAGE_EXPRESSION_OP(NAME,OP) \
+			struct NAME { \
+				template<typename A, typename B> \
+				static auto apply(const A& a, const B& b) -> decltype(a OP b) \
+				{ return a OP b; } \
+			};
+
+		SLIMAGE_EXPRESSION_OP(OpAdd, +)
+		SLIMAGE_EXPRESSION_OP(OpSub, -)
+		SLIMAGE_EXPRESSION_OP(OpMul, *)
+		SLIMAGE_EXPRESSION_OP(OpDiv, /)
+
+		#undef SLIMAGE_EXPRESSION_OP
+
+		/** Converts a pixel value to the pixel type of an image with element type K */
+		template<typename K, typename V>
+		K CastPixel(const V& v, Integer<1>)
+		{ return static_cast<K>(v); }
+
+		template<typename K, typename V, unsigned CC>
+		std::array<K,CC> CastPixel(const V& v, Integer<CC>)
+		{
+			std::array<K,CC> r;
+			for(unsigned i=0; i<CC; i++) {
+				r[i] = static_cast<K>(v[i]);
+			}
+			return r;
+		}
+	}
+
+	/** Expression which reads pixels from an image */
+	template<typename K, unsigned CC>
+	class SourceExpression
+	:	public Expression<SourceExpression<K,CC>>
+	{
+	public:
+		using value_t = Pixel<typename std::remove_const<K>::type,CC>;
+
+		struct Cursor
+		{
+			Iterator<const K,CC> it;
+
+			value_t next()
+			{
+				value_t v = *it;
+				++it;
+				return v;
+			}
+		};
+
+		explicit SourceExpression(const ImageView<const K,CC>& view)
+		:	view_(view)
+		{}
+
+		unsigned width() const
+		{ return view_.width(); }
+
+		unsigned height() const
+		{ return view_.height(); }
+
+		Cursor row(unsigned y) const
+		{ return Cursor{view_.beginScanline(y)}; }
+
+	private:
+		ImageView<const K,CC> view_;
+	};
+
+	/** Expression with the same value for every pixel; adapts to the size of the other operand */
+	template<typename T>
+	class ConstantExpression
+	:	public Expression<ConstantExpression<T>>
+	{
+	public:
+		using value_t = T;
+
+		struct Cursor
+		{
+			T value;
+
+			T next() const
+			{ return value; }
+		};
+
+		explicit ConstantExpression(const T& value)
+		:	value_(value)
+		{}
+
+		unsigned width() const
+		{ return 0; }
+
+		unsigned height() const
+		{ return 0; }
+
+		Cursor row(unsigned) const
+		{ return Cursor{value_}; }
+
+	private:
+		T value_;
+	};
+
+	/** Expression which applies a function to every pixel of another expression */
+	template<typename E, typename F>
+	class MapExpression
+	:	public Expression<MapExpression<E,F>>
+	{
+	public:
+		using value_t = typename std::decay<decltype(std::declval<const F&>()(std::declval<typename E::value_t>()))>::type;
+
+		struct Cursor
+		{
+			typename E::Cursor inner;
+			const F* fnc;
+
+			value_t next()
+			{ return (*fnc)(inner.next()); }
+		};
+
+		MapExpression(const E& e, F fnc)
+		:	e_(e),
+			fnc_(fnc)
+		{}
+
+		unsigned width() const
+		{ return e_.width(); }
+
+		unsigned height() const
+		{ return e_.height(); }
+
+		Cursor row(unsigned y) const
+		{ return Cursor{e_.row(y), &fnc_}; }
+
+	private:
+		E e_;
+		F fnc_;
+	};
+
+	/** Expression which picks one channel of a multi-channel expression */
+	template<typename E>
+	class PickExpression
+	:	public Expression<PickExpression<E>>
+	{
+	public:
+		using value_t = typename detail::PixelInfo<typename E::value_t>::element_t;
+
+		struct Cursor
+		{
+			typename E::Cursor inner;
+			unsigned c;
+
+			value_t next()
+			{ return inner.next()[c]; }
+		};
+
+		PickExpression(const E& e, unsigned c)
+		:	e_(e),
+			c_(c)
+		{ assert(c < detail::PixelInfo<typename E::value_t>::channels); }
+
+		unsigned width() const
+		{ return e_.width(); }
+
+		unsigned height() const
+		{ return e_.height(); }
+
+		Cursor row(unsigned y) const
+		{ return Cursor{e_.row(y), c_}; }
+
+	private:
+		E e_;
+		unsigned c_;
+	};
+
+	/** Expression which combines two expressions pixel by pixel */
+	template<typename A, typename B, typename OP>
+	class BinaryExpression
+	:	public Expression<BinaryExpression<A,B,OP>>
+	{
+	public:
+		using value_t = typename std::decay<decltype(detail::ElementWise<OP>::apply(
+			std::declval<typename A::value_t>(), std::declval<typename B::value_t>()))>::type;
+
+		struct Cursor
+		{
+			typename A::Cursor a;
+			typename B::Cursor b;
+
+			value_t next()
+			{
+				auto va = a.next();
+				auto vb = b.next();
+				return detail::ElementWise<OP>::apply(va, vb);
+			}
+		};
+
+		BinaryExpression(const A& a, const B& b)
+		:	a_(a),
+			b_(b)
+		{
+			assert(a.width() == 0 || b.width() == 0 || (a.width() == b.width() && a.height() == b.height()));
+		}
+
+		unsigned width() const
+		{ return std::max(a_.width(), b_.width()); }
+
+		unsigned height() const
+		{ return std::max(a_.height(), b_.height()); }
+
+		Cursor row(unsigned y) const
+		{ return Cursor{a_.row(y), b_.row(y)}; }
+
+	private:
+		A a_;
+		B b_;
+	};
+
+	/** Wraps an image into a lazy expression */
+	template<typename K, unsigned CC>
+	SourceExpression<typename std::remove_const<K>::type,CC> Lazy(const ImageView<K,CC>& view)
+	{ return SourceExpression<typename std::remove_const<K>::type,CC>(view); }
+
+	template<typename K, unsigned CC>
+	SourceExpression<K,CC> Lazy(const Image<K,CC>& img)
+	{ return SourceExpression<K,CC>(img.view()); }
+
+	/** Lazy version of Convert */
+	template<typename E, typename F>
+	MapExpression<E,F> Map(const Expression<E>& e, F fnc)
+	{ return MapExpression<E,F>(e.self(), fnc); }
+
+	/** Lazy version of PickChannel */
+	template<typename E>
+	PickExpression<E> Pick(const Expression<E>& e, unsigned c)
+	{ return PickExpression<E>(e.self(), c); }
+
+	#define SLIMAGE_EXPRESSION_OPERATOR(OPERATOR,OP) \
+		template<typename A, typename B> \
+		BinaryExpression<A,B,detail::OP> OPERATOR(const Expression<A>& a, const Expression<B>& b) \
+		{ return BinaryExpression<A,B,detail::OP>(a.self(), b.self()); } \
+		template<typename A, typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type> \
+		BinaryExpression<A,ConstantExpression<T>,detail::OP> OPERATOR(const Expression<A>& a, T b) \
+		{ return BinaryExpression<A,ConstantExpression<T>,detail::OP>(a.self(), ConstantExpression<T>(b)); } \
+		template<typename T, typename B, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type> \
+		BinaryExpression<ConstantExpression<T>,B,detail::OP> OPERATOR(T a, const Expression<B>& b) \
+		{ return BinaryExpression<ConstantExpression<T>,B,detail::OP>(ConstantExpression<T>(a), b.self()); }
+
+	SLIMAGE_EXPRESSION_OPERATOR(operator+, OpAdd)
+	SLIMAGE_EXPRESSION_OPERATOR(operator-, OpSub)
+	SLIMAGE_EXPRESSION_OPERATOR(operator*, OpMul)
+	SLIMAGE_EXPRESSION_OPERATOR(operator/, OpDiv)
+
+	#undef SLIMAGE_EXPRESSION_OPERATOR
+
+	namespace detail
+	{
+		template<typename K, unsigned CC, typename E>
+		void AssignRows(const ImageView<K,CC>& dst, const E& e, unsigned y0, unsigned y1)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				auto cursor = e.row(y);
+				for(auto it=dst.beginScanline(y), it_end=dst.endScanline(y); it!=it_end; ++it) {
+					*it = CastPixel<K>(cursor.next(), Integer<CC>());
+				}
+			}
+		}
+	}
+
+	/** Evaluates an expression into an existing image of the same size */
+	template<typename K, unsigned CC, typename E>
+	void Assign(const ImageView<K,CC>& dst, const Expression<E>& e)
+	{
+		assert(dst.width() == e.self().width() && dst.height() == e.self().height());
+		detail::AssignRows(dst, e.self(), 0, dst.height());
+	}
+
+	template<typename K, unsigned CC, typename E>
+	void Assign(Image<K,CC>& dst, const Expression<E>& e)
+	{ Assign(dst.view(), e); }
+
+	/** Evaluates an expression with lines processed in parallel */
+	template<typename K, unsigned CC, typename E>
+	void Assign(const ParallelPolicy& policy, const ImageView<K,CC>& dst, const Expression<E>& e)
+	{
+		assert(dst.width() == e.self().width() && dst.height() == e.self().height());
+		const E& expr = e.self();
+		ParallelRows(policy, dst.height(), [&dst,&expr](unsigned y0, unsigned y1) {
+			detail::AssignRows(dst, expr, y0, y1);
+		});
+	}
+
+	template<typename K, unsigned CC, typename E>
+	void Assign(const ParallelPolicy& policy, Image<K,CC>& dst, const Expression<E>& e)
+	{ Assign(policy, dst.view(), e); }
+
+	/** Evaluates an expression into a new image with the natural pixel type of the expression */
+	template<typename E>
+	typename detail::ImageFromPixelType<typename E::value_t>::type Evaluate(const Expression<E>& e)
+	{
+		typename detail::ImageFromPixelType<typename E::value_t>::type dst(e.self().width(), e.self().height());
+		Assign(dst, e);
+		return dst;
+	}
+
+	template<typename E>
+	typename detail::ImageFromPixelType<typename E::value_t>::type Evaluate(const ParallelPolicy& policy, const Expression<E>& e)
+	{
+		typename detail::ImageFromPixelType<typename E::value_t>::type dst(e.self().width(), e.self().height());
+		Assign(policy, dst, e);
+		return dst;
+	}
+
+	template<typename E>
+	template<typename K, unsigned CC>
+	Expression<E>::operator Image<K,CC>() const
+	{
+		Image<K,CC> dst(self().width(), self().height());
+		Assign(dst, *this);
+		return dst;
+	}
+
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <cassert>
+
+namespace slimage
+{
+
+	/** How pixels outside of the image are computed by filters */
+	enum class BorderMode
+	{
+		/** Repeats the border pixel: aaa|abc */
+		Replicate,
+		/** Mirrors at the border including the border pixel: cba|abc */
+		Reflect,
+		/** Continues at the opposite side: abc|abc */
+		Wrap,
+		/** Pixels outside are zero */
+		Zero
+	};
+
+	/** A one dimensional filter kernel with an odd number of weights centered at size()/2 */
+	class Kernel1D
+	{
+	public:
+		/** The identity kernel */
+		Kernel1D()
+		:	weights_(1, 1.0f)
+		{}
+
+		explicit Kernel1D(std::vector<float> weights)
+		:	weights_(std::move(weights))
+		{
+			if(weights_.size() % 2 != 1) {
+				throw ConversionException("Kernel1D needs an odd number of weights");
+			}
+		}
+
+		Kernel1D(std::initializer_list<float> weights)
+		:	Kernel1D(std::vector<float>(weights))
+		{}
+
+		/** Normalized Gaussian kernel; the radius is 3*sigma rounded up if 0 */
+		static Kernel1D Gaussian(float sigma, unsigned radius=0)
+		{
+			if(!(sigma > 0.0f)) {
+				return Kernel1D();
+			}
+			if(radius == 0) {
+				radius = static_cast<unsigned>(std::ceil(3.0f*sigma));
+			}
+			std::vector<float> w(2*radius + 1);
+			double sum = 0.0;
+			for(unsigned i=0; i<w.size(); i++) {
+				const double x = static_cast<double>(i) - radius;
+				sum += (w[i] = static_cast<float>(std::exp(-x*x/(2.0*sigma*sigma))));
+			}
+			for(float& v : w) {
+				v = static_cast<float>(v / sum);
+			}
+			return Kernel1D(std::move(w));
+		}
+
+		/** Normalized box kernel with 2*radius+1 equal weights */
+		static Kernel1D Box(unsigned radius)
+		{ return Kernel1D(std::vector<float>(2*radius + 1, 1.0f / static_cast<float>(2*radius + 1))); }
+
+		unsigned size() const
+		{ return weights_.size(); }
+
+		unsigned radius() const
+		{ return weights_.size() / 2; }
+
+		float operator[](unsigned i) const
+		{ return weights_[i]; }
+
+		const std::vector<float>& weights() const
+		{ return weights_; }
+
+	private:
+		std::vector<float> weights_;
+	};
+
+	namespace detail
+	{
+		/** Maps a coordinate outside of [0,n) into the image or returns -1 for BorderMode::Zero and n == 0 */
+		inline
+		int BorderIndex(int i, int n, BorderMode mode)
+		{
+			if(i >= 0 && i < n) {
+				return i;
+			}
+			if(n <= 0) {
+				return -1;
+			}
+			switch(mode) {
+			case BorderMode::Replicate:
+				return (i < 0) ? 0 : n - 1;
+			case BorderMode::Reflect: {
+				const int period = 2*n;
+				i %= period;
+				if(i < 0) {
+					i += period;
+				}
+				return (i < n) ? i : period - 1 - i;
+			}
+			case BorderMode::Wrap:
+				i %= n;
+				return (i < 0) ? i + n : i;
+			default:
+				return -1;
+			}
+		}
+
+		/** Converts a filter result to the destination type with rounding and saturation */
+		template<typename L>
+		typename std::enable_if<std::is_integral<L>::value, L>::type FromFloat(float v)
+		{
+			const float lo = static_cast<float>(std::numeric_limits<L>::min());
+			const float hi = static_cast<float>(std::numeric_limits<L>::max());
+			return static_cast<L>(std::floor(std::min(hi, std::max(lo, v)) + 0.5f));
+		}
+
+		template<typename L>
+		typename std::enable_if<!std::is_integral<L>::value, L>::type FromFloat(float v)
+		{ return static_cast<L>(v); }
+
+		template<>
+		inline
+		unsigned char FromFloat<unsigned char>(float v)
+		{ return static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, v)) + 0.5f); }
+
+		template<>
+		inline
+		uint16_t FromFloat<uint16_t>(float v)
+		{ return static_cast<uint16_t>(std::min(65535.0f, std::max(0.0f, v)) + 0.5f); }
+
+		/** Filters bands of lines; every band keeps the horizontally filtered lines in a ring buffer */
+		template<typename K, typename L, unsigned CC>
+		class SeparableBand
+		{
+		public:
+			SeparableBand(const ImageView<const K,CC>& src, const ImageView<L,CC>& dst,
+				const Kernel1D& kx, const Kernel1D& ky, BorderMode border)
+			:	src_(src), dst_(dst), kx_(kx), ky_(ky), border_(border),
+				n_(static_cast<size_t>(src.width())*CC),
+				padded_((src.width() + 2*kx.radius())*CC),
+				ring_(ky.size()*n_),
+				tags_(ky.size(), std::numeric_limits<int>::min()),
+				acc_(n_)
+			{}
+
+			void operator()(unsigned y0, unsigned y1)
+			{
+				if(n_ == 0) {
+					return; // nothing to filter in lines of width 0
+				}
+				const int r = ky_.radius();
+				for(unsigned y=y0; y<y1; y++) {
+					std::fill(acc_.begin(), acc_.end(), 0.0f);
+					for(unsigned k=0; k<ky_.size(); k++) {
+						const int sy = BorderIndex(static_cast<int>(y) + static_cast<int>(k) - r, src_.height(), border_);
+						if(sy >= 0 && ky_[k] != 0.0f) {
+							MulAdd(ky_[k], line(static_cast<int>(y) + static_cast<int>(k) - r, sy), acc_.data(), n_);
+						}
+					}
+					L* out = dst_.pixel_pointer(0,y);
+					for(size_t i=0; i<n_; i++) {
+						out[i] = FromFloat<L>(acc_[i]);
+					}
+				}
+			}
+
+		private:
+			/** Horizontally filtered source line 'sy' stored for the logical line 'j' */
+			const float* line(int j, int sy)
+			{
+				const unsigned slot = static_cast<unsigned>(((j % static_cast<int>(ky_.size())) + static_cast<int>(ky_.size())) % static_cast<int>(ky_.size()));
+				float* h = ring_.data() + slot*n_;
+				if(tags_[slot] == j) {
+					return h;
+				}
+				tags_[slot] = j;
+				// source line with converted border pixels on both sides
+				const int w = src_.width();
+				const int rx = kx_.radius();
+				const K* s = src_.pixel_pointer(0,sy);
+				for(int x=-rx; x<w+rx; x++) {
+					float* p = padded_.data() + (x + rx)*CC;
+					const int sx = (x >= 0 && x < w) ? x : BorderIndex(x, w, border_);
+					for(unsigned c=0; c<CC; c++) {
+						p[c] = (sx >= 0) ? static_cast<float>(s[sx*CC + c]) : 0.0f;
+					}
+				}
+				std::fill(h, h + n_, 0.0f);
+				for(unsigned k=0; k<kx_.size(); k++) {
+					if(kx_[k] != 0.0f) {
+						MulAdd(kx_[k], padded_.data() + k*CC, h, n_);
+					}
+				}
+				return h;
+			}
+
+			ImageView<const K,CC> src_;
+			ImageView<L,CC> dst_;
+			const Kernel1D& kx_;
+			const Kernel1D& ky_;
+			BorderMode border_;
+			size_t n_; // elements per line
+			std::vector<float> padded_;
+			std::vector<float> ring_; // ky.size() horizontally filtered lines
+			std::vector<int> tags_; // logical line stored in each slot of the ring
+			std::vector<float> acc_;
+		};
+
+		template<typename K, typename L, unsigned CC>
+		void CheckSeparableFilter(const ImageView<const K,CC>& src, const ImageView<L,CC>& dst)
+		{
+			if(src.width() != dst.width() || src.height() != dst.height()) {
+				throw ConversionException("SeparableFilter: source and destination must have the same size");
+			}
+			// empty images have a null pixel pointer
+			assert((src.pixel_pointer() == nullptr
+				|| static_cast<const void*>(src.pixel_pointer()) != static_cast<const void*>(dst.pixel_pointer()))
+				&& "SeparableFilter can not filter in place");
+		}
+	}
+
+	/** Correlates 'src' with 'kx' along lines and then with 'ky' along columns and writes the result to 'dst'
+	 * Kernels are not flipped: weight i is applied to the pixel at offset i - size()/2, thus
+	 * {-1,0,1} computes f(x+1) - f(x-1). 'dst' must have the size of 'src' and may have a
+	 * different element type, e.g. float for derivative kernels. Results are rounded and
+	 * saturated for integer types.
+	 */
+	template<typename K, typename L, unsigned CC>
+	void SeparableFilter(const ImageView<K,CC>& src, const ImageView<L,CC>& dst,
+		const Kernel1D& kx, const Kernel1D& ky, BorderMode border=BorderMode::Replicate)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		const ImageView<const base_t,CC> csrc = src;
+		detail::CheckSeparableFilter(csrc, dst);
+		detail::SeparableBand<base_t,L,CC> band(csrc, dst, kx, ky, border);
+		band(0, src.height());
+	}
+
+	/** SeparableFilter with bands of lines filtered in parallel */
+	template<typename K, typename L, unsigned CC>
+	void SeparableFilter(const ParallelPolicy& policy, const ImageView<K,CC>& src, const ImageView<L,CC>& dst,
+		const Kernel1D& kx, const Kernel1D& ky, BorderMode border=BorderMode::Replicate)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		const ImageView<const base_t,CC> csrc = src;
+		detail::CheckSeparableFilter(csrc, dst);
+		// every band filters ky.size()-1 lines more than it writes, thus bands must not be too small
+		const ParallelPolicy bands(policy.threads(), std::max(policy.min_band_rows, 4*ky.size()));
+		ParallelRows(bands, src.height(), [&](unsigned y0, unsigned y1) {
+			detail::SeparableBand<base_t,L,CC> band(csrc, dst, kx, ky, border);
+			band(y0, y1);
+		});
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> SeparableFilter(const Image<K,CC>& src, const Kernel1D& kx, const Kernel1D& ky, BorderMode border=BorderMode::Replicate)
+	{
+		Image<K,CC> dst(src.dimensions());
+		SeparableFilter(src.view(), dst.view(), kx, ky, border);
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> SeparableFilter(const ParallelPolicy& policy, const Image<K,CC>& src, const Kernel1D& kx, const Kernel1D& ky, BorderMode border=BorderMode::Replicate)
+	{
+		Image<K,CC> dst(src.dimensions());
+		SeparableFilter(policy, src.view(), dst.view(), kx, ky, border);
+		return dst;
+	}
+
+	/** Gaussian blur with standard deviation 'sigma' in pixels */
+	template<typename K, unsigned CC>
+	Image<K,CC> GaussianBlur(const Image<K,CC>& src, float sigma, BorderMode border=BorderMode::Replicate)
+	{
+		const Kernel1D k = Kernel1D::Gaussian(sigma);
+		return SeparableFilter(src, k, k, border);
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> GaussianBlur(const ParallelPolicy& policy, const Image<K,CC>& src, float sigma, BorderMode border=BorderMode::Replicate)
+	{
+		const Kernel1D k = Kernel1D::Gaussian(sigma);
+		return SeparableFilter(policy, src, k, k, border);
+	}
+
+	/** Mean over a window of (2*radius+1) x (2*radius+1) pixels */
+	template<typename K, unsigned CC>
+	Image<K,CC> BoxBlur(const Image<K,CC>& src, unsigned radius, BorderMode border=BorderMode::Replicate)
+	{
+		const Kernel1D k = Kernel1D::Box(radius);
+		return SeparableFilter(src, k, k, border);
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> BoxBlur(const ParallelPolicy& policy, const Image<K,CC>& src, unsigned radius, BorderMode border=BorderMode::Replicate)
+	{
+		const Kernel1D k = Kernel1D::Box(radius);
+		return SeparableFilter(policy, src, k, k, border);
+	}
+
+}
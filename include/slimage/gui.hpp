@@ -1,8 +1,8 @@
 #pragma once
 
 #ifndef SLIMAGE_OPENCV_INC
+#  define SLIMAGE_OPENCV_INC_UNDO // only for display, Load/Save in slimage/io.hpp do not use OpenCV
 #  include <slimage/opencv.hpp>
-#  define SLIMAGE_OPENCV_INC_UNDO
 #endif
 #include <slimage/algorithm.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -2,16 +2,35 @@
 
 #include <slimage/pixel.hpp>
 #include <slimage/iterator.hpp>
+#include <slimage/view.hpp>
+#include <slimage/allocator.hpp>
 #include <slimage/error.hpp>
 #include <algorithm>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 #include <memory>
+#include <utility>
 #include <cassert>
 #include <stdint.h>
 
 namespace slimage
 {
+	/** Layout option for Image which pads lines to a multiple of 'alignment' bytes
+	 * The image buffer itself is always 64-byte aligned, thus with an alignment which
+	 * is a multiple of 64 every line starts at an address suitable for aligned SIMD loads.
+	 * Line lengths which are a multiple of 4096 bytes get an additional alignment unit of
+	 * padding to avoid 4K aliasing between vertically neighbouring pixels.
+	 */
+	struct RowPadding
+	{
+		explicit RowPadding(size_t alignment=64)
+		:	alignment(alignment)
+		{}
+
+		size_t alignment;
+	};
+
 	template<typename K, unsigned CC, typename IDX=unsigned>
 	class Image
 	{
@@ -23,24 +42,39 @@ namespace slimage
 		using reference_t = typename iterator_t::reference;
 		using const_reference_t = typename const_iterator_t::reference;
 		using dim_t = std::tuple<unsigned,unsigned>;
+		using view_t = ImageView<K,CC>;
+		using const_view_t = ImageView<const K,CC>;
 
 		Image()
 		:	width_(0),
-			height_(0)
+			height_(0),
+			stride_(0),
+			alignment_(0)
 		{}
 
 		Image(idx_t width, idx_t height)
 		:	width_(width),
 			height_(height),
-			data_(CC*width*height)
+			stride_(static_cast<size_t>(CC)*width),
+			alignment_(0),
+			data_(static_cast<size_t>(CC)*width*height)
 		{}
 
 		Image(idx_t width, idx_t height, const Pixel<K,CC>& value)
-		:	width_(width),
-			height_(height),
-			data_(CC*width*height)
+		:	Image(width, height)
+		{
+			fill(value);
+		}
+
+		/** Creates an image with padded lines, see RowPadding */
+		Image(idx_t width, idx_t height, RowPadding padding)
+		:	width_(0),
+			height_(0),
+			stride_(0),
+			alignment_(padding.alignment)
 		{
-			std::fill(begin(), end(), value);
+			assert(alignment_ % sizeof(K) == 0);
+			resize(width, height);
 		}
 
 		Image(dim_t dim)
@@ -51,11 +85,17 @@ namespace slimage
 		:	Image(std::get<0>(dim), std::get<1>(dim), value)
 		{}
 
+		Image(dim_t dim, RowPadding padding)
+		:	Image(std::get<0>(dim), std::get<1>(dim), padding)
+		{}
+
+		/** Changes the image size; the line padding of the image is preserved */
 		void resize(idx_t width, idx_t height)
 		{
 			width_ = width;
 			height_ = height;
-			data_.resize(CC*width_*height_);
+			stride_ = computeStride(width_);
+			data_.resize(stride_*height_);
 		}
 
 		void resize(dim_t dim)
@@ -81,43 +121,88 @@ namespace slimage
 
 		/** Number of pixels, i.e. width()*height() */
 		size_t size() const
-		{ return width_*height_; }
+		{ return static_cast<size_t>(width_)*height_; }
 
 		/** Number of elements in the whole image, i.e. width()*height()*channelCount() */
 		size_t numElementsImage() const
-		{ return data_.size(); }
+		{ return CC*size(); }
 
 		/** Number of elements in a line, i.e. width()*channelCount() */
 		size_t numElementsScanline() const
-		{ return CC*width_; }
+		{ return static_cast<size_t>(CC)*width_; }
+
+		/** Distance in bytes between the beginnings of two consecutive lines */
+		size_t stride() const
+		{ return stride_*sizeof(K); }
+
+		/** True if lines are not padded and the image can be traversed with begin() and end() */
+		bool isContiguous() const
+		{ return stride_ == numElementsScanline() || height_ <= 1; }
 
-		reference_t operator[](idx_t i)
-		//{ return make_ref(pixel_pointer(i), Integer<CC>()); }
-		{ return *(begin() + i); }
+		reference_t operator[](size_t i)
+		{ return *iterator_t{pixel_pointer(i)}; }
 
-		const_reference_t operator[](idx_t i) const
-		//{ return make_ref(pixel_pointer(i), Integer<CC>()); }
-		{ return *(begin() + i); }
+		const_reference_t operator[](size_t i) const
+		{ return *const_iterator_t{pixel_pointer(i)}; }
 
 		reference_t operator()(idx_t x, idx_t y)
-		//{ return make_ref(pixel_pointer(x,y), Integer<CC>()); }
-		{ return *(begin() + index(x,y)); }
+		{ return *iterator_t{pixel_pointer(x,y)}; }
 
 		const_reference_t operator()(idx_t x, idx_t y) const
-		//{ return make_ref(pixel_pointer(x,y), Integer<CC>()); }
-		{ return *(begin() + index(x,y)); }
+		{ return *const_iterator_t{pixel_pointer(x,y)}; }
 
 		iterator_t begin()
-		{ return iterator_t{pixel_pointer()}; }
+		{
+			assert(isContiguous());
+			return iterator_t{data_.data()};
+		}
 
 		iterator_t end()
-		{ return iterator_t{pixel_pointer() + CC*size()}; }
+		{
+			assert(isContiguous());
+			return iterator_t{data_.data() + CC*size()};
+		}
 
 		const_iterator_t begin() const
-		{ return const_iterator_t{pixel_pointer()}; }
+		{
+			assert(isContiguous());
+			return const_iterator_t{data_.data()};
+		}
 
 		const_iterator_t end() const
-		{ return const_iterator_t{pixel_pointer() + CC*size()}; }
+		{
+			assert(isContiguous());
+			return const_iterator_t{data_.data() + CC*size()};
+		}
+
+		/** Iterator to the first pixel in line y */
+		iterator_t beginScanline(idx_t y)
+		{ return iterator_t{pixel_pointer(0,y)}; }
+
+		/** Iterator past the last pixel in line y */
+		iterator_t endScanline(idx_t y)
+		{ return iterator_t{pixel_pointer(0,y) + numElementsScanline()}; }
+
+		const_iterator_t beginScanline(idx_t y) const
+		{ return const_iterator_t{pixel_pointer(0,y)}; }
+
+		const_iterator_t endScanline(idx_t y) const
+		{ return const_iterator_t{pixel_pointer(0,y) + numElementsScanline()}; }
+
+		/** A non-owning view onto the pixels of this image */
+		view_t view()
+		{ return view_t(data_.data(), width_, height_, stride()); }
+
+		const_view_t view() const
+		{ return const_view_t(data_.data(), width_, height_, stride()); }
+
+		/** Sets all pixels to the given value */
+		void fill(const Pixel<K,CC>& value)
+		{
+			for(idx_t y=0; y<height_; y++) {
+				std::fill(beginScanline(y), endScanline(y), value);
+			}
+		}
 
 		bool isValidIndex(idx_t x, idx_t y) const
 		{ return 0 <= x && x < width_ && 0 <= y && y < height_; }
@@ -125,30 +210,57 @@ namespace slimage
 		size_t index(idx_t x, idx_t y) const
 		{
 			assert(isValidIndex(x,y));
-			return x + y*width_;
+			return static_cast<size_t>(x) + static_cast<size_t>(y)*width_;
 		}
 
 		element_t* pixel_pointer(idx_t x, idx_t y)
-		{ return data_.data() + CC*index(x,y); } 
+		{
+			assert(isValidIndex(x,y));
+			return data_.data() + static_cast<size_t>(y)*stride_ + static_cast<size_t>(CC)*x;
+		}
 
 		const element_t* pixel_pointer(idx_t x, idx_t y) const
-		{ return data_.data() + CC*index(x,y); } 
+		{
+			assert(isValidIndex(x,y));
+			return data_.data() + static_cast<size_t>(y)*stride_ + static_cast<size_t>(CC)*x;
+		}
 
 		element_t* pixel_pointer(size_t i=0)
 		{
 			assert(i < size()); // TODO this is a bit of a hack but we need to support end()
-			return data_.data() + CC*i;
+			return data_.data() + offset(i);
 		} 
 
 		const element_t* pixel_pointer(size_t i=0) const
 		{
 			assert(i < size()); // TODO this is a bit of a hack but we need to support end()
-			return data_.data() + CC*i;
+			return data_.data() + offset(i);
 		} 
 
+	private:
+		/** Offset of the i-th pixel in elements */
+		size_t offset(size_t i) const
+		{ return (stride_ == numElementsScanline()) ? CC*i : (i / width_)*stride_ + CC*(i % width_); }
+
+		/** Number of elements per line including padding */
+		size_t computeStride(idx_t width) const
+		{
+			const size_t bytes = static_cast<size_t>(CC)*width*sizeof(K);
+			if(alignment_ == 0) {
+				return bytes / sizeof(K);
+			}
+			size_t padded = ((bytes + alignment_ - 1) / alignment_) * alignment_;
+			if(padded > 0 && padded % 4096 == 0) {
+				padded += alignment_;
+			}
+			return padded / sizeof(K);
+		}
+
 	private:
 		idx_t width_, height_;
-		std::vector<element_t> data_;
+		size_t stride_; // in elements
+		size_t alignment_; // 0 for packed lines
+		std::vector<element_t, detail::AlignedAllocator<element_t>> data_;
 	};
 
 	#define SLIMAGE_CREATE_TYPEDEF(K,CC,S)\
@@ -169,6 +281,46 @@ namespace slimage
 	SLIMAGE_CREATE_TYPEDEF(uint16_t, 1, ui16)
 	SLIMAGE_CREATE_TYPEDEF(int, 1, i)
 
+	/** Type of the pixel elements of an anonymous image
+	 * The numeric values are stored in files and must not change.
+	 */
+	enum class ElementType : uint32_t
+	{
+		Unknown = 0,
+		UInt8 = 1,
+		Int8 = 2,
+		UInt16 = 3,
+		Int16 = 4,
+		UInt32 = 5,
+		Int32 = 6,
+		Float32 = 7,
+		Float64 = 8
+	};
+
+	/** Maps the element type K to its ElementType tag */
+	template<typename K> struct ElementTypeOf : std::integral_constant<ElementType, ElementType::Unknown> {};
+	template<> struct ElementTypeOf<unsigned char> : std::integral_constant<ElementType, ElementType::UInt8> {};
+	template<> struct ElementTypeOf<signed char> : std::integral_constant<ElementType, ElementType::Int8> {};
+	template<> struct ElementTypeOf<uint16_t> : std::integral_constant<ElementType, ElementType::UInt16> {};
+	template<> struct ElementTypeOf<int16_t> : std::integral_constant<ElementType, ElementType::Int16> {};
+	template<> struct ElementTypeOf<uint32_t> : std::integral_constant<ElementType, ElementType::UInt32> {};
+	template<> struct ElementTypeOf<int32_t> : std::integral_constant<ElementType, ElementType::Int32> {};
+	template<> struct ElementTypeOf<float> : std::integral_constant<ElementType, ElementType::Float32> {};
+	template<> struct ElementTypeOf<double> : std::integral_constant<ElementType, ElementType::Float64> {};
+
+	/** Size of one element in bytes or 0 for ElementType::Unknown */
+	inline
+	unsigned ElementSize(ElementType type)
+	{
+		switch(type) {
+		case ElementType::UInt8: case ElementType::Int8: return 1;
+		case ElementType::UInt16: case ElementType::Int16: return 2;
+		case ElementType::UInt32: case ElementType::Int32: case ElementType::Float32: return 4;
+		case ElementType::Float64: return 8;
+		default: return 0;
+		}
+	}
+
 	namespace detail
 	{
 		struct AnonymousInterface
@@ -177,6 +329,11 @@ namespace slimage
 			virtual unsigned width() const = 0;
 			virtual unsigned height() const = 0;
 			virtual unsigned channelCount() const = 0;
+			virtual ElementType elementType() const = 0;
+			/** Pointer to the first pixel */
+			virtual const void* data() const = 0;
+			/** Distance in bytes between the beginnings of two consecutive lines */
+			virtual size_t stride() const = 0;
 		};
 
 		template<typename K, unsigned CC>
@@ -188,7 +345,7 @@ namespace slimage
 			{}
 
 			AnonymousImpl(Image<K,CC>&& img)
-			:	img(std::forward(img))
+			:	img(std::move(img))
 			{}
 
 			unsigned width() const
@@ -200,18 +357,43 @@ namespace slimage
 			unsigned channelCount() const
 			{ return img.channelCount(); }
 
+			ElementType elementType() const
+			{ return ElementTypeOf<K>::value; }
+
+			const void* data() const
+			{ return (img.size() == 0) ? nullptr : img.pixel_pointer(); }
+
+			size_t stride() const
+			{ return img.stride(); }
+
 			Image<K,CC> img;
 		};
 	}
 
 	using AnonymousImage = std::shared_ptr<detail::AnonymousInterface>;
 
+	/** True if the anonymous image has pixels of type K with CC channels
+	 * Besides images created with make_anonymous this also holds for other anonymous
+	 * images, e.g. memory mapped files, with matching element type and channel count.
+	 */
 	template<typename K, unsigned CC>
 	bool anonymous_is(const AnonymousImage& aimg)
-	{ return static_cast<bool>(std::dynamic_pointer_cast<detail::AnonymousImpl<K,CC>>(aimg)); }
+	{
+		if(std::dynamic_pointer_cast<detail::AnonymousImpl<K,CC>>(aimg)) {
+			return true;
+		}
+		return aimg
+			&& ElementTypeOf<K>::value != ElementType::Unknown
+			&& aimg->elementType() == ElementTypeOf<K>::value
+			&& aimg->channelCount() == CC;
+	}
 
+	/** Returns the image stored in an anonymous image without copying
+	 * The anonymous image keeps ownership; like with a shared pointer all copies of the
+	 * anonymous image refer to the same image. Only works for images created with make_anonymous.
+	 */
 	template<typename K, unsigned CC>
-	Image<K,CC> anonymous_cast(const AnonymousImage& aimg)
+	Image<K,CC>& anonymous_ref(const AnonymousImage& aimg)
 	{
 		auto p = std::dynamic_pointer_cast<detail::AnonymousImpl<K,CC>>(aimg);
 		if(!p) {
@@ -220,12 +402,55 @@ namespace slimage
 		return p->img;
 	}
 
+	/** Returns a read-only view onto the image stored in an anonymous image */
+	template<typename K, unsigned CC>
+	ImageView<const K,CC> anonymous_view(const AnonymousImage& aimg)
+	{
+		if(!anonymous_is<K,CC>(aimg)) {
+			throw CastException();
+		}
+		return ImageView<const K,CC>(static_cast<const K*>(aimg->data()), aimg->width(), aimg->height(), aimg->stride());
+	}
+
+	/** Returns a copy of the image stored in an anonymous image */
+	template<typename K, unsigned CC>
+	Image<K,CC> anonymous_cast(const AnonymousImage& aimg)
+	{
+		if(auto p = std::dynamic_pointer_cast<detail::AnonymousImpl<K,CC>>(aimg)) {
+			return p->img;
+		}
+		const ImageView<const K,CC> src = anonymous_view<K,CC>(aimg);
+		Image<K,CC> img(src.width(), src.height());
+		for(unsigned y=0; y<src.height(); y++) {
+			std::copy(src.pixel_pointer(0,y), src.pixel_pointer(0,y) + src.numElementsScanline(), img.pixel_pointer(0,y));
+		}
+		return img;
+	}
+
+	/** Takes the image out of an anonymous image
+	 * The pixel buffer is moved if 'aimg' is the only owner of the image (e.g. when passing
+	 * the result of Load directly), otherwise the image is copied.
+	 */
+	template<typename K, unsigned CC>
+	Image<K,CC> anonymous_take(AnonymousImage aimg)
+	{
+		auto p = std::dynamic_pointer_cast<detail::AnonymousImpl<K,CC>>(aimg);
+		if(!p) {
+			return anonymous_cast<K,CC>(aimg);
+		}
+		aimg.reset();
+		if(p.use_count() == 1) {
+			return std::move(p->img);
+		}
+		return p->img;
+	}
+
 	template<typename K, unsigned CC>
 	AnonymousImage make_anonymous(const Image<K,CC>& img)
 	{ return std::make_shared<detail::AnonymousImpl<K,CC>>(img); }
 
 	template<typename K, unsigned CC>
 	AnonymousImage make_anonymous(Image<K,CC>&& img)
-	{ return std::make_shared<detail::AnonymousImpl<K,CC>>(img); }
+	{ return std::make_shared<detail::AnonymousImpl<K,CC>>(std::move(img)); }
 
 }
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/filter.hpp>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+
+namespace slimage
+{
+
+	/** Type used to sum elements of type K without overflow: 64 bit integers or double */
+	template<typename K>
+	struct IntegralSum
+	{
+		using type = typename std::conditional<std::is_integral<K>::value,
+			typename std::conditional<std::is_signed<K>::value, int64_t, uint64_t>::type,
+			double>::type;
+	};
+
+	/** Summed-area table of an image which gives the sum over any rectangle in constant time
+	 * Stores (width+1) x (height+1) sums where the value at (x,y) is the sum over all pixels
+	 * left of x and above y. With 'squared' the squares of the pixel values are summed.
+	 */
+	template<typename K, unsigned CC=1>
+	class IntegralImage
+	{
+	public:
+		using sum_t = typename IntegralSum<K>::type;
+
+		IntegralImage()
+		{}
+
+		explicit IntegralImage(const ImageView<const K,CC>& src, bool squared=false)
+		:	sums_(src.width() + 1, src.height() + 1)
+		{
+			clearBorder();
+			buildRows(src, squared, 0, src.height());
+		}
+
+		/** Builds bands of lines in parallel and adds the sums of the previous bands afterwards */
+		IntegralImage(const ParallelPolicy& policy, const ImageView<const K,CC>& src, bool squared=false)
+		:	sums_(src.width() + 1, src.height() + 1)
+		{
+			clearBorder();
+			ThreadPool& pool = policy.threads();
+			const unsigned min_rows = std::max(1u, policy.min_band_rows);
+			const unsigned bands = std::max(1u, std::min(pool.size(), (src.height() + min_rows - 1) / min_rows));
+			const unsigned rows = (src.height() + bands - 1) / bands;
+			// every band starts with a sum of zero
+			pool.run(bands, [&](size_t b) {
+				const unsigned y0 = std::min(src.height(), static_cast<unsigned>(b*rows));
+				buildRows(src, squared, y0, std::min(src.height(), y0 + rows));
+			});
+			// the sums above a band are the last line of the previous band after its fix-up
+			const size_t n = sums_.numElementsScanline();
+			std::vector<sum_t> carry((bands + 1)*n, sum_t(0));
+			for(unsigned b=1; b<bands; b++) {
+				const unsigned y = std::min(src.height(), b*rows);
+				const sum_t* last = sums_.pixel_pointer(0, y);
+				for(size_t i=0; i<n; i++) {
+					carry[b*n + i] = carry[(b-1)*n + i] + last[i];
+				}
+			}
+			pool.run(bands, [&](size_t b) {
+				const unsigned y0 = std::min(src.height(), static_cast<unsigned>(b*rows));
+				const unsigned y1 = std::min(src.height(), y0 + rows);
+				const sum_t* c = carry.data() + b*n;
+				for(unsigned y=y0+1; y<=y1 && b>0; y++) {
+					sum_t* p = sums_.pixel_pointer(0, y);
+					for(size_t i=0; i<n; i++) {
+						p[i] += c[i];
+					}
+				}
+			});
+		}
+
+		explicit IntegralImage(const Image<K,CC>& src, bool squared=false)
+		:	IntegralImage(src.view(), squared)
+		{}
+
+		IntegralImage(const ParallelPolicy& policy, const Image<K,CC>& src, bool squared=false)
+		:	IntegralImage(policy, src.view(), squared)
+		{}
+
+		/** Width of the source image */
+		unsigned width() const
+		{ return sums_.width() == 0 ? 0 : sums_.width() - 1; }
+
+		/** Height of the source image */
+		unsigned height() const
+		{ return sums_.height() == 0 ? 0 : sums_.height() - 1; }
+
+		/** Sum over all pixels (x',y') with x' < x and y' < y for channel c */
+		sum_t at(unsigned x, unsigned y, unsigned c=0) const
+		{ return sums_.pixel_pointer(x,y)[c]; }
+
+		/** The table of (width+1) x (height+1) sums */
+		const Image<sum_t,CC>& sums() const
+		{ return sums_; }
+
+	private:
+		void clearBorder()
+		{
+			std::fill(sums_.pixel_pointer(0,0), sums_.pixel_pointer(0,0) + sums_.numElementsScanline(), sum_t(0));
+		}
+
+		/** Computes the sums of lines [y0,y1) relative to line y0 in one pass */
+		void buildRows(const ImageView<const K,CC>& src, bool squared, unsigned y0, unsigned y1)
+		{
+			const size_t n = sums_.numElementsScanline();
+			const size_t m = static_cast<size_t>(src.width())*CC;
+			for(unsigned y=y0; y<y1; y++) {
+				const K* s = src.pixel_pointer(0,y);
+				const sum_t* above = (y == y0) ? nullptr : sums_.pixel_pointer(0,y);
+				sum_t* dst = sums_.pixel_pointer(0,y+1);
+				sum_t row[CC] = {};
+				for(unsigned c=0; c<CC; c++) {
+					dst[c] = sum_t(0);
+				}
+				for(size_t i=0; i<m; i+=CC) {
+					for(unsigned c=0; c<CC; c++) {
+						const sum_t v = static_cast<sum_t>(s[i + c]);
+						row[c] += squared ? v*v : v;
+						dst[i + CC + c] = above ? above[i + CC + c] + row[c] : row[c];
+					}
+				}
+				assert(m + CC == n);
+				(void)n;
+			}
+		}
+
+		Image<sum_t,CC> sums_;
+	};
+
+	/** Sum of channel c over the w x h pixels with top left corner (x,y) in constant time */
+	template<typename K, unsigned CC>
+	typename IntegralImage<K,CC>::sum_t BoxSum(const IntegralImage<K,CC>& ii, unsigned x, unsigned y, unsigned w, unsigned h, unsigned c=0)
+	{
+		assert(x + w <= ii.width() && y + h <= ii.height());
+		return ii.at(x + w, y + h, c) + ii.at(x, y, c) - ii.at(x + w, y, c) - ii.at(x, y + h, c);
+	}
+
+	namespace detail
+	{
+		/** Calls fnc(x, y, x0, y0, x1, y1) with the window of the given radius around (x,y) clipped to the image */
+		template<typename F>
+		void ForEachWindow(unsigned width, unsigned height, unsigned radius, unsigned y0, unsigned y1, F fnc)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				const unsigned wy0 = (y >= radius) ? y - radius : 0;
+				const unsigned wy1 = std::min(height, y + radius + 1);
+				for(unsigned x=0; x<width; x++) {
+					const unsigned wx0 = (x >= radius) ? x - radius : 0;
+					const unsigned wx1 = std::min(width, x + radius + 1);
+					fnc(x, y, wx0, wy0, wx1, wy1);
+				}
+			}
+		}
+
+		template<typename K, unsigned CC, typename L>
+		void LocalMeanRows(const IntegralImage<K,CC>& ii, const ImageView<L,CC>& dst, unsigned radius, unsigned y0, unsigned y1)
+		{
+			ForEachWindow(ii.width(), ii.height(), radius, y0, y1,
+				[&](unsigned x, unsigned y, unsigned wx0, unsigned wy0, unsigned wx1, unsigned wy1) {
+					const double area = static_cast<double>(wx1 - wx0)*(wy1 - wy0);
+					L* p = dst.pixel_pointer(x,y);
+					for(unsigned c=0; c<CC; c++) {
+						p[c] = FromFloat<L>(static_cast<float>(BoxSum(ii, wx0, wy0, wx1 - wx0, wy1 - wy0, c) / area));
+					}
+				});
+		}
+
+		template<typename K, unsigned CC>
+		void LocalVarianceRows(const IntegralImage<K,CC>& ii, const IntegralImage<K,CC>& ii2, const ImageView<float,CC>& dst,
+			unsigned radius, unsigned y0, unsigned y1)
+		{
+			ForEachWindow(ii.width(), ii.height(), radius, y0, y1,
+				[&](unsigned x, unsigned y, unsigned wx0, unsigned wy0, unsigned wx1, unsigned wy1) {
+					const double area = static_cast<double>(wx1 - wx0)*(wy1 - wy0);
+					float* p = dst.pixel_pointer(x,y);
+					for(unsigned c=0; c<CC; c++) {
+						const double mean = BoxSum(ii, wx0, wy0, wx1 - wx0, wy1 - wy0, c) / area;
+						const double mean2 = BoxSum(ii2, wx0, wy0, wx1 - wx0, wy1 - wy0, c) / area;
+						p[c] = static_cast<float>(std::max(0.0, mean2 - mean*mean));
+					}
+				});
+		}
+
+		template<typename K>
+		void AdaptiveThresholdRows(const ImageView<const K,1>& src, const IntegralImage<K,1>& ii, const ImageView<unsigned char,1>& dst,
+			unsigned radius, double offset, unsigned y0, unsigned y1)
+		{
+			ForEachWindow(ii.width(), ii.height(), radius, y0, y1,
+				[&](unsigned x, unsigned y, unsigned wx0, unsigned wy0, unsigned wx1, unsigned wy1) {
+					const double area = static_cast<double>(wx1 - wx0)*(wy1 - wy0);
+					const double mean = BoxSum(ii, wx0, wy0, wx1 - wx0, wy1 - wy0) / area;
+					*dst.pixel_pointer(x,y) = (static_cast<double>(*src.pixel_pointer(x,y)) > mean - offset) ? 255 : 0;
+				});
+		}
+	}
+
+	/** Mean over the (2*radius+1) x (2*radius+1) window around each pixel
+	 * Windows are clipped at the image border. The cost does not depend on the radius.
+	 */
+	template<typename K, unsigned CC>
+	Image<float,CC> LocalMean(const Image<K,CC>& src, unsigned radius)
+	{
+		const IntegralImage<K,CC> ii(src);
+		Image<float,CC> dst(src.dimensions());
+		detail::LocalMeanRows(ii, dst.view(), radius, 0, src.height());
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	Image<float,CC> LocalMean(const ParallelPolicy& policy, const Image<K,CC>& src, unsigned radius)
+	{
+		const IntegralImage<K,CC> ii(policy, src);
+		Image<float,CC> dst(src.dimensions());
+		ParallelRows(policy, src.height(), [&](unsigned y0, unsigned y1) {
+			detail::LocalMeanRows(ii, dst.view(), radius, y0, y1);
+		});
+		return dst;
+	}
+
+	/** Variance over the (2*radius+1) x (2*radius+1) window around each pixel, see LocalMean */
+	template<typename K, unsigned CC>
+	Image<float,CC> LocalVariance(const Image<K,CC>& src, unsigned radius)
+	{
+		const IntegralImage<K,CC> ii(src);
+		const IntegralImage<K,CC> ii2(src, true);
+		Image<float,CC> dst(src.dimensions());
+		detail::LocalVarianceRows(ii, ii2, dst.view(), radius, 0, src.height());
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	Image<float,CC> LocalVariance(const ParallelPolicy& policy, const Image<K,CC>& src, unsigned radius)
+	{
+		const IntegralImage<K,CC> ii(policy, src);
+		const IntegralImage<K,CC> ii2(policy, src, true);
+		Image<float,CC> dst(src.dimensions());
+		ParallelRows(policy, src.height(), [&](unsigned y0, unsigned y1) {
+			detail::LocalVarianceRows(ii, ii2, dst.view(), radius, y0, y1);
+		});
+		return dst;
+	}
+
+	/** Box filter computed from an integral image; unlike BoxBlur windows are clipped at the border */
+	template<typename K, unsigned CC>
+	Image<K,CC> BoxFilter(const Image<K,CC>& src, unsigned radius)
+	{
+		const IntegralImage<K,CC> ii(src);
+		Image<K,CC> dst(src.dimensions());
+		detail::LocalMeanRows(ii, dst.view(), radius, 0, src.height());
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> BoxFilter(const ParallelPolicy& policy, const Image<K,CC>& src, unsigned radius)
+	{
+		const IntegralImage<K,CC> ii(policy, src);
+		Image<K,CC> dst(src.dimensions());
+		ParallelRows(policy, src.height(), [&](unsigned y0, unsigned y1) {
+			detail::LocalMeanRows(ii, dst.view(), radius, y0, y1);
+		});
+		return dst;
+	}
+
+	/** Sets pixels brighter than the local mean minus 'offset' to 255 and all others to 0 */
+	template<typename K>
+	Image<unsigned char,1> AdaptiveThreshold(const Image<K,1>& src, unsigned radius, double offset=0.0)
+	{
+		const IntegralImage<K,1> ii(src);
+		Image<unsigned char,1> dst(src.dimensions());
+		detail::AdaptiveThresholdRows(ImageView<const K,1>(src.view()), ii, dst.view(), radius, offset, 0, src.height());
+		return dst;
+	}
+
+	template<typename K>
+	Image<unsigned char,1> AdaptiveThreshold(const ParallelPolicy& policy, const Image<K,1>& src, unsigned radius, double offset=0.0)
+	{
+		const IntegralImage<K,1> ii(policy, src);
+		Image<unsigned char,1> dst(src.dimensions());
+		const ImageView<const K,1> view = src.view();
+		ParallelRows(policy, src.height(), [&](unsigned y0, unsigned y1) {
+			detail::AdaptiveThresholdRows(view, ii, dst.view(), radius, offset, y0, y1);
+		});
+		return dst;
+	}
+
+}
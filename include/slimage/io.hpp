@@ -1,11 +1,17 @@
 #pragma once
 
 #include <slimage/io_1ui16.hpp>
+#include <slimage/netpbm.hpp>
+#include <slimage/mapped.hpp>
+#include <slimage/depth_codec.hpp>
 #include <slimage/image.hpp>
+#include <slimage/error.hpp>
 #include <string>
 
+// PGM, PPM, PNM, raw (.simg) and compressed depth (.sdepth) files are handled natively. Other formats are loaded and saved
+// with OpenCV or Qt; include slimage/opencv.hpp or slimage/qt.hpp BEFORE this file.
 #if !defined SLIMAGE_OPENCV_INC && !defined SLIMAGE_QT_INC
-#  error Include either slimage/opencv.hpp or slimage/qt.hpp BEFORE slimage/io.hpp
+#  define SLIMAGE_IO_INC_WITHOUT_BACKEND
 #endif
 
 
@@ -15,41 +21,139 @@ namespace slimage
 	inline
 	AnonymousImage Load(const std::string& fn)
 	{
+		if(IsNetpbmFilename(fn)) {
+			return NetpbmLoad(fn);
+		}
+		if(IsRawFilename(fn)) {
+			return RawLoad(fn);
+		}
+		if(IsDepthFilename(fn)) {
+			return make_anonymous(LoadDepth(fn));
+		}
 #if defined SLIMAGE_OPENCV_INC
 		return OpenCvLoad(fn);
 #elif defined SLIMAGE_QT_INC
 		return QtLoad(fn);
 #else
-		return AnonymousImage{};
+		throw IoException(fn, "Unsupported file format (include slimage/opencv.hpp or slimage/qt.hpp)");
 #endif
 	}
 
 	inline
 	void Save(const std::string& fn, const AnonymousImage& aimg)
 	{
+		if(IsNetpbmFilename(fn)) {
+			NetpbmSave(fn, aimg);
+			return;
+		}
+		if(IsRawFilename(fn)) {
+			SaveRaw(fn, aimg);
+			return;
+		}
+		if(IsDepthFilename(fn)) {
+			if(!anonymous_is<uint16_t,1>(aimg)) {
+				throw IoException(fn, "Compressed depth images must have type uint16_t with one channel");
+			}
+			SaveDepth(fn, anonymous_view<uint16_t,1>(aimg));
+			return;
+		}
 #if defined SLIMAGE_OPENCV_INC
 		OpenCvSave(fn, aimg);
 #elif defined SLIMAGE_QT_INC
 		QtSave(fn, aimg);
+#else
+		throw IoException(fn, "Unsupported file format (include slimage/opencv.hpp or slimage/qt.hpp)");
+#endif
+	}
+
+	namespace detail
+	{
+		template<typename K, unsigned CC>
+		void DepthLoadIntoAs(const std::string& fn, Image<K,CC>&)
+		{ throw IoException(fn, "Image does not have specified type"); }
+
+		template<>
+		inline
+		void DepthLoadIntoAs<uint16_t,1>(const std::string& fn, Image<uint16_t,1>& img)
+		{ LoadDepthInto(fn, img); }
+
+		template<typename K, unsigned CC>
+		void DepthSaveAs(const std::string& fn, const Image<K,CC>&)
+		{ throw IoException(fn, "Compressed depth images must have type uint16_t with one channel"); }
+
+		template<>
+		inline
+		void DepthSaveAs<uint16_t,1>(const std::string& fn, const Image<uint16_t,1>& img)
+		{ SaveDepth(fn, img); }
+	}
+
+	/** Loads an image with the given pixel type into 'img' which is only reallocated if its size differs
+	 * Netpbm, raw and depth files are decoded directly into 'img'. Throws an IoException if
+	 * the file does not store an image of this type; the content of 'img' is undefined then.
+	 */
+	template<typename K, unsigned CC>
+	void LoadInto(const std::string& fn, Image<K,CC>& img)
+	{
+		if(IsNetpbmFilename(fn)) {
+			NetpbmLoadInto(fn, img);
+			return;
+		}
+		if(IsRawFilename(fn)) {
+			RawLoadInto(fn, img);
+			return;
+		}
+		if(IsDepthFilename(fn)) {
+			detail::DepthLoadIntoAs(fn, img);
+			return;
+		}
+#if defined SLIMAGE_OPENCV_INC
+		OpenCvLoadInto(fn, img);
+#elif defined SLIMAGE_QT_INC
+		QtLoadInto(fn, img);
+#else
+		throw IoException(fn, "Unsupported file format (include slimage/opencv.hpp or slimage/qt.hpp)");
 #endif
 	}
 
+	/** Loads an image with the given pixel type, e.g. Load<float,1>(fn)
+	 * Throws an IoException if the file does not store an image of this type.
+	 */
+	template<typename K, unsigned CC>
+	Image<K,CC> Load(const std::string& fn)
+	{
+		Image<K,CC> img;
+		LoadInto(fn, img);
+		return img;
+	}
+
+	/** Saves an image; netpbm, raw and depth files are written without copying the image */
+	template<typename K, unsigned CC>
+	void Save(const std::string& fn, const Image<K,CC>& img)
+	{
+		if(IsNetpbmFilename(fn)) {
+			NetpbmSave(fn, img);
+			return;
+		}
+		if(IsRawFilename(fn)) {
+			SaveRaw(fn, img);
+			return;
+		}
+		if(IsDepthFilename(fn)) {
+			detail::DepthSaveAs(fn, img);
+			return;
+		}
+		Save(fn, make_anonymous<K,CC>(img));
+	}
+
 	#define SLIMAGE_IO_LOAD_HELP(K,CC,S) \
 		inline \
 		slimage::Image##CC##S Load##CC##S(const std::string& fn) \
-		{ \
-			try { \
-				return anonymous_cast<K,CC>(Load(fn)); \
-			} \
-			catch(CastException& ce) { \
-				throw IoException(fn, "Image does not have specified type"); \
-			} \
-		}
+		{ return Load<K,CC>(fn); }
 
 	#define SLIMAGE_IO_SAVE_HELP(K,CC,S) \
 		inline \
 		void Save(const std::string& fn, const slimage::Image##CC##S& img) \
-		{ Save(fn, make_anonymous<K,CC>(img)); }
+		{ Save<K,CC>(fn, img); }
 
 	#define SLIMAGE_IO_HELP(K,CC,S) \
 		SLIMAGE_IO_LOAD_HELP(K,CC,S) \
@@ -73,4 +177,15 @@ namespace slimage
 	#undef SLIMAGE_IO_LOAD_HELP
 	#undef SLIMAGE_IO_SAVE_HELP
 
+	/** Saves a 1 channel 16 bit image; PGM files are written as ASCII (P2) and all other formats like Save<uint16_t,1> */
+	inline
+	void Save(const std::string& fn, const Image1ui16& img)
+	{
+		if(detail::HasPgmExtension(fn)) {
+			SaveAscii1ui16(fn, img);
+			return;
+		}
+		Save<uint16_t,1>(fn, img);
+	}
+
 }
\ No newline at end of file
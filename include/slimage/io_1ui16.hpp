@@ -2,9 +2,10 @@
 
 #include <slimage/image.hpp>
 #include <slimage/error.hpp>
-#include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string.hpp>
+#include <slimage/simd.hpp>
+#include <algorithm>
 #include <fstream>
+#include <string>
 #include <vector>
 
 namespace slimage
@@ -21,57 +22,174 @@ namespace slimage
 		return false;
 	}
 
-	/** Loads a 16 bit 1-channel image from an ASCII PGM file */
-	inline Image1ui16 Load1ui16(const std::string& filename) {
-		if(!boost::algorithm::ends_with(filename, ".pgm")) {
+	namespace detail
+	{
+		/** Lines of a file in memory, skipping empty lines and comments like ReadDataLine */
+		class DataLineReader
+		{
+		public:
+			DataLineReader(const char* begin, const char* end)
+			:	p_(begin),
+				end_(end)
+			{}
+
+			/** Sets [begin,end) to the next data line without the line break */
+			bool next(const char*& begin, const char*& end)
+			{
+				while(p_ < end_) {
+					begin = p_;
+					while(p_ < end_ && *p_ != '\n') {
+						p_++;
+					}
+					end = p_;
+					if(p_ < end_) {
+						p_++; // skip '\n'
+					}
+					if(end > begin && end[-1] == '\r') {
+						end--;
+					}
+					if(end > begin && *begin != '#') {
+						return true;
+					}
+				}
+				return false;
+			}
+
+			/** Remaining data after the last line returned by next */
+			const char* position() const
+			{ return p_; }
+
+		private:
+			const char* p_;
+			const char* end_;
+		};
+
+		inline
+		bool IsBlank(char c)
+		{ return c == ' ' || c == '\t' || c == '\r'; }
+
+		/** Parses the next whitespace separated number in [p,end)
+		 * Returns false if there is no further token. Throws if the token is not a number.
+		 */
+		inline
+		bool ParseUnsignedToken(const char*& p, const char* end, unsigned& value, const std::string& fn, const char* msg)
+		{
+			while(p < end && IsBlank(*p)) {
+				p++;
+			}
+			if(p == end) {
+				return false;
+			}
+			unsigned long v = 0;
+			const char* first = p;
+			while(p < end && *p >= '0' && *p <= '9') {
+				v = 10*v + static_cast<unsigned>(*p - '0');
+				if(v > 0xFFFFFFFFul) {
+					throw IoException(fn, msg);
+				}
+				p++;
+			}
+			if(p == first || (p < end && !IsBlank(*p))) {
+				throw IoException(fn, msg);
+			}
+			value = static_cast<unsigned>(v);
+			return true;
+		}
+
+		/** Writes the decimal representation of v to 'out' and returns the end of the written characters */
+		inline
+		char* FormatUnsigned(uint16_t v, char* out)
+		{
+			char tmp[5];
+			unsigned n = 0;
+			do {
+				tmp[n++] = static_cast<char>('0' + v % 10);
+				v /= 10;
+			} while(v != 0);
+			while(n > 0) {
+				*out++ = tmp[--n];
+			}
+			return out;
+		}
+
+		inline
+		bool HasPgmExtension(const std::string& filename)
+		{ return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".pgm") == 0; }
+	}
+
+	/** Loads a 16 bit 1-channel image from an ASCII (P2) or binary (P5) PGM file into 'img'
+	 * 'img' is only reallocated if its size differs. The file is read into a buffer which
+	 * is kept per thread and reused by later calls.
+	 */
+	inline void Load1ui16Into(const std::string& filename, Image1ui16& img) {
+		if(!detail::HasPgmExtension(filename)) {
 			throw IoException(filename, "Load1ui16 can only handle PGM files");
 		}
-		std::ifstream ifs(filename);
+		std::ifstream ifs(filename, std::ios::binary);
 		if(!ifs.is_open()) {
 			throw IoException(filename, "Could not open file");
 		}
-		std::string line;
-		std::vector<std::string> tokens;
+		// read the whole file at once and parse it in memory
+		static thread_local std::vector<char> buffer;
+		ifs.seekg(0, std::ios::end);
+		buffer.resize(static_cast<size_t>(ifs.tellg()));
+		ifs.seekg(0, std::ios::beg);
+		ifs.read(buffer.data(), buffer.size());
+		detail::DataLineReader lines(buffer.data(), buffer.data() + buffer.size());
+		const char* p;
+		const char* end;
 		// read magic line
-		ReadDataLine(ifs, line);
-		boost::split(tokens, line, boost::is_any_of(" "));
-		if(tokens.size() != 1 || !(tokens[0] == "P2" || tokens[0] == "P5")) {
-			throw IoException(filename, "Wrong PGM file header (P2 id)");
+		const char* magic_msg = "Wrong PGM file header (P2 id)";
+		if(!lines.next(p, end)) {
+			throw IoException(filename, magic_msg);
+		}
+		while(end > p && detail::IsBlank(end[-1])) {
+			end--;
+		}
+		if(end - p != 2 || p[0] != 'P' || (p[1] != '2' && p[1] != '5')) {
+			throw IoException(filename, magic_msg);
 		}
-		std::string pmode = tokens[0];
+		const bool binary = (p[1] == '5');
 		// read dimensions line
-		ReadDataLine(ifs, line);
-		boost::split(tokens, line, boost::is_any_of(" "));
-		unsigned int w, h;
-		if(tokens.size() != 2) {
-			throw IoException(filename, "Wrong PGM file header (width/height)");
-		}
-		try {
-			w = boost::lexical_cast<unsigned int>(tokens[0]);
-			h = boost::lexical_cast<unsigned int>(tokens[1]);
-		} catch(...) {
-			throw IoException(filename, "Wrong PGM file header (width/height)");
+		const char* dim_msg = "Wrong PGM file header (width/height)";
+		unsigned w, h, extra;
+		if(!lines.next(p, end)
+			|| !detail::ParseUnsignedToken(p, end, w, filename, dim_msg)
+			|| !detail::ParseUnsignedToken(p, end, h, filename, dim_msg)
+			|| detail::ParseUnsignedToken(p, end, extra, filename, dim_msg)) {
+			throw IoException(filename, dim_msg);
 		}
 		// read max line
-		ReadDataLine(ifs, line);
-		boost::split(tokens, line, boost::is_any_of(" "));
-		if(tokens.size() != 1 || tokens[0] != "65535") {
-			throw IoException(filename, "Wrong PGM file header (max value)");
+		const char* max_msg = "Wrong PGM file header (max value)";
+		unsigned maxval;
+		if(!lines.next(p, end)
+			|| !detail::ParseUnsignedToken(p, end, maxval, filename, max_msg)
+			|| maxval != 65535
+			|| detail::ParseUnsignedToken(p, end, extra, filename, max_msg)) {
+			throw IoException(filename, max_msg);
 		}
 		// read data
-		Image1ui16 img(w, h);
-		if(pmode == "P2") {
-			unsigned int y = 0;
-			while(ReadDataLine(ifs, line)) {
-				boost::split(tokens, line, boost::is_any_of(" "));
-				if(tokens.back().empty()) {
-					tokens.pop_back();
+		if(img.width() != w || img.height() != h) {
+			img.resize(w, h);
+		}
+		if(!binary) {
+			const char* value_msg = "Invalid value in PGM data";
+			unsigned y = 0;
+			while(lines.next(p, end)) {
+				if(y == h) {
+					throw IoException(filename, "Height and number of lines do not match");
 				}
-				if(tokens.size() != w) {
-					throw IoException(filename, "Width and number of tokens in line do not match");
+				uint16_t* dst = img.pixel_pointer(0, y);
+				unsigned x = 0;
+				unsigned v;
+				while(detail::ParseUnsignedToken(p, end, v, filename, value_msg)) {
+					if(x == w) {
+						throw IoException(filename, "Width and number of tokens in line do not match");
+					}
+					dst[x++] = static_cast<uint16_t>(v);
 				}
-				for(unsigned int x=0; x<w; x++) {
-					img(x,y) = boost::lexical_cast<unsigned int>(tokens[x]);
+				if(x != w) {
+					throw IoException(filename, "Width and number of tokens in line do not match");
 				}
 				y++;
 			}
@@ -79,38 +197,58 @@ namespace slimage
 				throw IoException(filename, "Height and number of lines do not match");
 			}
 		}
-		if(pmode == "P5") {
-			std::vector<char> dataline(img.size()*2);
-			ifs.read(dataline.data(), img.size()*2);
-			for(unsigned i=0; i<img.size(); i++) {
-				uint16_t v;
-				reinterpret_cast<char*>(&v)[1] = dataline[2*i];
-				reinterpret_cast<char*>(&v)[0] = dataline[2*i + 1];
-				img[i] = v;
+		else {
+			const char* data = lines.position();
+			if(static_cast<size_t>(buffer.data() + buffer.size() - data) < 2*static_cast<size_t>(w)*h) {
+				throw IoException(filename, "Unexpected end of file");
+			}
+			// values are stored big endian; lines of 'img' may be padded
+			for(unsigned int y=0; y<h; y++) {
+				uint16_t* dst = img.pixel_pointer(0, y);
+				std::copy(data, data + 2*w, reinterpret_cast<char*>(dst));
+				if(detail::IsLittleEndian()) {
+					detail::ByteSwap16(dst, w, dst);
+				}
+				data += 2*w;
 			}
 		}
+	}
+
+	/** Loads a 16 bit 1-channel image from an ASCII (P2) or binary (P5) PGM file */
+	inline Image1ui16 Load1ui16(const std::string& filename) {
+		Image1ui16 img;
+		Load1ui16Into(filename, img);
 		return img;
 	}
 
-	/** Saves a 1 channel 16 bit unsigned integer image to an ASCII PGM file */
-	inline void Save(const std::string& filename, const Image1ui16& img) {
-		if(!boost::algorithm::ends_with(filename, ".pgm")) {
-			throw IoException(filename, "Save for 1ui16 images can only handle PGM files");
-		}
-		std::ofstream ofs(filename);
-		ofs << "P2" << std::endl;
-		ofs << img.width() << " " << img.height() << std::endl;
-		ofs << "65535" << std::endl;
+	/** Saves a 1 channel 16 bit unsigned integer image to an ASCII (P2) PGM file
+	 * Save in slimage/io.hpp uses this for .pgm files and handles all other formats.
+	 */
+	inline void SaveAscii1ui16(const std::string& filename, const Image1ui16& img) {
+		std::ofstream ofs(filename, std::ios::binary);
+		if(!ofs.is_open()) {
+			throw IoException(filename, "Could not open file");
+		}
+		ofs << "P2\n" << img.width() << " " << img.height() << "\n65535\n";
+		// one line of at most 5 digits and a separator per value
+		std::vector<char> line(6*static_cast<size_t>(img.width()) + 1);
 		for(unsigned int y=0; y<img.height(); y++) {
+			char* out = line.data();
+			const uint16_t* src = img.pixel_pointer(0, y);
 			for(unsigned int x=0; x<img.width(); x++) {
-				ofs << img(x,y);
-				if(x+1 < img.width()) {
-					ofs << " ";
-				}
+				out = detail::FormatUnsigned(src[x], out);
+				*out++ = ' ';
+			}
+			if(img.width() > 0) {
+				out--; // no separator after the last value
 			}
 			if(y+1 < img.height()) {
-				ofs << std::endl;
+				*out++ = '\n';
 			}
+			ofs.write(line.data(), out - line.data());
+		}
+		if(!ofs) {
+			throw IoException(filename, "Could not write file");
 		}
 	}
-}
\ No newline at end of file
+}
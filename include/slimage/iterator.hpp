@@ -1,6 +1,7 @@
 #pragma once
 
 #include <slimage/pixel.hpp>
+#include <cstddef>
 #include <vector>
 #include <iterator>
 #include <cassert>
@@ -123,8 +124,9 @@ namespace slimage
 	bool operator>=(const Iterator<K1,CC>& a, const Iterator<K2,CC>& b)
 	{ return a.base() >= b.base(); }
 
+	/** Distance in pixels */
 	template<typename K1, typename K2, unsigned CC>
-	auto operator-(const Iterator<K1,CC>& a, const Iterator<K2,CC>& b) -> decltype(a.base() - b.base())
-	{ return a.base() - b.base(); }
+	std::ptrdiff_t operator-(const Iterator<K1,CC>& a, const Iterator<K2,CC>& b)
+	{ return (a.base() - b.base()) / static_cast<std::ptrdiff_t>(CC); }
 
 }
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#if !defined _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define SLIMAGE_HAS_MMAP
+#endif
+
+// Raw images (.simg) store a 64 byte header followed by the uncompressed pixel data.
+// The pixel data starts at a 64 byte aligned offset, thus a memory mapped file can be
+// used as image without decoding or copying. All values are stored little endian.
+
+namespace slimage
+{
+
+	namespace detail
+	{
+		struct RawHeader
+		{
+			char magic[8]; // "SLIMAGE" and a terminating zero
+			uint32_t version;
+			uint32_t element_type; // ElementType
+			uint32_t channels;
+			uint32_t width;
+			uint32_t height;
+			uint32_t reserved;
+			uint64_t stride; // bytes between the beginnings of two consecutive lines
+			uint64_t data_offset; // position of the first pixel in the file
+			uint8_t padding[16];
+		};
+
+		static_assert(sizeof(RawHeader) == 64, "RawHeader must have a size of 64 bytes");
+
+		constexpr uint32_t RawVersion = 1;
+
+		inline
+		RawHeader CreateRawHeader(ElementType type, unsigned channels, unsigned width, unsigned height)
+		{
+			RawHeader h;
+			std::memset(&h, 0, sizeof(h));
+			std::memcpy(h.magic, "SLIMAGE", 8);
+			h.version = RawVersion;
+			h.element_type = static_cast<uint32_t>(type);
+			h.channels = channels;
+			h.width = width;
+			h.height = height;
+			h.stride = static_cast<uint64_t>(ElementSize(type))*channels*width;
+			h.data_offset = sizeof(RawHeader);
+			return h;
+		}
+
+		/** Checks a header read from a file with 'file_size' bytes */
+		inline
+		void CheckRawHeader(const RawHeader& h, uint64_t file_size, const std::string& fn)
+		{
+			if(!IsLittleEndian()) {
+				throw IoException(fn, "Raw images are only supported on little endian machines");
+			}
+			if(std::memcmp(h.magic, "SLIMAGE", 8) != 0) {
+				throw IoException(fn, "Not a raw slimage file");
+			}
+			if(h.version != RawVersion) {
+				throw IoException(fn, "Unsupported raw image version");
+			}
+			const unsigned element_size = ElementSize(static_cast<ElementType>(h.element_type));
+			if(element_size == 0 || h.channels == 0) {
+				throw IoException(fn, "Invalid raw image header (element type)");
+			}
+			// sizes are checked by division as products of header fields may overflow
+			const uint64_t pixel = static_cast<uint64_t>(element_size)*h.channels;
+			if(h.width > 0 && pixel > std::numeric_limits<uint64_t>::max() / h.width) {
+				throw IoException(fn, "Invalid raw image header (layout)");
+			}
+			const uint64_t line = pixel*h.width;
+			if(h.stride < line || h.stride % element_size != 0 || h.data_offset % 64 != 0) {
+				throw IoException(fn, "Invalid raw image header (layout)");
+			}
+			if(h.data_offset > file_size) {
+				throw IoException(fn, "Unexpected end of file");
+			}
+			const uint64_t available = file_size - h.data_offset;
+			if(h.height > 0 && (line > available || (h.height > 1 && h.stride > (available - line) / (h.height - 1)))) {
+				throw IoException(fn, "Unexpected end of file");
+			}
+		}
+
+		template<typename K, unsigned CC>
+		void CheckRawType(const RawHeader& h, const std::string& fn)
+		{
+			if(h.element_type != static_cast<uint32_t>(ElementTypeOf<K>::value)
+				|| ElementTypeOf<K>::value == ElementType::Unknown
+				|| h.channels != CC) {
+				throw IoException(fn, "Image does not have specified type");
+			}
+		}
+
+		inline
+		RawHeader ReadRawHeader(std::istream& is, const std::string& fn)
+		{
+			is.seekg(0, std::ios::end);
+			const uint64_t file_size = static_cast<uint64_t>(is.tellg());
+			is.seekg(0, std::ios::beg);
+			RawHeader h;
+			if(!is.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+				throw IoException(fn, "Not a raw slimage file");
+			}
+			CheckRawHeader(h, file_size, fn);
+			return h;
+		}
+
+		inline
+		void WriteRaw(const std::string& fn, ElementType type, unsigned channels, unsigned width, unsigned height,
+			const void* data, size_t stride)
+		{
+			if(ElementSize(type) == 0) {
+				throw IoException(fn, "Raw images need a known element type");
+			}
+			if(!IsLittleEndian()) {
+				throw IoException(fn, "Raw images are only supported on little endian machines");
+			}
+			std::ofstream ofs(fn, std::ios::binary);
+			if(!ofs.is_open()) {
+				throw IoException(fn, "Could not open file");
+			}
+			const RawHeader h = CreateRawHeader(type, channels, width, height);
+			ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			const char* p = static_cast<const char*>(data);
+			if(stride == h.stride) {
+				ofs.write(p, h.stride*height);
+			}
+			else {
+				for(unsigned y=0; y<height; y++) {
+					ofs.write(p + y*stride, h.stride);
+				}
+			}
+			if(!ofs) {
+				throw IoException(fn, "Could not write file");
+			}
+		}
+	}
+
+	/** True if the filename has the extension .simg used for raw images */
+	inline
+	bool IsRawFilename(const std::string& fn)
+	{ return fn.size() >= 5 && fn.compare(fn.size() - 5, 5, ".simg") == 0; }
+
+	/** Saves an image as raw image */
+	template<typename K, unsigned CC>
+	void SaveRaw(const std::string& fn, const ImageView<K,CC>& img)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::WriteRaw(fn, ElementTypeOf<base_t>::value, CC, img.width(), img.height(), img.pixel_pointer(), img.stride());
+	}
+
+	template<typename K, unsigned CC>
+	void SaveRaw(const std::string& fn, const Image<K,CC>& img)
+	{ SaveRaw(fn, img.view()); }
+
+	inline
+	void SaveRaw(const std::string& fn, const AnonymousImage& aimg)
+	{ detail::WriteRaw(fn, aimg->elementType(), aimg->channelCount(), aimg->width(), aimg->height(), aimg->data(), aimg->stride()); }
+
+	/** Reads a raw image into 'img' which is only reallocated if its size differs
+	 * Throws an IoException if the file does not store pixels of type K with CC channels.
+	 */
+	template<typename K, unsigned CC>
+	void RawLoadInto(const std::string& fn, Image<K,CC>& img)
+	{
+		std::ifstream ifs(fn, std::ios::binary);
+		if(!ifs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		const detail::RawHeader h = detail::ReadRawHeader(ifs, fn);
+		detail::CheckRawType<K,CC>(h, fn);
+		if(img.width() != h.width || img.height() != h.height) {
+			img.resize(h.width, h.height);
+		}
+		const size_t line = img.numElementsScanline()*sizeof(K);
+		for(unsigned y=0; y<img.height(); y++) {
+			ifs.seekg(h.data_offset + h.stride*y, std::ios::beg);
+			if(!ifs.read(reinterpret_cast<char*>(img.pixel_pointer(0,y)), line)) {
+				throw IoException(fn, "Unexpected end of file");
+			}
+		}
+	}
+
+	/** Reads a raw image into memory
+	 * Throws an IoException if the file does not store pixels of type K with CC channels.
+	 */
+	template<typename K, unsigned CC>
+	Image<K,CC> RawLoad(const std::string& fn)
+	{
+		Image<K,CC> img;
+		RawLoadInto(fn, img);
+		return img;
+	}
+
+#if defined SLIMAGE_HAS_MMAP
+
+	enum class MapMode
+	{
+		/** Pixels can only be read */
+		ReadOnly,
+		/** Pixels can be modified; modified pages are private copies and never written to the file */
+		CopyOnWrite
+	};
+
+	/** A raw image file mapped into memory
+	 * Opening the image only reads the header; pages with pixel data are read by the
+	 * operating system when they are accessed for the first time.
+	 */
+	template<typename K, unsigned CC>
+	class MappedImage
+	{
+	public:
+		using element_t = K;
+		using const_reference_t = typename Iterator<const K,CC>::reference;
+		using dim_t = std::tuple<unsigned,unsigned>;
+
+		MappedImage()
+		:	base_(nullptr),
+			length_(0),
+			data_(nullptr),
+			width_(0),
+			height_(0),
+			stride_(0),
+			mode_(MapMode::ReadOnly)
+		{}
+
+		explicit MappedImage(const std::string& fn, MapMode mode=MapMode::ReadOnly)
+		:	MappedImage()
+		{ map(fn, mode); }
+
+		MappedImage(const MappedImage&) = delete;
+		MappedImage& operator=(const MappedImage&) = delete;
+
+		MappedImage(MappedImage&& other)
+		:	MappedImage()
+		{ swap(other); }
+
+		MappedImage& operator=(MappedImage&& other)
+		{
+			MappedImage tmp(std::move(other));
+			swap(tmp);
+			return *this;
+		}
+
+		~MappedImage()
+		{
+			if(base_) {
+				munmap(base_, length_);
+			}
+		}
+
+		bool empty() const
+		{ return width_ == 0 && height_ == 0; }
+
+		/** Width of image */
+		unsigned width() const
+		{ return width_; }
+
+		/** Height of image */
+		unsigned height() const
+		{ return height_; }
+
+		dim_t dimensions() const
+		{ return std::make_tuple(width(), height()); }
+
+		/** Number of elements per pixel */
+		unsigned channelCount() const
+		{ return CC; }
+
+		/** Number of pixels, i.e. width()*height() */
+		size_t size() const
+		{ return static_cast<size_t>(width_)*height_; }
+
+		/** Distance in bytes between the beginnings of two consecutive lines */
+		size_t stride() const
+		{ return stride_; }
+
+		MapMode mode() const
+		{ return mode_; }
+
+		const_reference_t operator()(unsigned x, unsigned y) const
+		{ return view()(x,y); }
+
+		/** A read-only view onto the mapped pixels */
+		ImageView<const K,CC> view() const
+		{ return ImageView<const K,CC>(data_, width_, height_, stride_); }
+
+		/** A view onto the mapped pixels which can be modified, only for MapMode::CopyOnWrite */
+		ImageView<K,CC> mutableView()
+		{
+			if(mode_ != MapMode::CopyOnWrite) {
+				throw IoException(filename_, "Image is mapped read-only");
+			}
+			return ImageView<K,CC>(data_, width_, height_, stride_);
+		}
+
+	private:
+		void map(const std::string& fn, MapMode mode)
+		{
+			const int fd = open(fn.c_str(), O_RDONLY);
+			if(fd < 0) {
+				throw IoException(fn, "Could not open file");
+			}
+			struct stat st;
+			detail::RawHeader h;
+			if(fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h))) {
+				close(fd);
+				throw IoException(fn, "Not a raw slimage file");
+			}
+			try {
+				detail::CheckRawHeader(h, st.st_size, fn);
+				detail::CheckRawType<K,CC>(h, fn);
+			}
+			catch(...) {
+				close(fd);
+				throw;
+			}
+			const int prot = (mode == MapMode::CopyOnWrite) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+			void* p = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+			close(fd); // the mapping keeps the file open
+			if(p == MAP_FAILED) {
+				throw IoException(fn, "Could not map file into memory");
+			}
+			base_ = p;
+			length_ = st.st_size;
+			data_ = reinterpret_cast<K*>(static_cast<char*>(p) + h.data_offset);
+			width_ = h.width;
+			height_ = h.height;
+			stride_ = h.stride;
+			mode_ = mode;
+			filename_ = fn;
+		}
+
+		void swap(MappedImage& other)
+		{
+			std::swap(base_, other.base_);
+			std::swap(length_, other.length_);
+			std::swap(data_, other.data_);
+			std::swap(width_, other.width_);
+			std::swap(height_, other.height_);
+			std::swap(stride_, other.stride_);
+			std::swap(mode_, other.mode_);
+			std::swap(filename_, other.filename_);
+		}
+
+		void* base_;
+		size_t length_;
+		K* data_;
+		unsigned width_, height_;
+		size_t stride_; // in bytes
+		MapMode mode_;
+		std::string filename_;
+	};
+
+	namespace detail
+	{
+		template<typename K, unsigned CC>
+		struct AnonymousMapped
+		:	public AnonymousInterface
+		{
+			AnonymousMapped(MappedImage<K,CC>&& img)
+			:	img(std::move(img))
+			{}
+
+			unsigned width() const
+			{ return img.width(); }
+
+			unsigned height() const
+			{ return img.height(); }
+
+			unsigned channelCount() const
+			{ return img.channelCount(); }
+
+			ElementType elementType() const
+			{ return ElementTypeOf<K>::value; }
+
+			const void* data() const
+			{ return img.view().pixel_pointer(); }
+
+			size_t stride() const
+			{ return img.stride(); }
+
+			MappedImage<K,CC> img;
+		};
+	}
+
+	/** An anonymous image which keeps the file mapped as long as it exists
+	 * Use anonymous_view to access the pixels without copying.
+	 */
+	template<typename K, unsigned CC>
+	AnonymousImage make_anonymous(MappedImage<K,CC>&& img)
+	{ return std::make_shared<detail::AnonymousMapped<K,CC>>(std::move(img)); }
+
+#endif
+
+	namespace detail
+	{
+#if defined SLIMAGE_HAS_MMAP
+		struct RawMapOp
+		{
+			template<typename K, unsigned CC>
+			AnonymousImage apply(const std::string& fn) const
+			{ return make_anonymous(MappedImage<K,CC>(fn)); }
+		};
+#endif
+
+		struct RawReadOp
+		{
+			template<typename K, unsigned CC>
+			AnonymousImage apply(const std::string& fn) const
+			{ return make_anonymous(RawLoad<K,CC>(fn)); }
+		};
+
+		template<typename K, typename OP>
+		AnonymousImage RawDispatchChannels(const OP& op, const std::string& fn, unsigned channels)
+		{
+			switch(channels) {
+			case 1: return op.template apply<K,1>(fn);
+			case 2: return op.template apply<K,2>(fn);
+			case 3: return op.template apply<K,3>(fn);
+			case 4: return op.template apply<K,4>(fn);
+			default: throw IoException(fn, "Raw images with more than 4 channels can not be loaded anonymously");
+			}
+		}
+
+		template<typename OP>
+		AnonymousImage RawDispatch(const OP& op, const std::string& fn, ElementType type, unsigned channels)
+		{
+			switch(type) {
+			case ElementType::UInt8: return RawDispatchChannels<unsigned char>(op, fn, channels);
+			case ElementType::Int8: return RawDispatchChannels<signed char>(op, fn, channels);
+			case ElementType::UInt16: return RawDispatchChannels<uint16_t>(op, fn, channels);
+			case ElementType::Int16: return RawDispatchChannels<int16_t>(op, fn, channels);
+			case ElementType::UInt32: return RawDispatchChannels<uint32_t>(op, fn, channels);
+			case ElementType::Int32: return RawDispatchChannels<int32_t>(op, fn, channels);
+			case ElementType::Float32: return RawDispatchChannels<float>(op, fn, channels);
+			case ElementType::Float64: return RawDispatchChannels<double>(op, fn, channels);
+			default: throw IoException(fn, "Invalid raw image header (element type)");
+			}
+		}
+	}
+
+	/** Loads a raw image as anonymous image
+	 * Where supported the file is memory mapped read-only instead of read.
+	 */
+	inline
+	AnonymousImage RawLoad(const std::string& fn)
+	{
+		std::ifstream ifs(fn, std::ios::binary);
+		if(!ifs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		const detail::RawHeader h = detail::ReadRawHeader(ifs, fn);
+		ifs.close();
+#if defined SLIMAGE_HAS_MMAP
+		return detail::RawDispatch(detail::RawMapOp{}, fn, static_cast<ElementType>(h.element_type), h.channels);
+#else
+		return detail::RawDispatch(detail::RawReadOp{}, fn, static_cast<ElementType>(h.element_type), h.channels);
+#endif
+	}
+
+}
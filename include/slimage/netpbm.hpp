@@ -0,0 +1,323 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// PGM (P2/P5) and PPM (P3/P6) images with 8 or 16 bit per channel; files are written binary.
+// Does not depend on OpenCV or Qt and decodes directly into the image buffer.
+
+namespace slimage
+{
+
+	namespace detail
+	{
+		struct NetpbmHeader
+		{
+			unsigned channels; // 1 for P2/P5, 3 for P3/P6
+			unsigned width, height;
+			unsigned maxval;
+			bool ascii; // P2/P3 store decimal values
+
+			/** Bytes per channel, i.e. 1 or 2 */
+			unsigned bytes() const
+			{ return maxval < 256 ? 1 : 2; }
+		};
+
+		/** Skips whitespace and comments and reads a decimal number */
+		inline
+		unsigned ReadNetpbmNumber(std::istream& is, const std::string& fn)
+		{
+			int c = is.get();
+			while(c != EOF && (std::isspace(c) || c == '#')) {
+				if(c == '#') {
+					while(c != EOF && c != '\n' && c != '\r') {
+						c = is.get();
+					}
+				}
+				c = is.get();
+			}
+			if(c == EOF || !std::isdigit(c)) {
+				throw IoException(fn, "Invalid netpbm header");
+			}
+			unsigned long v = 0;
+			while(c != EOF && std::isdigit(c)) {
+				v = 10*v + (c - '0');
+				if(v > 0xFFFFFFFFul) {
+					throw IoException(fn, "Invalid netpbm header (number too large)");
+				}
+				c = is.get();
+			}
+			// exactly one whitespace character separates the header from the pixel data
+			if(c != EOF && !std::isspace(c)) {
+				throw IoException(fn, "Invalid netpbm header");
+			}
+			return static_cast<unsigned>(v);
+		}
+
+		inline
+		NetpbmHeader ReadNetpbmHeader(std::istream& is, const std::string& fn)
+		{
+			char magic[2];
+			if(!is.read(magic, 2) || magic[0] != 'P' || magic[1] < '2' || magic[1] > '6' || magic[1] == '4') {
+				throw IoException(fn, "Not a PGM or PPM file (P2/P3/P5/P6)");
+			}
+			NetpbmHeader h;
+			h.channels = (magic[1] == '2' || magic[1] == '5') ? 1 : 3;
+			h.ascii = (magic[1] == '2' || magic[1] == '3');
+			h.width = ReadNetpbmNumber(is, fn);
+			h.height = ReadNetpbmNumber(is, fn);
+			h.maxval = ReadNetpbmNumber(is, fn);
+			if(h.maxval == 0 || h.maxval > 65535) {
+				throw IoException(fn, "Invalid netpbm header (max value)");
+			}
+			return h;
+		}
+
+		template<typename K, unsigned CC>
+		struct IsNetpbmType
+		{
+			static constexpr bool value =
+				(std::is_same<K,unsigned char>::value || std::is_same<K,uint16_t>::value)
+				&& (CC == 1 || CC == 3);
+		};
+
+		/** Reads the next decimal value of the pixel data of a P2/P3 file */
+		inline
+		unsigned ReadNetpbmAsciiValue(std::streambuf& sb, const std::string& fn, unsigned maxval)
+		{
+			int c = sb.sbumpc();
+			while(c != EOF && (std::isspace(c) || c == '#')) {
+				if(c == '#') {
+					while(c != EOF && c != '\n' && c != '\r') {
+						c = sb.sbumpc();
+					}
+				}
+				c = sb.sbumpc();
+			}
+			if(c == EOF) {
+				throw IoException(fn, "Unexpected end of file");
+			}
+			if(!std::isdigit(c)) {
+				throw IoException(fn, "Invalid value in netpbm data");
+			}
+			unsigned v = 0;
+			while(c != EOF && std::isdigit(c)) {
+				v = 10*v + static_cast<unsigned>(c - '0');
+				if(v > maxval) {
+					throw IoException(fn, "Invalid value in netpbm data (larger than max value)");
+				}
+				c = sb.sbumpc();
+			}
+			if(c != EOF && !std::isspace(c)) {
+				throw IoException(fn, "Invalid value in netpbm data");
+			}
+			return v;
+		}
+
+		/** Reads the pixel data following the header 'h' into 'img' which has the size given in the header */
+		template<typename K, unsigned CC>
+		void ReadNetpbmData(std::istream& is, const std::string& fn, const NetpbmHeader& h, const ImageView<K,CC>& img)
+		{
+			const size_t n = img.numElementsScanline();
+			if(n == 0) {
+				return;
+			}
+			if(h.ascii) {
+				std::streambuf& sb = *is.rdbuf();
+				for(unsigned y=0; y<img.height(); y++) {
+					K* p = img.pixel_pointer(0,y);
+					for(size_t i=0; i<n; i++) {
+						p[i] = static_cast<K>(ReadNetpbmAsciiValue(sb, fn, h.maxval));
+					}
+				}
+				return;
+			}
+			const size_t bytes = n*sizeof(K);
+			auto read = [&is,&fn](K* p, size_t bytes) {
+				if(!is.read(reinterpret_cast<char*>(p), bytes)) {
+					throw IoException(fn, "Unexpected end of file");
+				}
+			};
+			if(img.isContiguous()) {
+				read(img.pixel_pointer(), bytes*img.height());
+			}
+			else {
+				for(unsigned y=0; y<img.height(); y++) {
+					read(img.pixel_pointer(0,y), bytes);
+				}
+			}
+			// 16 bit values are stored big endian
+			if(sizeof(K) == 2 && IsLittleEndian()) {
+				for(unsigned y=0; y<img.height(); y++) {
+					uint16_t* p = reinterpret_cast<uint16_t*>(img.pixel_pointer(0,y));
+					ByteSwap16(p, n, p);
+				}
+			}
+		}
+
+		template<typename K, unsigned CC>
+		AnonymousImage ReadNetpbmAnonymous(std::istream& is, const std::string& fn, const NetpbmHeader& h)
+		{
+			Image<K,CC> img(h.width, h.height);
+			ReadNetpbmData(is, fn, h, img.view());
+			return make_anonymous(std::move(img));
+		}
+
+		template<typename K, unsigned CC>
+		void CheckNetpbmType(const std::string& fn)
+		{
+			if(!IsNetpbmType<K,CC>::value) {
+				throw IoException(fn, "Netpbm supports 1 or 3 channels with 8 or 16 bit");
+			}
+		}
+
+		template<typename K, unsigned CC>
+		void WriteNetpbmHeader(std::ostream& os, unsigned width, unsigned height)
+		{
+			os << (CC == 1 ? "P5" : "P6") << "\n"
+				<< width << " " << height << "\n"
+				<< (sizeof(K) == 1 ? 255 : 65535) << "\n";
+		}
+
+		/** Writes the lines of 'img' as netpbm pixel data */
+		template<typename K, unsigned CC>
+		void WriteNetpbmData(std::ostream& os, const ImageView<const K,CC>& img)
+		{
+			const size_t n = img.numElementsScanline();
+			std::vector<uint16_t> swapped;
+			for(unsigned y=0; y<img.height(); y++) {
+				const char* p = reinterpret_cast<const char*>(img.pixel_pointer(0,y));
+				if(sizeof(K) == 2 && IsLittleEndian()) {
+					swapped.resize(n);
+					ByteSwap16(reinterpret_cast<const uint16_t*>(p), n, swapped.data());
+					p = reinterpret_cast<const char*>(swapped.data());
+				}
+				os.write(p, n*sizeof(K));
+			}
+		}
+
+		template<typename K, unsigned CC>
+		void WriteNetpbm(const std::string& fn, const ImageView<const K,CC>& img)
+		{
+			CheckNetpbmType<K,CC>(fn);
+			std::ofstream ofs(fn, std::ios::binary);
+			if(!ofs.is_open()) {
+				throw IoException(fn, "Could not open file");
+			}
+			WriteNetpbmHeader<K,CC>(ofs, img.width(), img.height());
+			WriteNetpbmData(ofs, img);
+			if(!ofs) {
+				throw IoException(fn, "Could not write file");
+			}
+		}
+	}
+
+	/** True if the filename has one of the extensions .pgm, .ppm or .pnm (case insensitive) */
+	inline
+	bool IsNetpbmFilename(const std::string& fn)
+	{
+		if(fn.size() < 4 || fn[fn.size() - 4] != '.') {
+			return false;
+		}
+		std::string ext = fn.substr(fn.size() - 3);
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+		return ext == "pgm" || ext == "ppm" || ext == "pnm";
+	}
+
+	/** Loads a PGM or PPM file into 'img' which is only reallocated if its size differs
+	 * Throws an IoException if the file does not store pixels of type K with CC channels.
+	 */
+	template<typename K, unsigned CC>
+	void NetpbmLoadInto(const std::string& fn, Image<K,CC>& img)
+	{
+		std::ifstream ifs(fn, std::ios::binary);
+		if(!ifs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		const detail::NetpbmHeader h = detail::ReadNetpbmHeader(ifs, fn);
+		if(!detail::IsNetpbmType<K,CC>::value || h.channels != CC || h.bytes() != sizeof(K)) {
+			throw IoException(fn, "Image does not have specified type");
+		}
+		if(img.width() != h.width || img.height() != h.height) {
+			img.resize(h.width, h.height);
+		}
+		detail::ReadNetpbmData(ifs, fn, h, img.view());
+	}
+
+	/** Loads a PGM or PPM file into an image of the given type
+	 * Throws an IoException if the file does not store pixels of type K with CC channels.
+	 */
+	template<typename K, unsigned CC>
+	Image<K,CC> NetpbmLoad(const std::string& fn)
+	{
+		Image<K,CC> img;
+		NetpbmLoadInto(fn, img);
+		return img;
+	}
+
+	/** Loads a PGM or PPM file as 1ub, 3ub, 1ui16 or 3ui16 image */
+	inline
+	AnonymousImage NetpbmLoad(const std::string& fn)
+	{
+		std::ifstream ifs(fn, std::ios::binary);
+		if(!ifs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		const detail::NetpbmHeader h = detail::ReadNetpbmHeader(ifs, fn);
+		if(h.channels == 1) {
+			return (h.bytes() == 1)
+				? detail::ReadNetpbmAnonymous<unsigned char,1>(ifs, fn, h)
+				: detail::ReadNetpbmAnonymous<uint16_t,1>(ifs, fn, h);
+		}
+		else {
+			return (h.bytes() == 1)
+				? detail::ReadNetpbmAnonymous<unsigned char,3>(ifs, fn, h)
+				: detail::ReadNetpbmAnonymous<uint16_t,3>(ifs, fn, h);
+		}
+	}
+
+	/** Saves a 1 or 3 channel image with 8 or 16 bit per channel as binary PGM or PPM
+	 * Throws an IoException for other image types.
+	 */
+	template<typename K, unsigned CC>
+	void NetpbmSave(const std::string& fn, const ImageView<K,CC>& img)
+	{ detail::WriteNetpbm<typename std::remove_const<K>::type,CC>(fn, img); }
+
+	template<typename K, unsigned CC>
+	void NetpbmSave(const std::string& fn, const Image<K,CC>& img)
+	{ detail::WriteNetpbm<K,CC>(fn, img.view()); }
+
+	/** Saves an anonymous image as binary PGM or PPM
+	 * Throws an IoException if the image type is not supported by the format.
+	 */
+	inline
+	void NetpbmSave(const std::string& fn, const AnonymousImage& aimg)
+	{
+		if(anonymous_is<unsigned char,1>(aimg)) {
+			NetpbmSave(fn, anonymous_view<unsigned char,1>(aimg));
+		}
+		else if(anonymous_is<unsigned char,3>(aimg)) {
+			NetpbmSave(fn, anonymous_view<unsigned char,3>(aimg));
+		}
+		else if(anonymous_is<uint16_t,1>(aimg)) {
+			NetpbmSave(fn, anonymous_view<uint16_t,1>(aimg));
+		}
+		else if(anonymous_is<uint16_t,3>(aimg)) {
+			NetpbmSave(fn, anonymous_view<uint16_t,3>(aimg));
+		}
+		else {
+			throw IoException(fn, "Netpbm supports 1 or 3 channels with 8 or 16 bit");
+		}
+	}
+
+}
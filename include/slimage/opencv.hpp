@@ -3,9 +3,15 @@
 #include <slimage/image.hpp>
 #include <slimage/error.hpp>
 #include <slimage/algorithm.hpp>
+#include <slimage/pool.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#if defined SLIMAGE_IO_INC_WITHOUT_BACKEND && !defined SLIMAGE_OPENCV_INC_UNDO
+#  error Include slimage/opencv.hpp BEFORE slimage/io.hpp and headers which include it (saver.hpp, sequence.hpp)
+#endif
 #define SLIMAGE_OPENCV_INC
 #include <functional>
+#include <string>
+#include <type_traits>
 
 namespace slimage
 {
@@ -15,10 +21,15 @@ namespace slimage
 		template<typename K, unsigned CC>
 		struct OpenCvImageType;
 
+		/** True if OpenCvImageType is defined for K and CC */
+		template<typename K, unsigned CC>
+		struct OpenCvHasImageType : std::false_type {};
+
 		#define SLIMAGE_OPENCV_IMG_TYPE(K,CC,CVT) \
 			template<> struct OpenCvImageType<K,CC> { \
 				static constexpr int value = CVT; \
-			};
+			}; \
+			template<> struct OpenCvHasImageType<K,CC> : std::true_type {};
 
 		#define SLIMAGE_OPENCV_IMG_TYPE_BATCH(K,CVT) \
 			SLIMAGE_OPENCV_IMG_TYPE(K,1,CVT##C1) \
@@ -61,24 +72,30 @@ namespace slimage
 
 	}
 
-	/** Converts a typed slimage image to an OpenCV image */
+	/** Converts a view onto slimage pixels to an OpenCV image */
 	template<typename K, unsigned CC>
-	cv::Mat ConvertToOpenCv(const Image<K,CC>& img)
+	cv::Mat ConvertToOpenCv(const ImageView<K,CC>& img)
 	{
-	 	cv::Mat mat(img.height(), img.width(), detail::OpenCvImageType<K,CC>::value);
+		using base_t = typename std::remove_const<K>::type;
+	 	cv::Mat mat(img.height(), img.width(), detail::OpenCvImageType<base_t,CC>::value);
 		CopyScanlines(
 			img,
-			[&mat](unsigned y) { return mat.ptr<K>(y,0); },
-			detail::OpenCvCopyPixelsImpl<K,CC>::function);
+			[&mat](unsigned y) { return mat.ptr<base_t>(y,0); },
+			detail::OpenCvCopyPixelsImpl<base_t,CC>::function);
 	 	return mat;
 	}
 
+	/** Converts a typed slimage image to an OpenCV image */
+	template<typename K, unsigned CC>
+	cv::Mat ConvertToOpenCv(const Image<K,CC>& img)
+	{ return ConvertToOpenCv(img.view()); }
+
 	/** Converts an anonymous slimage image to an OpenCV image */
 	inline
 	cv::Mat ConvertToOpenCv(const AnonymousImage& aimg)
 	{
 		#define SLIMAGE_ConvertToOpenCv_HELPER(K,CC) \
-			if(anonymous_is<K,CC>(aimg)) return ConvertToOpenCv(anonymous_cast<K,CC>(aimg));
+			if(anonymous_is<K,CC>(aimg)) return ConvertToOpenCv(anonymous_view<K,CC>(aimg));
 
 		#define SLIMAGE_ConvertToOpenCv_HELPER_BATCH(K) \
 			SLIMAGE_ConvertToOpenCv_HELPER(K,1) \
@@ -97,15 +114,39 @@ namespace slimage
 		#undef SLIMAGE_ConvertToOpenCv_HELPER
 	}
 
-	/** Converts an OpenCV image to a typed slimage image */
+	/** Converts an OpenCV image into 'img' which is only reallocated if its size differs */
 	template<typename K, unsigned CC>
-	Image<K,CC> ConvertToSlimage(const cv::Mat& mat)
+	void ConvertToSlimage(const cv::Mat& mat, Image<K,CC>& img)
 	{
 		#define TOSTRING(X) #X
 		if(mat.type() != detail::OpenCvImageType<K,CC>::value)
 			throw ConversionException("cv::Mat does not have expected type: element_type=" TOSTRING(K) ", channel count=" TOSTRING(CC));
 		#undef TOSTRING
-		Image<K,CC> img(mat.cols, mat.rows);
+		if(img.width() != static_cast<unsigned>(mat.cols) || img.height() != static_cast<unsigned>(mat.rows)) {
+			img.resize(mat.cols, mat.rows);
+		}
+		CopyScanlines(
+			[&mat](unsigned y) { return mat.ptr<K>(y,0); },
+			img,
+			detail::OpenCvCopyPixelsImpl<K,CC>::function);
+	}
+
+	/** Converts an OpenCV image to a typed slimage image */
+	template<typename K, unsigned CC>
+	Image<K,CC> ConvertToSlimage(const cv::Mat& mat)
+	{
+		Image<K,CC> img;
+		ConvertToSlimage(mat, img);
+		return img;
+	}
+
+	/** Converts an OpenCV image to a typed slimage image using a buffer from the pool */
+	template<typename K, unsigned CC>
+	Image<K,CC> ConvertToSlimage(ImagePool& pool, const cv::Mat& mat)
+	{
+		if(mat.type() != detail::OpenCvImageType<K,CC>::value)
+			throw ConversionException("cv::Mat does not have expected type");
+		Image<K,CC> img = pool.acquire<K,CC>(mat.cols, mat.rows);
 		CopyScanlines(
 			[&mat](unsigned y) { return mat.ptr<K>(y,0); },
 			img,
@@ -113,6 +154,25 @@ namespace slimage
 		return img;
 	}
 
+	/** Creates a view onto the pixels of an OpenCV image without copying
+	 * Note that OpenCV stores color images in BGR(A) order.
+	 */
+	template<typename K, unsigned CC>
+	ImageView<K,CC> ViewOpenCv(cv::Mat& mat)
+	{
+		if(mat.type() != detail::OpenCvImageType<K,CC>::value)
+			throw ConversionException("cv::Mat does not have expected type for ViewOpenCv");
+		return ImageView<K,CC>(mat.ptr<K>(0), mat.cols, mat.rows, mat.step[0]);
+	}
+
+	template<typename K, unsigned CC>
+	ImageView<const K,CC> ViewOpenCv(const cv::Mat& mat)
+	{
+		if(mat.type() != detail::OpenCvImageType<K,CC>::value)
+			throw ConversionException("cv::Mat does not have expected type for ViewOpenCv");
+		return ImageView<const K,CC>(mat.ptr<K>(0), mat.cols, mat.rows, mat.step[0]);
+	}
+
 	/** Converts an OpenCV image to an anonymous slimage image */
 	inline
 	AnonymousImage ConvertToSlimage(const cv::Mat& mat)
@@ -155,4 +215,36 @@ namespace slimage
 		return ConvertToSlimage(mat);
 	}
 
+	namespace detail
+	{
+		template<typename K, unsigned CC>
+		void OpenCvLoadIntoImpl(const std::string& filename, Image<K,CC>& img, std::true_type)
+		{
+			// let OpenCV decode directly to the requested number of channels and bit depth
+			const int color = (CC == 1) ? cv::IMREAD_GRAYSCALE : ((CC == 3) ? cv::IMREAD_COLOR : cv::IMREAD_UNCHANGED);
+			const int flags = (CC == 4 || sizeof(K) == 1) ? color : (color | cv::IMREAD_ANYDEPTH);
+			cv::Mat mat = cv::imread(filename, flags);
+			if(mat.empty()) {
+				throw IoException(filename, "Empty image (does the file exists?)");
+			}
+			try {
+				ConvertToSlimage(mat, img);
+			}
+			catch(const ConversionException&) {
+				throw IoException(filename, "Image does not have specified type");
+			}
+		}
+
+		template<typename K, unsigned CC>
+		void OpenCvLoadIntoImpl(const std::string& filename, Image<K,CC>&, std::false_type)
+		{ throw IoException(filename, "Image type is not supported by OpenCV"); }
+	}
+
+	/** Loads an image from a file using OpenCV into 'img' which is only reallocated if its size differs
+	 * OpenCV decodes into its own buffer which is then copied into 'img'.
+	 */
+	template<typename K, unsigned CC>
+	void OpenCvLoadInto(const std::string& filename, Image<K,CC>& img)
+	{ detail::OpenCvLoadIntoImpl(filename, img, detail::OpenCvHasImageType<K,CC>()); }
+
 }
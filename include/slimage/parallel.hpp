@@ -0,0 +1,294 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/algorithm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace slimage
+{
+
+	/** A fixed set of worker threads which execute index ranges in parallel
+	 * The thread calling run participates in the work. Calling run from inside a job
+	 * executes the nested job sequentially on the calling thread.
+	 */
+	class ThreadPool
+	{
+	public:
+		/** Creates a pool with the given total number of threads (0 for one per hardware thread) */
+		explicit ThreadPool(unsigned num_threads=0)
+		:	job_(nullptr),
+			generation_(0),
+			stop_(false)
+		{
+			if(num_threads == 0) {
+				num_threads = std::max(1u, std::thread::hardware_concurrency());
+			}
+			for(unsigned i=1; i<num_threads; i++) {
+				workers_.emplace_back([this]() { work(); });
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop_ = true;
+			}
+			wake_.notify_all();
+			for(std::thread& t : workers_) {
+				t.join();
+			}
+		}
+
+		/** Number of threads including the calling thread */
+		unsigned size() const
+		{ return workers_.size() + 1; }
+
+		/** Calls fnc(i) for all i in [0,n) and waits until all calls have finished
+		 * The first exception thrown by fnc is rethrown after all other calls are done.
+		 */
+		template<typename F>
+		void run(size_t n, F fnc)
+		{
+			if(n == 0) {
+				return;
+			}
+			if(workers_.empty() || n == 1 || InsideWorker()) {
+				for(size_t i=0; i<n; i++) {
+					fnc(i);
+				}
+				return;
+			}
+			std::lock_guard<std::mutex> run_lock(run_mutex_);
+			Job job;
+			job.invoke = &Invoke<F>;
+			job.fnc = &fnc;
+			job.n = n;
+			job.next = 0;
+			job.remaining = n;
+			job.active = 0;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				job_ = &job;
+				generation_++;
+			}
+			wake_.notify_all();
+			process(job);
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				done_.wait(lock, [&job]() { return job.remaining == 0 && job.active == 0; });
+				job_ = nullptr;
+			}
+			if(job.error) {
+				std::rethrow_exception(job.error);
+			}
+		}
+
+		/** A process-wide pool with one thread per hardware thread */
+		static ThreadPool& Default()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+	private:
+		struct Job
+		{
+			void (*invoke)(void*, size_t);
+			void* fnc;
+			size_t n;
+			std::atomic<size_t> next;
+			std::atomic<size_t> remaining;
+			unsigned active; // guarded by mutex_
+			std::mutex error_mutex;
+			std::exception_ptr error;
+		};
+
+		template<typename F>
+		static void Invoke(void* fnc, size_t i)
+		{ (*static_cast<F*>(fnc))(i); }
+
+		static bool& InsideWorker()
+		{
+			static thread_local bool inside = false;
+			return inside;
+		}
+
+		void process(Job& job)
+		{
+			const bool was_inside = InsideWorker();
+			InsideWorker() = true;
+			size_t i;
+			while((i = job.next++) < job.n) {
+				try {
+					job.invoke(job.fnc, i);
+				}
+				catch(...) {
+					std::lock_guard<std::mutex> lock(job.error_mutex);
+					if(!job.error) {
+						job.error = std::current_exception();
+					}
+				}
+				if(--job.remaining == 0) {
+					std::lock_guard<std::mutex> lock(mutex_);
+					done_.notify_all();
+				}
+			}
+			InsideWorker() = was_inside;
+		}
+
+		void work()
+		{
+			size_t seen = 0;
+			while(true) {
+				Job* job;
+				{
+					std::unique_lock<std::mutex> lock(mutex_);
+					wake_.wait(lock, [this,seen]() { return stop_ || generation_ != seen; });
+					if(stop_) {
+						return;
+					}
+					seen = generation_;
+					job = job_;
+					if(!job) {
+						continue;
+					}
+					job->active++;
+				}
+				process(*job);
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					job->active--;
+					done_.notify_all();
+				}
+			}
+		}
+
+		std::vector<std::thread> workers_;
+		std::mutex run_mutex_;
+		std::mutex mutex_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		Job* job_;
+		size_t generation_;
+		bool stop_;
+	};
+
+	/** Execution policy which runs an algorithm on the calling thread */
+	struct SequentialPolicy {};
+
+	/** Execution policy which splits the image into bands of lines processed by a thread pool
+	 * Every pixel is computed independently, thus results do not depend on the number of threads.
+	 */
+	struct ParallelPolicy
+	{
+		ParallelPolicy()
+		:	pool(nullptr),
+			min_band_rows(8)
+		{}
+
+		explicit ParallelPolicy(ThreadPool& pool, unsigned min_band_rows=8)
+		:	pool(&pool),
+			min_band_rows(min_band_rows)
+		{}
+
+		/** The pool to use or nullptr for ThreadPool::Default() */
+		ThreadPool* pool;
+
+		/** Bands are never smaller than this to keep the per-band overhead low */
+		unsigned min_band_rows;
+
+		ThreadPool& threads() const
+		{ return pool ? *pool : ThreadPool::Default(); }
+	};
+
+	constexpr SequentialPolicy seq{};
+	const ParallelPolicy par{};
+
+	/** Calls fnc(y0,y1) for bands of lines which together cover [0,height) */
+	template<typename F>
+	void ParallelRows(const ParallelPolicy& policy, unsigned height, F fnc)
+	{
+		ThreadPool& pool = policy.threads();
+		const unsigned min_rows = std::max(1u, policy.min_band_rows);
+		// a few bands per thread balance uneven per-line costs
+		const unsigned max_bands = std::max(1u, (height + min_rows - 1) / min_rows);
+		const unsigned bands = std::min(max_bands, 4*pool.size());
+		const unsigned rows = (height + bands - 1) / std::max(1u, bands);
+		pool.run(bands, [&fnc,rows,height](size_t b) {
+			const unsigned y0 = b*rows;
+			const unsigned y1 = std::min(height, y0 + rows);
+			if(y0 < y1) {
+				fnc(y0, y1);
+			}
+		});
+	}
+
+	template<typename F>
+	void ParallelRows(const SequentialPolicy&, unsigned height, F fnc)
+	{ fnc(0u, height); }
+
+	template<typename SRC, unsigned CC, typename F>
+	auto Convert(const SequentialPolicy&, const ImageView<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src, fnc))
+	{ return Convert(src, fnc); }
+
+	template<typename SRC, unsigned CC, typename F>
+	auto Convert(const SequentialPolicy&, const Image<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src.view(), fnc))
+	{ return Convert(src.view(), fnc); }
+
+	/** Convert with lines processed in parallel; 'fnc' is called concurrently */
+	template<typename SRC, unsigned CC, typename F>
+	auto Convert(const ParallelPolicy& policy, const ImageView<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src, fnc))
+	{
+		decltype(Convert(src, fnc)) dst{src.dimensions()};
+		ParallelRows(policy, src.height(), [&src,&dst,&fnc](unsigned y0, unsigned y1) {
+			detail::ConvertRows(src, dst, fnc, y0, y1);
+		});
+		return dst;
+	}
+
+	template<typename SRC, unsigned CC, typename F>
+	auto Convert(const ParallelPolicy& policy, const Image<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src.view(), fnc))
+	{ return Convert(policy, src.view(), fnc); }
+
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(const SequentialPolicy&, const ImageView<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src, fnc))
+	{ return ConvertUV(src, fnc); }
+
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(const SequentialPolicy&, const Image<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src.view(), fnc))
+	{ return ConvertUV(src.view(), fnc); }
+
+	/** ConvertUV with lines processed in parallel; 'fnc' is called concurrently */
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(const ParallelPolicy& policy, const ImageView<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src, fnc))
+	{
+		decltype(ConvertUV(src, fnc)) dst{src.dimensions()};
+		ParallelRows(policy, src.height(), [&src,&dst,&fnc](unsigned y0, unsigned y1) {
+			detail::ConvertUVRows(src, dst, fnc, y0, y1);
+		});
+		return dst;
+	}
+
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(const ParallelPolicy& policy, const Image<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src.view(), fnc))
+	{ return ConvertUV(policy, src.view(), fnc); }
+
+}
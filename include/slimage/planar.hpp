@@ -0,0 +1,279 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/algorithm.hpp>
+#include <slimage/simd.hpp>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+namespace slimage
+{
+
+	/** An image which stores each channel in its own contiguous plane
+	 * Every plane is an Image<K,1>, thus all single-channel algorithms can be applied
+	 * to the planes directly.
+	 */
+	template<typename K, unsigned CC>
+	class PlanarImage
+	{
+	public:
+		using element_t = K;
+		using plane_t = Image<K,1>;
+		using dim_t = std::tuple<unsigned,unsigned>;
+
+		PlanarImage() {}
+
+		PlanarImage(unsigned width, unsigned height)
+		{ resize(width, height); }
+
+		PlanarImage(dim_t dim)
+		:	PlanarImage(std::get<0>(dim), std::get<1>(dim))
+		{}
+
+		void resize(unsigned width, unsigned height)
+		{
+			for(plane_t& p : planes_) {
+				p.resize(width, height);
+			}
+		}
+
+		void resize(dim_t dim)
+		{ resize(std::get<0>(dim), std::get<1>(dim)); }
+
+		bool empty() const
+		{ return planes_[0].empty(); }
+
+		/** Width of image */
+		unsigned width() const
+		{ return planes_[0].width(); }
+
+		/** Height of image */
+		unsigned height() const
+		{ return planes_[0].height(); }
+
+		dim_t dimensions() const
+		{ return planes_[0].dimensions(); }
+
+		/** Number of planes */
+		unsigned channelCount() const
+		{ return CC; }
+
+		/** Number of pixels, i.e. width()*height() */
+		size_t size() const
+		{ return planes_[0].size(); }
+
+		/** The plane holding channel c */
+		plane_t& plane(unsigned c)
+		{
+			assert(c < CC);
+			return planes_[c];
+		}
+
+		const plane_t& plane(unsigned c) const
+		{
+			assert(c < CC);
+			return planes_[c];
+		}
+
+		K& operator()(unsigned x, unsigned y, unsigned c)
+		{ return plane(c)(x,y); }
+
+		const K& operator()(unsigned x, unsigned y, unsigned c) const
+		{ return plane(c)(x,y); }
+
+	private:
+		std::array<plane_t,CC> planes_;
+	};
+
+	namespace detail
+	{
+		/** Splits n interleaved pixels into CC separate rows */
+		template<typename K, unsigned CC>
+		struct PlanarRow
+		{
+			static void deinterleave(const K* src, K* const* dst, size_t n)
+			{
+				for(size_t i=0; i<n; i++) {
+					for(unsigned c=0; c<CC; c++) {
+						dst[c][i] = src[CC*i + c];
+					}
+				}
+			}
+
+			static void interleave(const K* const* src, K* dst, size_t n)
+			{
+				for(size_t i=0; i<n; i++) {
+					for(unsigned c=0; c<CC; c++) {
+						dst[CC*i + c] = src[c][i];
+					}
+				}
+			}
+		};
+
+		/** True if rows of K can be (de)interleaved with the byte shuffles of SimdDeinterleave */
+		template<typename K>
+		struct PlanarSimd
+		{
+			static constexpr bool value = std::is_arithmetic<K>::value
+				&& (sizeof(K) == 1 || sizeof(K) == 2 || sizeof(K) == 4);
+		};
+
+		// The specializations shuffle blocks of pixels with SIMD instructions and handle
+		// the remaining pixels with one pointer per plane and a fixed stride.
+
+		template<typename K>
+		struct PlanarRow<K,3>
+		{
+			static void deinterleave(const K* src, K* const* dst, size_t n)
+			{
+				K* d0 = dst[0];
+				K* d1 = dst[1];
+				K* d2 = dst[2];
+				size_t i = 0;
+				if(PlanarSimd<K>::value) {
+					void* const rows[3] = { d0, d1, d2 };
+					i = SimdDeinterleave(3, sizeof(K), src, n, rows);
+				}
+				for(; i<n; i++) {
+					d0[i] = src[3*i];
+					d1[i] = src[3*i + 1];
+					d2[i] = src[3*i + 2];
+				}
+			}
+
+			static void interleave(const K* const* src, K* dst, size_t n)
+			{
+				const K* s0 = src[0];
+				const K* s1 = src[1];
+				const K* s2 = src[2];
+				size_t i = 0;
+				if(PlanarSimd<K>::value) {
+					const void* const rows[3] = { s0, s1, s2 };
+					i = SimdInterleave(3, sizeof(K), rows, n, dst);
+				}
+				for(; i<n; i++) {
+					dst[3*i] = s0[i];
+					dst[3*i + 1] = s1[i];
+					dst[3*i + 2] = s2[i];
+				}
+			}
+		};
+
+		template<typename K>
+		struct PlanarRow<K,4>
+		{
+			static void deinterleave(const K* src, K* const* dst, size_t n)
+			{
+				K* d0 = dst[0];
+				K* d1 = dst[1];
+				K* d2 = dst[2];
+				K* d3 = dst[3];
+				size_t i = 0;
+				if(PlanarSimd<K>::value) {
+					void* const rows[4] = { d0, d1, d2, d3 };
+					i = SimdDeinterleave(4, sizeof(K), src, n, rows);
+				}
+				for(; i<n; i++) {
+					d0[i] = src[4*i];
+					d1[i] = src[4*i + 1];
+					d2[i] = src[4*i + 2];
+					d3[i] = src[4*i + 3];
+				}
+			}
+
+			static void interleave(const K* const* src, K* dst, size_t n)
+			{
+				const K* s0 = src[0];
+				const K* s1 = src[1];
+				const K* s2 = src[2];
+				const K* s3 = src[3];
+				size_t i = 0;
+				if(PlanarSimd<K>::value) {
+					const void* const rows[4] = { s0, s1, s2, s3 };
+					i = SimdInterleave(4, sizeof(K), rows, n, dst);
+				}
+				for(; i<n; i++) {
+					dst[4*i] = s0[i];
+					dst[4*i + 1] = s1[i];
+					dst[4*i + 2] = s2[i];
+					dst[4*i + 3] = s3[i];
+				}
+			}
+		};
+	}
+
+	/** Converts an interleaved image into a planar image */
+	template<typename K, unsigned CC>
+	PlanarImage<typename std::remove_const<K>::type,CC> Deinterleave(const ImageView<K,CC>& src)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		PlanarImage<base_t,CC> dst(src.dimensions());
+		if(src.width() == 0) {
+			return dst;
+		}
+		std::array<base_t*,CC> rows;
+		for(unsigned y=0; y<src.height(); y++) {
+			for(unsigned c=0; c<CC; c++) {
+				rows[c] = dst.plane(c).pixel_pointer(0,y);
+			}
+			detail::PlanarRow<base_t,CC>::deinterleave(src.pixel_pointer(0,y), rows.data(), src.width());
+		}
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	PlanarImage<K,CC> Deinterleave(const Image<K,CC>& src)
+	{ return Deinterleave(src.view()); }
+
+	/** Converts a planar image into an interleaved image */
+	template<typename K, unsigned CC>
+	Image<K,CC> Interleave(const PlanarImage<K,CC>& src)
+	{
+		Image<K,CC> dst(src.dimensions());
+		if(src.width() == 0) {
+			return dst;
+		}
+		std::array<const K*,CC> rows;
+		for(unsigned y=0; y<src.height(); y++) {
+			for(unsigned c=0; c<CC; c++) {
+				rows[c] = src.plane(c).pixel_pointer(0,y);
+			}
+			detail::PlanarRow<K,CC>::interleave(rows.data(), dst.pixel_pointer(0,y), src.width());
+		}
+		return dst;
+	}
+
+	/** Applies an element-wise function to every plane
+	 * In contrast to Convert for interleaved images 'fnc' maps single elements, not pixels.
+	 */
+	template<typename K, unsigned CC, typename F>
+	auto Convert(const PlanarImage<K,CC>& src, F fnc)
+	-> PlanarImage<typename std::decay<decltype(fnc(std::declval<K>()))>::type,CC>
+	{
+		using dst_t = typename std::decay<decltype(fnc(std::declval<K>()))>::type;
+		PlanarImage<dst_t,CC> dst(src.dimensions());
+		if(src.width() == 0) {
+			return dst;
+		}
+		for(unsigned c=0; c<CC; c++) {
+			const Image<K,1>& sp = src.plane(c);
+			Image<dst_t,1>& dp = dst.plane(c);
+			for(unsigned y=0; y<src.height(); y++) {
+				const K* s = sp.pixel_pointer(0,y);
+				dst_t* d = dp.pixel_pointer(0,y);
+				for(unsigned x=0; x<src.width(); x++) {
+					d[x] = fnc(s[x]);
+				}
+			}
+		}
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,1> PickChannel(const PlanarImage<K,CC>& img, unsigned c)
+	{ return img.plane(c); }
+
+}
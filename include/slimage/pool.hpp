@@ -0,0 +1,241 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/algorithm.hpp>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace slimage
+{
+
+	/** Recycles image buffers for pipelines which process many images of the same size
+	 * Images are handed out with acquire and given back with release. In the steady
+	 * state no memory is allocated. The pool is thread-safe.
+	 */
+	class ImagePool
+	{
+	public:
+		struct Statistics
+		{
+			/** Number of acquired images which were served from the pool */
+			size_t hits;
+			/** Number of acquired images which had to be allocated */
+			size_t misses;
+			/** Number of images currently held by the pool */
+			size_t cached;
+		};
+
+		/** Returns an image with the given size; pixel values are unspecified */
+		template<typename K, unsigned CC>
+		Image<K,CC> acquire(unsigned width, unsigned height)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				Entry& e = entries_[key<K,CC>(width, height)];
+				if(!e.filled.empty()) {
+					AnonymousImage holder = std::move(e.filled.back());
+					e.filled.pop_back();
+					Image<K,CC> img = std::move(anonymous_ref<K,CC>(holder));
+					e.empty.push_back(std::move(holder));
+					hits_++;
+					return img;
+				}
+				misses_++;
+			}
+			return Image<K,CC>(width, height);
+		}
+
+		template<typename K, unsigned CC>
+		Image<K,CC> acquire(std::tuple<unsigned,unsigned> dim)
+		{ return acquire<K,CC>(std::get<0>(dim), std::get<1>(dim)); }
+
+		/** Gives an image back to the pool */
+		template<typename K, unsigned CC>
+		void release(Image<K,CC>&& img)
+		{
+			if(img.empty()) {
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex_);
+			Entry& e = entries_[key<K,CC>(img.width(), img.height())];
+			if(e.empty.empty()) {
+				e.filled.push_back(make_anonymous(std::move(img)));
+			}
+			else {
+				AnonymousImage holder = std::move(e.empty.back());
+				e.empty.pop_back();
+				anonymous_ref<K,CC>(holder) = std::move(img);
+				e.filled.push_back(std::move(holder));
+			}
+		}
+
+		Statistics statistics() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			Statistics s;
+			s.hits = hits_;
+			s.misses = misses_;
+			s.cached = 0;
+			for(const auto& p : entries_) {
+				s.cached += p.second.filled.size();
+			}
+			return s;
+		}
+
+		/** Frees all images held by the pool and resets the statistics */
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			entries_.clear();
+			hits_ = 0;
+			misses_ = 0;
+		}
+
+	private:
+		using key_t = std::tuple<std::type_index,unsigned,unsigned,unsigned>;
+
+		/** Holders with an image ready for use and empty holders kept to avoid reallocation */
+		struct Entry
+		{
+			std::vector<AnonymousImage> filled;
+			std::vector<AnonymousImage> empty;
+		};
+
+		template<typename K, unsigned CC>
+		static key_t key(unsigned width, unsigned height)
+		{ return key_t(std::type_index(typeid(K)), CC, width, height); }
+
+		mutable std::mutex mutex_;
+		std::map<key_t,Entry> entries_;
+		size_t hits_ = 0;
+		size_t misses_ = 0;
+	};
+
+	namespace detail
+	{
+		template<typename IMG>
+		struct PoolAcquire;
+
+		template<typename K, unsigned CC>
+		struct PoolAcquire<Image<K,CC>>
+		{
+			static Image<K,CC> apply(ImagePool& pool, std::tuple<unsigned,unsigned> dim)
+			{ return pool.acquire<K,CC>(dim); }
+		};
+	}
+
+	template<typename SRC, unsigned CC, typename F>
+	auto Convert(ImagePool& pool, const ImageView<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src, fnc))
+	{
+		using img_t = decltype(Convert(src, fnc));
+		img_t dst = detail::PoolAcquire<img_t>::apply(pool, src.dimensions());
+		detail::ConvertInto(src, dst, fnc);
+		return dst;
+	}
+
+	template<typename SRC, unsigned CC, typename F>
+	auto Convert(ImagePool& pool, const Image<SRC,CC>& src, F fnc)
+	-> decltype(Convert(src.view(), fnc))
+	{ return Convert(pool, src.view(), fnc); }
+
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(ImagePool& pool, const ImageView<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src, fnc))
+	{
+		using img_t = decltype(ConvertUV(src, fnc));
+		img_t dst = detail::PoolAcquire<img_t>::apply(pool, src.dimensions());
+		detail::ConvertUVInto(src, dst, fnc);
+		return dst;
+	}
+
+	template<typename SRC, unsigned CC, typename F>
+	auto ConvertUV(ImagePool& pool, const Image<SRC,CC>& src, F fnc)
+	-> decltype(ConvertUV(src.view(), fnc))
+	{ return ConvertUV(pool, src.view(), fnc); }
+
+	template<typename K, unsigned CC>
+	Image<typename std::remove_const<K>::type,1> PickChannel(ImagePool& pool, const ImageView<K,CC>& img, unsigned c)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		assert(c < CC);
+		return Convert(pool, img, [c](const Pixel<base_t,CC>& v) { return v[c]; });
+	}
+
+	template<typename K>
+	Image<typename std::remove_const<K>::type,1> PickChannel(ImagePool& pool, const ImageView<K,1>& img, unsigned c)
+	{
+		assert(c == 0);
+		Image<typename std::remove_const<K>::type,1> result = pool.acquire<typename std::remove_const<K>::type,1>(img.dimensions());
+		detail::CopyInto(img, result);
+		return result;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,1> PickChannel(ImagePool& pool, const Image<K,CC>& img, unsigned c)
+	{ return PickChannel(pool, img.view(), c); }
+
+	template<typename K, unsigned CC>
+	Image<typename std::remove_const<K>::type,CC> SubImage(ImagePool& pool, const ImageView<K,CC>& img, unsigned x, unsigned y, unsigned w, unsigned h)
+	{
+		Image<typename std::remove_const<K>::type,CC> result = pool.acquire<typename std::remove_const<K>::type,CC>(w, h);
+		detail::CopyInto(img.sub(x, y, w, h), result);
+		return result;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> SubImage(ImagePool& pool, const Image<K,CC>& img, unsigned x, unsigned y, unsigned w, unsigned h)
+	{ return SubImage(pool, img.view(), x, y, w, h); }
+
+	template<typename K, unsigned CC>
+	Image<typename std::remove_const<K>::type,CC> FlipY(ImagePool& pool, const ImageView<K,CC>& img)
+	{
+		Image<typename std::remove_const<K>::type,CC> result = pool.acquire<typename std::remove_const<K>::type,CC>(img.dimensions());
+		detail::FlipYInto(img, result);
+		return result;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> FlipY(ImagePool& pool, const Image<K,CC>& img)
+	{ return FlipY(pool, img.view()); }
+
+	template<typename K>
+	Image1f Rescale(ImagePool& pool, const ImageView<K,1>& img, float min, float max)
+	{
+		if(min == max) {
+			Image1f result = pool.acquire<float,1>(img.dimensions());
+			result.fill(0.5f);
+			return result;
+		}
+		float scl = 1.0f / (max - min);
+		return Convert(pool, img, [scl,min](float v) { return std::min(std::max(0.0f,scl*(v - min)),1.0f); });
+	}
+
+	template<typename K>
+	Image1f Rescale(ImagePool& pool, const Image<K,1>& img, float min, float max)
+	{ return Rescale(pool, img.view(), min, max); }
+
+	template<typename K>
+	Image1f Rescale(ImagePool& pool, const ImageView<K,1>& img)
+	{
+		const auto range = detail::MinMaxRows(img, 0, img.height());
+		const float min = range.first, max = range.second;
+		if(!(min < max)) {
+			Image1f result = pool.acquire<float,1>(img.dimensions());
+			result.fill(0.5f);
+			return result;
+		}
+		float scl = 1.0f / (max - min);
+		return Convert(pool, img, [scl,min](float v) { return scl*(v - min); });
+	}
+
+	template<typename K>
+	Image1f Rescale(ImagePool& pool, const Image<K,1>& img)
+	{ return Rescale(pool, img.view()); }
+
+}
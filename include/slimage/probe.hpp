@@ -0,0 +1,322 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/netpbm.hpp>
+#include <slimage/mapped.hpp>
+#include <slimage/depth_codec.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#if defined SLIMAGE_HAS_MMAP
+#  include <dirent.h>
+#endif
+
+// Reads the size and pixel type of an image from the file header without decoding pixels.
+// PGM/PPM, raw, compressed depth, PNG, JPEG and BMP headers are parsed directly. Other
+// formats are probed with QImageReader; include slimage/qt.hpp BEFORE this file for that.
+
+#if defined SLIMAGE_QT_INC
+#  include <QtGui/QImageReader>
+#endif
+
+namespace slimage
+{
+
+	/** Size and pixel type of an image file */
+	struct ImageInfo
+	{
+		unsigned width;
+		unsigned height;
+		unsigned channels;
+		ElementType type;
+	};
+
+	namespace detail
+	{
+		inline
+		uint32_t ReadBigEndian(const unsigned char* p, unsigned bytes)
+		{
+			uint32_t v = 0;
+			for(unsigned i=0; i<bytes; i++) {
+				v = (v << 8) | p[i];
+			}
+			return v;
+		}
+
+		inline
+		uint32_t ReadLittleEndian(const unsigned char* p, unsigned bytes)
+		{
+			uint32_t v = 0;
+			for(unsigned i=bytes; i>0; i--) {
+				v = (v << 8) | p[i-1];
+			}
+			return v;
+		}
+
+		inline
+		ImageInfo ProbeNetpbm(std::istream& is, const std::string& fn, char type)
+		{
+			ImageInfo info;
+			is.seekg(2, std::ios::beg);
+			info.channels = (type == '3' || type == '6') ? 3 : 1;
+			info.width = ReadNetpbmNumber(is, fn);
+			info.height = ReadNetpbmNumber(is, fn);
+			const unsigned maxval = ReadNetpbmNumber(is, fn);
+			if(maxval == 0 || maxval > 65535) {
+				throw IoException(fn, "Invalid netpbm header (max value)");
+			}
+			info.type = (maxval < 256) ? ElementType::UInt8 : ElementType::UInt16;
+			return info;
+		}
+
+		/** PNG: the IHDR chunk directly follows the signature */
+		inline
+		ImageInfo ProbePng(std::istream& is, const std::string& fn)
+		{
+			unsigned char h[26];
+			is.seekg(0, std::ios::beg);
+			if(!is.read(reinterpret_cast<char*>(h), sizeof(h)) || std::memcmp(h + 12, "IHDR", 4) != 0) {
+				throw IoException(fn, "Invalid PNG header");
+			}
+			ImageInfo info;
+			info.width = ReadBigEndian(h + 16, 4);
+			info.height = ReadBigEndian(h + 20, 4);
+			info.type = (h[24] == 16) ? ElementType::UInt16 : ElementType::UInt8;
+			switch(h[25]) {
+			case 0: info.channels = 1; break; // gray
+			case 2: info.channels = 3; break; // RGB
+			case 3: info.channels = 3; break; // palette
+			case 4: info.channels = 2; break; // gray and alpha
+			case 6: info.channels = 4; break; // RGBA
+			default: throw IoException(fn, "Invalid PNG header (color type)");
+			}
+			return info;
+		}
+
+		/** JPEG: skips marker segments until the start of frame */
+		inline
+		ImageInfo ProbeJpeg(std::istream& is, const std::string& fn)
+		{
+			is.seekg(2, std::ios::beg);
+			while(true) {
+				unsigned char m[4];
+				if(!is.read(reinterpret_cast<char*>(m), 2) || m[0] != 0xFF) {
+					throw IoException(fn, "Invalid JPEG header");
+				}
+				if(m[1] == 0xFF) {
+					// fill byte
+					is.seekg(-1, std::ios::cur);
+					continue;
+				}
+				if(m[1] == 0x01 || (m[1] >= 0xD0 && m[1] <= 0xD7)) {
+					// markers without a segment
+					continue;
+				}
+				if(!is.read(reinterpret_cast<char*>(m + 2), 2)) {
+					throw IoException(fn, "Invalid JPEG header");
+				}
+				const unsigned length = ReadBigEndian(m + 2, 2);
+				if(length < 2) {
+					throw IoException(fn, "Invalid JPEG header");
+				}
+				// SOF0 to SOF15 except DHT (C4), JPG (C8) and DAC (CC)
+				if(m[1] >= 0xC0 && m[1] <= 0xCF && m[1] != 0xC4 && m[1] != 0xC8 && m[1] != 0xCC) {
+					unsigned char f[6];
+					if(!is.read(reinterpret_cast<char*>(f), sizeof(f))) {
+						throw IoException(fn, "Invalid JPEG header");
+					}
+					ImageInfo info;
+					info.type = (f[0] > 8) ? ElementType::UInt16 : ElementType::UInt8;
+					info.height = ReadBigEndian(f + 1, 2);
+					info.width = ReadBigEndian(f + 3, 2);
+					info.channels = f[5];
+					return info;
+				}
+				is.seekg(length - 2, std::ios::cur);
+			}
+		}
+
+		/** BMP: the DIB header follows the 14 byte file header */
+		inline
+		ImageInfo ProbeBmp(std::istream& is, const std::string& fn)
+		{
+			unsigned char h[30];
+			is.seekg(0, std::ios::beg);
+			if(!is.read(reinterpret_cast<char*>(h), sizeof(h))) {
+				throw IoException(fn, "Invalid BMP header");
+			}
+			ImageInfo info;
+			unsigned bits;
+			if(ReadLittleEndian(h + 14, 4) == 12) {
+				// OS/2 header with 16 bit sizes
+				info.width = ReadLittleEndian(h + 18, 2);
+				info.height = ReadLittleEndian(h + 20, 2);
+				bits = ReadLittleEndian(h + 24, 2);
+			}
+			else {
+				// negative heights are used for top-down images
+				info.width = ReadLittleEndian(h + 18, 4);
+				info.height = static_cast<unsigned>(std::abs(static_cast<int32_t>(ReadLittleEndian(h + 22, 4))));
+				bits = ReadLittleEndian(h + 28, 2);
+			}
+			info.type = ElementType::UInt8;
+			info.channels = (bits == 32) ? 4 : 3; // images with a palette are loaded as color images
+			return info;
+		}
+
+		inline
+		ImageInfo ProbeRaw(std::istream& is, const std::string& fn)
+		{
+			const RawHeader h = ReadRawHeader(is, fn);
+			return ImageInfo{h.width, h.height, h.channels, static_cast<ElementType>(h.element_type)};
+		}
+
+		inline
+		ImageInfo ProbeDepth(std::istream& is, const std::string& fn)
+		{
+			DepthCodecHeader h;
+			is.seekg(0, std::ios::beg);
+			if(!is.read(reinterpret_cast<char*>(&h), sizeof(h)) || !IsLittleEndian()) {
+				throw IoException(fn, "Not a compressed depth image");
+			}
+			return ImageInfo{h.width, h.height, 1, ElementType::UInt16};
+		}
+	}
+
+	/** Reads size and pixel type of an image without decoding the pixels
+	 * The format is detected from the first bytes of the file. Throws an IoException if
+	 * the format is not supported or the header is invalid.
+	 */
+	inline
+	ImageInfo Probe(const std::string& fn)
+	{
+		std::ifstream ifs(fn, std::ios::binary);
+		if(!ifs.is_open()) {
+			throw IoException(fn, "Could not open file");
+		}
+		char magic[8] = {};
+		ifs.read(magic, sizeof(magic));
+		ifs.clear();
+		if(magic[0] == 'P' && (magic[1] == '2' || magic[1] == '3' || magic[1] == '5' || magic[1] == '6')) {
+			return detail::ProbeNetpbm(ifs, fn, magic[1]);
+		}
+		if(std::memcmp(magic, "SLIMAGE", 8) == 0) {
+			return detail::ProbeRaw(ifs, fn);
+		}
+		if(std::memcmp(magic, "SLDEPTH", 8) == 0) {
+			return detail::ProbeDepth(ifs, fn);
+		}
+		if(std::memcmp(magic, "\x89PNG\r\n\x1a\n", 8) == 0) {
+			return detail::ProbePng(ifs, fn);
+		}
+		if(static_cast<unsigned char>(magic[0]) == 0xFF && static_cast<unsigned char>(magic[1]) == 0xD8) {
+			return detail::ProbeJpeg(ifs, fn);
+		}
+		if(magic[0] == 'B' && magic[1] == 'M') {
+			return detail::ProbeBmp(ifs, fn);
+		}
+#if defined SLIMAGE_QT_INC
+		QImageReader reader(QString::fromStdString(fn));
+		const QSize size = reader.size();
+		if(size.isValid()) {
+			const bool gray = (reader.imageFormat() == QImage::Format_Indexed8 || reader.imageFormat() == QImage::Format_Mono);
+			const bool alpha = (reader.imageFormat() == QImage::Format_ARGB32);
+			return ImageInfo{static_cast<unsigned>(size.width()), static_cast<unsigned>(size.height()),
+				gray ? 1u : (alpha ? 4u : 3u), ElementType::UInt8};
+		}
+#endif
+		throw IoException(fn, "Unsupported file format");
+	}
+
+#if defined SLIMAGE_HAS_MMAP
+
+	/** A file found by ProbeDirectory */
+	struct ProbeEntry
+	{
+		std::string filename;
+		ImageInfo info;
+	};
+
+	namespace detail
+	{
+		inline
+		void ListFiles(const std::string& dir, bool recursive, std::vector<std::string>& files)
+		{
+			DIR* d = ::opendir(dir.c_str());
+			if(d == nullptr) {
+				throw IoException(dir, "Could not open directory");
+			}
+			const std::string prefix = (!dir.empty() && dir.back() == '/') ? dir : dir + "/";
+			std::vector<std::string> subdirs;
+			while(dirent* e = ::readdir(d)) {
+				if(std::strcmp(e->d_name, ".") == 0 || std::strcmp(e->d_name, "..") == 0) {
+					continue;
+				}
+				const std::string fn = prefix + e->d_name;
+				unsigned char type = e->d_type;
+				if(type == DT_UNKNOWN || type == DT_LNK) {
+					// not all file systems report the type
+					struct stat st;
+					if(::stat(fn.c_str(), &st) != 0) {
+						continue;
+					}
+					type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+				}
+				if(type == DT_REG) {
+					files.push_back(fn);
+				}
+				else if(type == DT_DIR && recursive) {
+					subdirs.push_back(fn);
+				}
+			}
+			::closedir(d);
+			for(const std::string& s : subdirs) {
+				ListFiles(s, recursive, files);
+			}
+		}
+	}
+
+	/** Probes all files in a directory in parallel
+	 * Files which are not images of a supported format or can not be read are skipped. The result is sorted by filename.
+	 */
+	inline
+	std::vector<ProbeEntry> ProbeDirectory(const ParallelPolicy& policy, const std::string& dir, bool recursive=false)
+	{
+		std::vector<std::string> files;
+		detail::ListFiles(dir, recursive, files);
+		std::sort(files.begin(), files.end());
+		std::vector<ImageInfo> infos(files.size());
+		std::vector<char> valid(files.size(), 0);
+		policy.threads().run(files.size(), [&files,&infos,&valid](size_t i) {
+			try {
+				infos[i] = Probe(files[i]);
+				valid[i] = 1;
+			}
+			catch(const std::exception&) {
+				// unreadable or malformed files are skipped, e.g. std::bad_alloc for a bogus header
+			}
+		});
+		std::vector<ProbeEntry> result;
+		for(size_t i=0; i<files.size(); i++) {
+			if(valid[i]) {
+				result.push_back(ProbeEntry{std::move(files[i]), infos[i]});
+			}
+		}
+		return result;
+	}
+
+	inline
+	std::vector<ProbeEntry> ProbeDirectory(const std::string& dir, bool recursive=false)
+	{ return ProbeDirectory(par, dir, recursive); }
+
+#endif
+
+}
@@ -4,14 +4,19 @@
 #include <slimage/error.hpp>
 #include <slimage/algorithm.hpp>
 #include <QtGui/QImage>
+#ifdef SLIMAGE_IO_INC_WITHOUT_BACKEND
+#  error Include slimage/qt.hpp BEFORE slimage/io.hpp and headers which include it (saver.hpp, sequence.hpp)
+#endif
 #define SLIMAGE_QT_INC
 #include <algorithm>
+#include <string>
+#include <utility>
 
 namespace slimage
 {
 
 	inline
-	QImage ConvertToQt(const Image1ub& mask)
+	QImage ConvertToQt(const ImageView<const unsigned char,1>& mask)
 	{
 		unsigned int h = mask.height();
 		unsigned int w = mask.width();
@@ -30,7 +35,7 @@ namespace slimage
 	}
 
 	inline
-	QImage ConvertToQt(const Image3ub& img)
+	QImage ConvertToQt(const ImageView<const unsigned char,3>& img)
 	{
 		unsigned int h = img.height();
 		unsigned int w = img.width();
@@ -44,7 +49,7 @@ namespace slimage
 	}
 
 	inline
-	QImage ConvertToQt(const Image4ub& img)
+	QImage ConvertToQt(const ImageView<const unsigned char,4>& img)
 	{
 		unsigned int h = img.height();
 		unsigned int w = img.width();
@@ -57,22 +62,43 @@ namespace slimage
 		return imgQt;
 	}
 
+	inline
+	QImage ConvertToQt(const Image1ub& img)
+	{ return ConvertToQt(img.view()); }
+
+	inline
+	QImage ConvertToQt(const Image3ub& img)
+	{ return ConvertToQt(img.view()); }
+
+	inline
+	QImage ConvertToQt(const Image4ub& img)
+	{ return ConvertToQt(img.view()); }
 
 	inline
 	QImage ConvertToQt(const AnonymousImage& aimg)
 	{
 		if(anonymous_is<unsigned char,1>(aimg)) {
-			return ConvertToQt(anonymous_cast<unsigned char, 1>(aimg));
+			return ConvertToQt(anonymous_view<unsigned char, 1>(aimg));
 		}
 		if(anonymous_is<unsigned char, 3>(aimg)) {
-			return ConvertToQt(anonymous_cast<unsigned char, 3>(aimg));
+			return ConvertToQt(anonymous_view<unsigned char, 3>(aimg));
 		}
 		if(anonymous_is<unsigned char, 4>(aimg)) {
-			return ConvertToQt(anonymous_cast<unsigned char, 4>(aimg));
+			return ConvertToQt(anonymous_view<unsigned char, 4>(aimg));
 		}
 		throw ConversionException("Invalid type of AnonymousImage for ConvertToQt");
 	}
 
+	/** Creates a view onto the pixels of an 8-bit indexed QImage without copying */
+	inline
+	ImageView1ub ViewQt(QImage& qimg)
+	{
+		if(qimg.format() != QImage::Format_Indexed8) {
+			throw ConversionException("Invalid type of QImage for ViewQt");
+		}
+		return ImageView1ub(qimg.bits(), qimg.width(), qimg.height(), qimg.bytesPerLine());
+	}
+
 	inline
 	AnonymousImage ConvertToSlimage(const QImage& qimg)
 	{
@@ -86,7 +112,7 @@ namespace slimage
 				unsigned char* dst = img.pixel_pointer(0, i);
 				std::copy(src, src+w, dst);
 			}
-			return make_anonymous(img);
+			return make_anonymous(std::move(img));
 		}
 		if(qimg.format() == QImage::Format_RGB32) {
 			unsigned int h = qimg.height();
@@ -97,7 +123,7 @@ namespace slimage
 				unsigned char* dst = img.pixel_pointer(0, i);
 				Copy_RGBA_to_BGR(src, src + 4*w, dst);
 			}
-			return make_anonymous(img);
+			return make_anonymous(std::move(img));
 		}
 		if(qimg.format() == QImage::Format_ARGB32) {
 			unsigned int h = qimg.height();
@@ -108,7 +134,7 @@ namespace slimage
 				unsigned char* dst = img.pixel_pointer(0, i);
 				Copy_RGBA_to_BGRA(src, src + 4*w, dst);
 			}
-			return make_anonymous(img);
+			return make_anonymous(std::move(img));
 		}
 		throw new ConversionException("Invalid type of QImage for ConvertToSlimage(QImage)");
 	}
@@ -121,4 +147,95 @@ namespace slimage
 	AnonymousImage QtLoad(const std::string& filename)
 	{ return ConvertToSlimage(QImage(QString::fromStdString(filename))); }
 
+	namespace detail
+	{
+		/** Loads an image with Qt and converts it to the given format if necessary */
+		inline
+		QImage QtLoadFormat(const std::string& filename, QImage::Format format)
+		{
+			QImage qimg(QString::fromStdString(filename));
+			if(qimg.isNull()) {
+				throw IoException(filename, "Could not load image");
+			}
+			if(qimg.format() != format) {
+				qimg = qimg.convertToFormat(format);
+			}
+			return qimg;
+		}
+
+		template<typename K, unsigned CC>
+		void QtReuse(Image<K,CC>& img, const QImage& qimg)
+		{
+			if(img.width() != static_cast<unsigned>(qimg.width()) || img.height() != static_cast<unsigned>(qimg.height())) {
+				img.resize(qimg.width(), qimg.height());
+			}
+		}
+	}
+
+	/** Loads an image with Qt into 'img' which is only reallocated if its size differs
+	 * Colour images are converted to grey levels with qGray.
+	 */
+	inline
+	void QtLoadInto(const std::string& filename, Image1ub& img)
+	{
+		QImage qimg(QString::fromStdString(filename));
+		if(qimg.isNull()) {
+			throw IoException(filename, "Could not load image");
+		}
+		detail::QtReuse(img, qimg);
+		if(qimg.format() == QImage::Format_Indexed8) {
+			// pixels are indices into the colour table, not grey levels
+			const QVector<QRgb> colors = qimg.colorTable();
+			unsigned char gray[256] = {};
+			for(int i=0; i<colors.size() && i<256; i++) {
+				gray[i] = static_cast<unsigned char>(qGray(colors[i]));
+			}
+			for(unsigned int i=0; i<img.height(); i++) {
+				const unsigned char* src = qimg.scanLine(i);
+				unsigned char* dst = img.pixel_pointer(0, i);
+				for(unsigned int j=0; j<img.width(); j++) {
+					dst[j] = gray[src[j]];
+				}
+			}
+			return;
+		}
+		if(qimg.format() != QImage::Format_RGB32) {
+			qimg = qimg.convertToFormat(QImage::Format_RGB32);
+		}
+		for(unsigned int i=0; i<img.height(); i++) {
+			const QRgb* src = reinterpret_cast<const QRgb*>(qimg.scanLine(i));
+			unsigned char* dst = img.pixel_pointer(0, i);
+			for(unsigned int j=0; j<img.width(); j++) {
+				dst[j] = static_cast<unsigned char>(qGray(src[j]));
+			}
+		}
+	}
+
+	inline
+	void QtLoadInto(const std::string& filename, Image3ub& img)
+	{
+		const QImage qimg = detail::QtLoadFormat(filename, QImage::Format_RGB32);
+		detail::QtReuse(img, qimg);
+		for(unsigned int i=0; i<img.height(); i++) {
+			const unsigned char* src = qimg.scanLine(i);
+			Copy_RGBA_to_BGR(src, src + 4*img.width(), img.pixel_pointer(0, i));
+		}
+	}
+
+	inline
+	void QtLoadInto(const std::string& filename, Image4ub& img)
+	{
+		const QImage qimg = detail::QtLoadFormat(filename, QImage::Format_ARGB32);
+		detail::QtReuse(img, qimg);
+		for(unsigned int i=0; i<img.height(); i++) {
+			const unsigned char* src = qimg.scanLine(i);
+			Copy_RGBA_to_BGRA(src, src + 4*img.width(), img.pixel_pointer(0, i));
+		}
+	}
+
+	/** Qt only supports images with 1, 3 or 4 channels of unsigned char */
+	template<typename K, unsigned CC>
+	void QtLoadInto(const std::string& filename, Image<K,CC>&)
+	{ throw IoException(filename, "Image type is not supported by Qt"); }
+
 }
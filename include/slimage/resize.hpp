@@ -0,0 +1,379 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/filter.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+
+namespace slimage
+{
+
+	/** How Resize computes destination pixels */
+	enum class Interpolation
+	{
+		/** The source pixel closest to the pixel center */
+		Nearest,
+		/** Weighted mean of the four closest source pixels */
+		Bilinear,
+		/** Mean of the source pixels covered by the destination pixel weighted by the covered area */
+		Area
+	};
+
+	namespace detail
+	{
+		/** Source indices and weights for every destination index along one axis
+		 * Every destination index uses the same number of taps; unused taps have weight 0.
+		 */
+		struct ResizeTable
+		{
+			ResizeTable(unsigned src, unsigned dst, Interpolation mode)
+			:	taps(1)
+			{
+				const double scale = static_cast<double>(src) / static_cast<double>(dst);
+				std::vector<std::vector<std::pair<unsigned,float>>> entries(dst);
+				for(unsigned d=0; d<dst; d++) {
+					auto& e = entries[d];
+					if(mode == Interpolation::Nearest) {
+						const unsigned i = static_cast<unsigned>((d + 0.5)*scale);
+						e.emplace_back(std::min(i, src - 1), 1.0f);
+					}
+					else if(mode == Interpolation::Bilinear) {
+						// pixel centers are at i + 0.5
+						const double x = std::min(static_cast<double>(src - 1), std::max(0.0, (d + 0.5)*scale - 0.5));
+						const unsigned i = std::min(static_cast<unsigned>(x), src - 1);
+						const float a = static_cast<float>(x - i);
+						e.emplace_back(i, 1.0f - a);
+						e.emplace_back(std::min(i + 1, src - 1), a);
+					}
+					else {
+						const double x0 = d*scale;
+						const double x1 = std::min(static_cast<double>(src), (d + 1)*scale);
+						for(unsigned i=static_cast<unsigned>(x0); i<src && i<x1; i++) {
+							const double overlap = std::min(x1, i + 1.0) - std::max(x0, static_cast<double>(i));
+							if(overlap > 0.0) {
+								e.emplace_back(i, static_cast<float>(overlap / (x1 - x0)));
+							}
+						}
+					}
+					taps = std::max<unsigned>(taps, e.size());
+				}
+				index.resize(dst*taps);
+				weight.resize(dst*taps, 0.0f);
+				for(unsigned d=0; d<dst; d++) {
+					const auto& e = entries[d];
+					for(unsigned k=0; k<taps; k++) {
+						// unused taps point to the last used one to keep source rows consecutive
+						index[d*taps + k] = e[std::min<size_t>(k, e.size() - 1)].first;
+						if(k < e.size()) {
+							weight[d*taps + k] = e[k].second;
+						}
+					}
+				}
+			}
+
+			unsigned taps;
+			std::vector<unsigned> index;
+			std::vector<float> weight;
+		};
+
+		/** Resizes bands of destination lines; resampled source lines are kept in a ring buffer */
+		template<typename K, unsigned CC>
+		class ResizeBand
+		{
+		public:
+			ResizeBand(const ImageView<const K,CC>& src, const ImageView<K,CC>& dst, const ResizeTable& tx, const ResizeTable& ty)
+			:	src_(src), dst_(dst), tx_(tx), ty_(ty),
+				n_(static_cast<size_t>(dst.width())*CC),
+				ring_(ty.taps*n_),
+				tags_(ty.taps, std::numeric_limits<unsigned>::max()),
+				acc_(n_)
+			{}
+
+			void operator()(unsigned y0, unsigned y1)
+			{
+				const unsigned taps = ty_.taps;
+				for(unsigned y=y0; y<y1; y++) {
+					std::fill(acc_.begin(), acc_.end(), 0.0f);
+					for(unsigned k=0; k<taps; k++) {
+						const float w = ty_.weight[y*taps + k];
+						if(w != 0.0f) {
+							MulAdd(w, line(ty_.index[y*taps + k]), acc_.data(), n_);
+						}
+					}
+					K* out = dst_.pixel_pointer(0,y);
+					for(size_t i=0; i<n_; i++) {
+						out[i] = FromFloat<K>(acc_[i]);
+					}
+				}
+			}
+
+		private:
+			/** Source line 'sy' resampled to the destination width */
+			const float* line(unsigned sy)
+			{
+				const unsigned slot = sy % ty_.taps;
+				float* h = ring_.data() + slot*n_;
+				if(tags_[slot] == sy) {
+					return h;
+				}
+				tags_[slot] = sy;
+				const K* s = src_.pixel_pointer(0,sy);
+				const unsigned taps = tx_.taps;
+				for(unsigned x=0; x<dst_.width(); x++) {
+					float v[CC] = {};
+					for(unsigned k=0; k<taps; k++) {
+						const float w = tx_.weight[x*taps + k];
+						const K* p = s + static_cast<size_t>(tx_.index[x*taps + k])*CC;
+						for(unsigned c=0; c<CC; c++) {
+							v[c] += w*static_cast<float>(p[c]);
+						}
+					}
+					for(unsigned c=0; c<CC; c++) {
+						h[x*CC + c] = v[c];
+					}
+				}
+				return h;
+			}
+
+			ImageView<const K,CC> src_;
+			ImageView<K,CC> dst_;
+			const ResizeTable& tx_;
+			const ResizeTable& ty_;
+			size_t n_; // elements per destination line
+			std::vector<float> ring_; // ty.taps resampled source lines
+			std::vector<unsigned> tags_; // source line stored in each slot of the ring
+			std::vector<float> acc_;
+		};
+
+		template<typename K, unsigned CC>
+		void ResizeNearestRows(const ImageView<const K,CC>& src, const ImageView<K,CC>& dst,
+			const ResizeTable& tx, const ResizeTable& ty, unsigned y0, unsigned y1)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				const K* s = src.pixel_pointer(0, ty.index[y]);
+				K* d = dst.pixel_pointer(0,y);
+				for(unsigned x=0; x<dst.width(); x++) {
+					std::copy(s + static_cast<size_t>(tx.index[x])*CC, s + static_cast<size_t>(tx.index[x] + 1)*CC, d + x*CC);
+				}
+			}
+		}
+
+		template<typename K, unsigned CC>
+		void CheckResize(const ImageView<const K,CC>& src, const ImageView<K,CC>& dst)
+		{
+			if((src.width() == 0 || src.height() == 0) && (dst.width() != 0 && dst.height() != 0)) {
+				throw ConversionException("Resize: can not resize an empty image");
+			}
+			// empty images have a null pixel pointer
+			assert((src.pixel_pointer() == nullptr
+				|| static_cast<const void*>(src.pixel_pointer()) != static_cast<const void*>(dst.pixel_pointer()))
+				&& "Resize can not resize in place");
+		}
+	}
+
+	/** Resizes 'src' to the size of 'dst'
+	 * Source and destination pixel centers are aligned, i.e. the image borders coincide.
+	 * Weights are computed once per column and line.
+	 */
+	template<typename K, unsigned CC>
+	void Resize(const ImageView<K,CC>& src, const ImageView<typename std::remove_const<K>::type,CC>& dst,
+		Interpolation mode=Interpolation::Bilinear)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		const ImageView<const base_t,CC> csrc = src;
+		detail::CheckResize(csrc, dst);
+		if(dst.width() == 0 || dst.height() == 0) {
+			return;
+		}
+		const detail::ResizeTable tx(src.width(), dst.width(), mode);
+		const detail::ResizeTable ty(src.height(), dst.height(), mode);
+		if(mode == Interpolation::Nearest) {
+			detail::ResizeNearestRows(csrc, dst, tx, ty, 0, dst.height());
+		}
+		else {
+			detail::ResizeBand<base_t,CC> band(csrc, dst, tx, ty);
+			band(0, dst.height());
+		}
+	}
+
+	/** Resize with bands of destination lines computed in parallel */
+	template<typename K, unsigned CC>
+	void Resize(const ParallelPolicy& policy, const ImageView<K,CC>& src, const ImageView<typename std::remove_const<K>::type,CC>& dst,
+		Interpolation mode=Interpolation::Bilinear)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		const ImageView<const base_t,CC> csrc = src;
+		detail::CheckResize(csrc, dst);
+		if(dst.width() == 0 || dst.height() == 0) {
+			return;
+		}
+		const detail::ResizeTable tx(src.width(), dst.width(), mode);
+		const detail::ResizeTable ty(src.height(), dst.height(), mode);
+		ParallelRows(policy, dst.height(), [&](unsigned y0, unsigned y1) {
+			if(mode == Interpolation::Nearest) {
+				detail::ResizeNearestRows(csrc, dst, tx, ty, y0, y1);
+			}
+			else {
+				detail::ResizeBand<base_t,CC> band(csrc, dst, tx, ty);
+				band(y0, y1);
+			}
+		});
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> Resize(const Image<K,CC>& src, unsigned width, unsigned height, Interpolation mode=Interpolation::Bilinear)
+	{
+		Image<K,CC> dst(width, height);
+		Resize(src.view(), dst.view(), mode);
+		return dst;
+	}
+
+	template<typename K, unsigned CC>
+	Image<K,CC> Resize(const ParallelPolicy& policy, const Image<K,CC>& src, unsigned width, unsigned height, Interpolation mode=Interpolation::Bilinear)
+	{
+		Image<K,CC> dst(width, height);
+		Resize(policy, src.view(), dst.view(), mode);
+		return dst;
+	}
+
+	namespace detail
+	{
+		template<typename K>
+		typename std::enable_if<std::is_integral<K>::value, K>::type Average4(K a, K b, K c, K d)
+		{ return static_cast<K>((static_cast<int64_t>(a) + b + c + d + 2) >> 2); }
+
+		template<typename K>
+		typename std::enable_if<!std::is_integral<K>::value, K>::type Average4(K a, K b, K c, K d)
+		{ return static_cast<K>(0.25f*((a + b) + (c + d))); }
+	}
+
+	/** An image and successively halved copies of it for coarse-to-fine algorithms
+	 * Level i+1 has size ((w+1)/2, (h+1)/2) and is the mean of 2x2 pixels of level i
+	 * where the last line and column are repeated for odd sizes. All levels are built in
+	 * one pass over the base image: a line of the next level is computed as soon as the
+	 * two lines it depends on are done.
+	 */
+	template<typename K, unsigned CC>
+	class Pyramid
+	{
+	public:
+		Pyramid()
+		{}
+
+		/** Builds at most 'levels' levels including the base image; stops after the first level of size 1x1 */
+		Pyramid(const ImageView<const K,CC>& base, unsigned levels)
+		{ build(base, levels); }
+
+		Pyramid(const ParallelPolicy& policy, const ImageView<const K,CC>& base, unsigned levels)
+		{ build(policy, base, levels); }
+
+		Pyramid(const Image<K,CC>& base, unsigned levels)
+		{ build(base.view(), levels); }
+
+		Pyramid(const ParallelPolicy& policy, const Image<K,CC>& base, unsigned levels)
+		{ build(policy, base.view(), levels); }
+
+		/** Number of levels */
+		unsigned size() const
+		{ return levels_.size(); }
+
+		/** Level i where level 0 is the base image */
+		const Image<K,CC>& operator[](unsigned i) const
+		{ return levels_[i]; }
+
+		Image<K,CC>& operator[](unsigned i)
+		{ return levels_[i]; }
+
+		/** Rebuilds the pyramid for a new base image and reuses the memory of the levels */
+		void build(const ImageView<const K,CC>& base, unsigned levels)
+		{
+			allocate(base, levels);
+			buildBand(base, 0, base.height());
+		}
+
+		/** Builds bands of base lines with all their coarser lines in parallel */
+		void build(const ParallelPolicy& policy, const ImageView<const K,CC>& base, unsigned levels)
+		{
+			allocate(base, levels);
+			// bands must start at a multiple of 2^(levels-1) base lines to be independent
+			const unsigned align = 1u << (size() - 1);
+			const unsigned blocks = (base.height() + align - 1) / align;
+			const ParallelPolicy bands(policy.threads(), std::max(1u, policy.min_band_rows / align));
+			ParallelRows(bands, blocks, [&](unsigned b0, unsigned b1) {
+				buildBand(base, b0*align, std::min(base.height(), b1*align));
+			});
+		}
+
+	private:
+		void allocate(const ImageView<const K,CC>& base, unsigned levels)
+		{
+			unsigned n = std::max(1u, levels);
+			unsigned w = base.width();
+			unsigned h = base.height();
+			for(unsigned i=1; i<n; i++) {
+				if(w <= 1 && h <= 1) {
+					n = i;
+					break;
+				}
+				w = (w + 1)/2;
+				h = (h + 1)/2;
+			}
+			levels_.resize(n);
+			w = base.width();
+			h = base.height();
+			for(unsigned i=0; i<n; i++) {
+				levels_[i].resize(w, h);
+				w = (w + 1)/2;
+				h = (h + 1)/2;
+			}
+		}
+
+		/** Copies base lines [y0,y1) and computes all lines of coarser levels which only depend on them */
+		void buildBand(const ImageView<const K,CC>& base, unsigned y0, unsigned y1)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				const K* s = base.pixel_pointer(0,y);
+				std::copy(s, s + base.numElementsScanline(), levels_[0].pixel_pointer(0,y));
+				finishLine(0, y);
+			}
+		}
+
+		/** Computes the next level line which uses line y of level i if line y was the last one it needs */
+		void finishLine(unsigned i, unsigned y)
+		{
+			if(i + 1 >= levels_.size()) {
+				return;
+			}
+			const Image<K,CC>& src = levels_[i];
+			if(y % 2 == 0 && y + 1 < src.height()) {
+				return;
+			}
+			Image<K,CC>& dst = levels_[i+1];
+			const unsigned dy = y / 2;
+			const K* a = src.pixel_pointer(0, 2*dy);
+			const K* b = src.pixel_pointer(0, std::min(2*dy + 1, src.height() - 1));
+			K* d = dst.pixel_pointer(0, dy);
+			const unsigned last = src.width() - 1;
+			for(unsigned x=0; x<dst.width(); x++) {
+				const size_t x0 = static_cast<size_t>(2*x)*CC;
+				const size_t x1 = static_cast<size_t>(std::min(2*x + 1, last))*CC;
+				for(unsigned c=0; c<CC; c++) {
+					d[x*CC + c] = detail::Average4(a[x0 + c], a[x1 + c], b[x0 + c], b[x1 + c]);
+				}
+			}
+			finishLine(i + 1, dy);
+		}
+
+		std::vector<Image<K,CC>> levels_;
+	};
+
+}
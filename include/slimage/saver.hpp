@@ -0,0 +1,204 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/io.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace slimage
+{
+
+	/** Saves images on background threads
+	 * Images are moved into the saver and encoded with Save on a pool of worker threads.
+	 * If the images waiting to be saved exceed the memory budget, save() blocks until
+	 * enough of them have been written. Errors are collected and reported by flush().
+	 */
+	class AsyncSaver
+	{
+	public:
+		struct Statistics
+		{
+			/** Number of images waiting or being saved */
+			size_t pending;
+			/** Memory used by the pending images in bytes */
+			size_t pending_bytes;
+			/** Largest memory used by pending images so far */
+			size_t max_pending_bytes;
+			/** Number of images which were saved successfully */
+			size_t saved;
+			/** Number of images which could not be saved */
+			size_t failed;
+			/** Total time save() blocked because of the memory budget in milliseconds */
+			double blocked_ms;
+		};
+
+		/** Creates a saver with 'num_threads' worker threads which keeps at most 'memory_budget' bytes of images */
+		explicit AsyncSaver(unsigned num_threads=1, size_t memory_budget=size_t(256) << 20)
+		:	budget_(memory_budget),
+			stop_(false),
+			statistics_()
+		{
+			for(unsigned i=0; i<std::max(1u, num_threads); i++) {
+				workers_.emplace_back([this]() { work(); });
+			}
+		}
+
+		AsyncSaver(const AsyncSaver&) = delete;
+		AsyncSaver& operator=(const AsyncSaver&) = delete;
+
+		/** Writes all pending images; errors are ignored, call flush() to check for them */
+		~AsyncSaver()
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				done_.wait(lock, [this]() { return statistics_.pending == 0; });
+				stop_ = true;
+			}
+			wake_.notify_all();
+			for(std::thread& t : workers_) {
+				t.join();
+			}
+		}
+
+		/** Takes ownership of 'img' and saves it to 'fn' in the background */
+		template<typename K, unsigned CC>
+		void save(const std::string& fn, Image<K,CC>&& img)
+		{
+			const size_t bytes = img.stride()*img.height();
+			auto p = std::make_shared<Image<K,CC>>(std::move(img));
+			enqueue(fn, bytes, [fn,p]() {
+				if(IsNetpbmFilename(fn) || IsRawFilename(fn) || IsDepthFilename(fn)) {
+					Save(fn, *p);
+				}
+				else {
+					// OpenCV and Qt save an anonymous image which takes over the pixels without a copy
+					Save(fn, make_anonymous(std::move(*p)));
+				}
+			});
+		}
+
+		/** Saves an anonymous image in the background; the image must not be modified until it is saved */
+		void save(const std::string& fn, AnonymousImage aimg)
+		{
+			const size_t bytes = aimg->stride()*aimg->height();
+			enqueue(fn, bytes, [fn,aimg]() { Save(fn, aimg); });
+		}
+
+		/** Waits until all images are saved
+		 * Throws an IoException listing all images which could not be saved since the last flush.
+		 */
+		void flush()
+		{
+			std::vector<std::string> errors;
+			std::string first_failed;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				done_.wait(lock, [this]() { return statistics_.pending == 0; });
+				std::swap(errors, errors_);
+				std::swap(first_failed, first_failed_);
+			}
+			if(!errors.empty()) {
+				std::string msg = std::to_string(errors.size()) + " image(s) could not be saved:";
+				for(const std::string& e : errors) {
+					msg += "\n" + e;
+				}
+				throw IoException(first_failed, msg);
+			}
+		}
+
+		Statistics statistics() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return statistics_;
+		}
+
+	private:
+		struct Job
+		{
+			std::string fn;
+			size_t bytes;
+			std::function<void()> save;
+		};
+
+		void enqueue(const std::string& fn, size_t bytes, std::function<void()> save)
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			// a single image larger than the budget is accepted if nothing else is pending
+			if(statistics_.pending_bytes > 0 && statistics_.pending_bytes + bytes > budget_) {
+				const auto t0 = std::chrono::steady_clock::now();
+				done_.wait(lock, [this,bytes]() {
+					return statistics_.pending_bytes == 0 || statistics_.pending_bytes + bytes <= budget_;
+				});
+				statistics_.blocked_ms += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - t0).count();
+			}
+			jobs_.push_back(Job{fn, bytes, std::move(save)});
+			statistics_.pending++;
+			statistics_.pending_bytes += bytes;
+			statistics_.max_pending_bytes = std::max(statistics_.max_pending_bytes, statistics_.pending_bytes);
+			lock.unlock();
+			wake_.notify_one();
+		}
+
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while(true) {
+				wake_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+				if(jobs_.empty()) {
+					return;
+				}
+				Job job = std::move(jobs_.front());
+				jobs_.pop_front();
+				lock.unlock();
+				std::string error;
+				try {
+					job.save();
+				}
+				catch(const std::exception& e) {
+					error = e.what();
+				}
+				catch(...) {
+					error = "slimage::AsyncSaver: unknown error saving '" + job.fn + "'";
+				}
+				job.save = nullptr; // releases the image
+				lock.lock();
+				if(error.empty()) {
+					statistics_.saved++;
+				}
+				else {
+					if(errors_.empty()) {
+						first_failed_ = job.fn;
+					}
+					errors_.push_back(error);
+					statistics_.failed++;
+				}
+				statistics_.pending--;
+				statistics_.pending_bytes -= job.bytes;
+				done_.notify_all();
+			}
+		}
+
+		size_t budget_;
+		bool stop_;
+		Statistics statistics_;
+		std::deque<Job> jobs_;
+		std::vector<std::string> errors_;
+		std::string first_failed_;
+		mutable std::mutex mutex_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		std::vector<std::thread> workers_;
+	};
+
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/io.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace slimage
+{
+
+	/** Creates the filenames for the frames first to last (inclusive)
+	 * 'pattern' contains one printf conversion for an integer, e.g. "/data/depth_%05d.pgm".
+	 */
+	inline
+	std::vector<std::string> SequenceFilenames(const std::string& pattern, int first, int last)
+	{
+		std::vector<std::string> filenames;
+		for(int i=first; i<=last; i++) {
+			const int n = std::snprintf(nullptr, 0, pattern.c_str(), i);
+			if(n < 0) {
+				throw IoException(pattern, "Invalid filename pattern");
+			}
+			std::vector<char> buffer(n + 1);
+			std::snprintf(buffer.data(), buffer.size(), pattern.c_str(), i);
+			filenames.emplace_back(buffer.data());
+		}
+		return filenames;
+	}
+
+	/** Loads a sequence of images on background threads and returns them in order
+	 * At most 'queue_size' decoded frames wait in memory for the consumer. Errors are
+	 * reported by next() for the frame which could not be loaded.
+	 */
+	template<typename K, unsigned CC>
+	class SequenceLoader
+	{
+	public:
+		using load_function_t = std::function<Image<K,CC>(const std::string&)>;
+
+		struct Statistics
+		{
+			/** Number of frames returned by next */
+			size_t frames;
+			/** Number of decoded frames waiting in the queue */
+			size_t queued;
+			/** Largest number of frames waiting in the queue so far */
+			size_t max_queued;
+			/** Total and largest decode time of a frame in milliseconds */
+			double decode_ms;
+			double max_decode_ms;
+			/** Total time next() waited for a frame in milliseconds */
+			double wait_ms;
+		};
+
+		/** Loads the given files with 'num_threads' threads using Load<K,CC> by default */
+		SequenceLoader(std::vector<std::string> filenames, unsigned num_threads=2, unsigned queue_size=8,
+			load_function_t load=&Load<K,CC>)
+		:	filenames_(std::move(filenames)),
+			load_(std::move(load)),
+			slots_(std::max(1u, queue_size)),
+			head_(0),
+			claimed_(0),
+			stop_(false),
+			statistics_()
+		{
+			for(unsigned i=0; i<std::max(1u, num_threads); i++) {
+				workers_.emplace_back([this]() { work(); });
+			}
+		}
+
+		SequenceLoader(const SequenceLoader&) = delete;
+		SequenceLoader& operator=(const SequenceLoader&) = delete;
+
+		~SequenceLoader()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop_ = true;
+			}
+			claim_.notify_all();
+			for(std::thread& t : workers_) {
+				t.join();
+			}
+		}
+
+		/** Number of frames in the sequence */
+		size_t size() const
+		{ return filenames_.size(); }
+
+		/** Index of the frame which is returned by the next call to next */
+		size_t position() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return head_;
+		}
+
+		/** Moves the next frame into 'img'; returns false after the last frame
+		 * Rethrows the exception if the frame could not be loaded.
+		 */
+		bool next(Image<K,CC>& img)
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			if(head_ == filenames_.size()) {
+				return false;
+			}
+			Slot& slot = slots_[head_ % slots_.size()];
+			const auto t0 = std::chrono::steady_clock::now();
+			ready_.wait(lock, [&slot]() { return slot.ready; });
+			statistics_.wait_ms += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - t0).count();
+			slot.ready = false;
+			statistics_.queued--;
+			head_++;
+			std::exception_ptr error = slot.error;
+			slot.error = nullptr;
+			if(!error) {
+				img = std::move(slot.img);
+				statistics_.frames++;
+			}
+			lock.unlock();
+			claim_.notify_all();
+			if(error) {
+				std::rethrow_exception(error);
+			}
+			return true;
+		}
+
+		Statistics statistics() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return statistics_;
+		}
+
+	private:
+		struct Slot
+		{
+			Slot()
+			:	ready(false)
+			{}
+
+			bool ready;
+			Image<K,CC> img;
+			std::exception_ptr error;
+		};
+
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while(true) {
+				claim_.wait(lock, [this]() {
+					return stop_ || (claimed_ < filenames_.size() && claimed_ < head_ + slots_.size());
+				});
+				if(stop_) {
+					return;
+				}
+				const size_t i = claimed_++;
+				lock.unlock();
+				Image<K,CC> img;
+				std::exception_ptr error;
+				const auto t0 = std::chrono::steady_clock::now();
+				try {
+					img = load_(filenames_[i]);
+				}
+				catch(...) {
+					error = std::current_exception();
+				}
+				const double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - t0).count();
+				lock.lock();
+				Slot& slot = slots_[i % slots_.size()];
+				slot.img = std::move(img);
+				slot.error = error;
+				slot.ready = true;
+				statistics_.queued++;
+				statistics_.max_queued = std::max(statistics_.max_queued, statistics_.queued);
+				statistics_.decode_ms += ms;
+				statistics_.max_decode_ms = std::max(statistics_.max_decode_ms, ms);
+				ready_.notify_all();
+			}
+		}
+
+		std::vector<std::string> filenames_;
+		load_function_t load_;
+		std::vector<Slot> slots_;
+		size_t head_; // next frame returned by next
+		size_t claimed_; // next frame claimed by a worker
+		bool stop_;
+		Statistics statistics_;
+		mutable std::mutex mutex_;
+		std::condition_variable claim_;
+		std::condition_variable ready_;
+		std::vector<std::thread> workers_;
+	};
+
+}
@@ -0,0 +1,507 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/mapped.hpp>
+#include <slimage/depth_codec.hpp>
+#include <slimage/error.hpp>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+// Sequence files (.sseq) store many frames of one pixel type in a single file:
+//   file header (64 bytes)
+//   frames: frame header (64 bytes) followed by the payload padded to a multiple of 64 bytes
+//   index: one entry per frame followed by a trailer; written when the writer is closed
+// Every frame header carries a checksum and is written after its payload, thus readers can
+// use all frames with a valid header even if the index is missing because the file is still
+// being written or the writer was interrupted. Payloads start at 64 byte aligned offsets.
+// All values are stored little endian.
+
+#if defined SLIMAGE_HAS_MMAP
+
+namespace slimage
+{
+
+	/** Compression of the frames in a sequence file */
+	enum class SequenceCodec : uint32_t
+	{
+		/** Pixels are stored uncompressed line by line */
+		None = 0,
+		/** Lossless depth compression, see CompressDepth; only for 1ui16 images */
+		Depth = 1
+	};
+
+	namespace detail
+	{
+		struct SequenceFileHeader
+		{
+			char magic[8]; // "SLSEQ" and terminating zeros
+			uint32_t version;
+			uint32_t element_type; // ElementType
+			uint32_t channels;
+			uint8_t padding[44];
+		};
+
+		struct SequenceFrameHeader
+		{
+			char magic[8]; // "SLFRAME" and a terminating zero
+			uint64_t size; // payload bytes without padding
+			int64_t timestamp;
+			uint32_t width;
+			uint32_t height;
+			uint32_t codec; // SequenceCodec
+			uint32_t reserved;
+			uint64_t index; // frame number
+			uint8_t padding[8];
+			uint64_t check; // SequenceChecksum of all bytes before this field
+		};
+
+		struct SequenceIndexEntry
+		{
+			uint64_t offset; // position of the frame header
+			uint64_t size;
+			int64_t timestamp;
+			uint32_t width;
+			uint32_t height;
+			uint32_t codec;
+			uint32_t reserved;
+		};
+
+		struct SequenceTrailer
+		{
+			uint64_t index_offset;
+			uint64_t count;
+			uint8_t padding[8];
+			char magic[8]; // "SLSEQIDX" without a terminating zero
+		};
+
+		static_assert(sizeof(SequenceFileHeader) == 64, "SequenceFileHeader must have a size of 64 bytes");
+		static_assert(sizeof(SequenceFrameHeader) == 64, "SequenceFrameHeader must have a size of 64 bytes");
+		static_assert(sizeof(SequenceIndexEntry) == 40, "SequenceIndexEntry must have a size of 40 bytes");
+		static_assert(sizeof(SequenceTrailer) == 32, "SequenceTrailer must have a size of 32 bytes");
+
+		constexpr uint32_t SequenceVersion = 1;
+		constexpr uint64_t SequenceAlignment = 64;
+
+		inline
+		uint64_t SequenceAlign(uint64_t n)
+		{ return (n + SequenceAlignment - 1) / SequenceAlignment * SequenceAlignment; }
+
+		/** FNV-1a hash used to detect incompletely written frame headers */
+		inline
+		uint64_t SequenceChecksum(const void* data, size_t size)
+		{
+			const uint8_t* p = static_cast<const uint8_t*>(data);
+			uint64_t h = 14695981039346656037ull;
+			for(size_t i=0; i<size; i++) {
+				h = (h ^ p[i]) * 1099511628211ull;
+			}
+			return h;
+		}
+
+		inline
+		bool IsValidFrameHeader(const SequenceFrameHeader& h, uint64_t index)
+		{
+			return std::memcmp(h.magic, "SLFRAME", 8) == 0
+				&& h.index == index
+				&& h.check == SequenceChecksum(&h, offsetof(SequenceFrameHeader, check));
+		}
+
+		/** Writes 'size' bytes at 'offset' */
+		inline
+		void SequencePWrite(int fd, const void* data, size_t size, uint64_t offset, const std::string& fn)
+		{
+			const char* p = static_cast<const char*>(data);
+			while(size > 0) {
+				const ssize_t n = ::pwrite(fd, p, size, offset);
+				if(n <= 0) {
+					throw IoException(fn, "Could not write file");
+				}
+				p += n;
+				size -= n;
+				offset += n;
+			}
+		}
+
+		/** Reads up to 'size' bytes at 'offset' and returns the number of bytes read */
+		inline
+		size_t SequencePRead(int fd, void* data, size_t size, uint64_t offset, const std::string& fn)
+		{
+			char* p = static_cast<char*>(data);
+			size_t total = 0;
+			while(total < size) {
+				const ssize_t n = ::pread(fd, p + total, size - total, offset + total);
+				if(n < 0) {
+					throw IoException(fn, "Could not read file");
+				}
+				if(n == 0) {
+					break;
+				}
+				total += n;
+			}
+			return total;
+		}
+
+		inline
+		void SequenceCompress(const ImageView<const uint16_t,1>& img, std::vector<uint8_t>& data)
+		{ data = CompressDepth(par, img); }
+
+		template<typename K, unsigned CC>
+		void SequenceCompress(const ImageView<const K,CC>&, std::vector<uint8_t>&)
+		{ throw ConversionException("Depth compression is only supported for 1ui16 images"); }
+
+		inline
+		void SequenceDecompress(const uint8_t* data, size_t size, Image<uint16_t,1>& img)
+		{ DecompressDepthInto(par, data, size, img); }
+
+		template<typename K, unsigned CC>
+		void SequenceDecompress(const uint8_t*, size_t, Image<K,CC>&)
+		{ throw ConversionException("Depth compression is only supported for 1ui16 images"); }
+	}
+
+	/** True if the filename has the extension .sseq used for sequence files */
+	inline
+	bool IsSequenceFilename(const std::string& fn)
+	{ return fn.size() >= 5 && fn.compare(fn.size() - 5, 5, ".sseq") == 0; }
+
+	/** Appends frames to a new sequence file
+	 * Frames are committed when append returns and can be read by a SequenceReader at that
+	 * point, also from other threads or processes. close() writes the index for fast opening.
+	 */
+	template<typename K, unsigned CC>
+	class SequenceWriter
+	{
+	public:
+		/** Creates the file; frames are compressed with 'codec' */
+		explicit SequenceWriter(const std::string& fn, SequenceCodec codec=SequenceCodec::None)
+		:	fn_(fn),
+			codec_(codec),
+			fd_(-1),
+			end_(sizeof(detail::SequenceFileHeader))
+		{
+			if(ElementTypeOf<K>::value == ElementType::Unknown || !detail::IsLittleEndian()) {
+				throw IoException(fn, "Sequence files need a known element type and a little endian machine");
+			}
+			if(codec == SequenceCodec::Depth && !(std::is_same<K,uint16_t>::value && CC == 1)) {
+				throw IoException(fn, "Depth compression is only supported for 1ui16 images");
+			}
+			fd_ = ::open(fn.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if(fd_ < 0) {
+				throw IoException(fn, "Could not open file");
+			}
+			detail::SequenceFileHeader h;
+			std::memset(&h, 0, sizeof(h));
+			std::memcpy(h.magic, "SLSEQ\0\0", 8);
+			h.version = detail::SequenceVersion;
+			h.element_type = static_cast<uint32_t>(ElementTypeOf<K>::value);
+			h.channels = CC;
+			try {
+				detail::SequencePWrite(fd_, &h, sizeof(h), 0, fn_);
+			}
+			catch(...) {
+				::close(fd_);
+				throw;
+			}
+		}
+
+		SequenceWriter(const SequenceWriter&) = delete;
+		SequenceWriter& operator=(const SequenceWriter&) = delete;
+
+		/** Closes the file without reporting errors; call close() to check for errors */
+		~SequenceWriter()
+		{
+			try {
+				close();
+			}
+			catch(...) {
+			}
+		}
+
+		/** Number of frames appended so far */
+		size_t size() const
+		{ return index_.size(); }
+
+		/** Appends a frame with a user defined timestamp and returns its frame number */
+		size_t append(const ImageView<const K,CC>& img, int64_t timestamp=0)
+		{
+			if(fd_ < 0) {
+				throw IoException(fn_, "Sequence file is closed");
+			}
+			const uint64_t offset = end_;
+			const uint64_t payload = offset + sizeof(detail::SequenceFrameHeader);
+			uint64_t size;
+			if(codec_ == SequenceCodec::Depth) {
+				detail::SequenceCompress(img, buffer_);
+				size = buffer_.size();
+				detail::SequencePWrite(fd_, buffer_.data(), buffer_.size(), payload, fn_);
+			}
+			else {
+				const size_t line = img.numElementsScanline()*sizeof(K);
+				size = static_cast<uint64_t>(line)*img.height();
+				if(img.isContiguous()) {
+					detail::SequencePWrite(fd_, img.pixel_pointer(), size, payload, fn_);
+				}
+				else {
+					for(unsigned y=0; y<img.height(); y++) {
+						detail::SequencePWrite(fd_, img.pixel_pointer(0,y), line, payload + line*y, fn_);
+					}
+				}
+			}
+			// the header is written last and commits the frame for concurrent readers
+			const uint64_t padded = detail::SequenceAlign(size);
+			if(padded != size) {
+				const uint8_t zeros[detail::SequenceAlignment] = {};
+				detail::SequencePWrite(fd_, zeros, padded - size, payload + size, fn_);
+			}
+			detail::SequenceFrameHeader h;
+			std::memset(&h, 0, sizeof(h));
+			std::memcpy(h.magic, "SLFRAME", 8);
+			h.size = size;
+			h.timestamp = timestamp;
+			h.width = img.width();
+			h.height = img.height();
+			h.codec = static_cast<uint32_t>(codec_);
+			h.index = index_.size();
+			h.check = detail::SequenceChecksum(&h, offsetof(detail::SequenceFrameHeader, check));
+			detail::SequencePWrite(fd_, &h, sizeof(h), offset, fn_);
+			index_.push_back(detail::SequenceIndexEntry{offset, size, timestamp, h.width, h.height, h.codec, 0});
+			end_ = payload + padded;
+			return index_.size() - 1;
+		}
+
+		size_t append(const ImageView<K,CC>& img, int64_t timestamp=0)
+		{ return append(ImageView<const K,CC>(img), timestamp); }
+
+		size_t append(const Image<K,CC>& img, int64_t timestamp=0)
+		{ return append(img.view(), timestamp); }
+
+		/** Writes the index and closes the file; no frames can be appended afterwards */
+		void close()
+		{
+			if(fd_ < 0) {
+				return;
+			}
+			const int fd = fd_;
+			fd_ = -1;
+			try {
+				detail::SequenceTrailer t;
+				std::memset(&t, 0, sizeof(t));
+				t.index_offset = end_;
+				t.count = index_.size();
+				std::memcpy(t.magic, "SLSEQIDX", 8);
+				const size_t bytes = sizeof(detail::SequenceIndexEntry)*index_.size();
+				detail::SequencePWrite(fd, index_.data(), bytes, end_, fn_);
+				detail::SequencePWrite(fd, &t, sizeof(t), end_ + bytes, fn_);
+			}
+			catch(...) {
+				::close(fd);
+				throw;
+			}
+			if(::close(fd) != 0) {
+				throw IoException(fn_, "Could not write file");
+			}
+		}
+
+	private:
+		std::string fn_;
+		SequenceCodec codec_;
+		int fd_;
+		uint64_t end_; // position of the next frame header
+		std::vector<detail::SequenceIndexEntry> index_;
+		std::vector<uint8_t> buffer_;
+	};
+
+	/** Random access to the frames of a sequence file
+	 * All methods can be called concurrently from several threads. Frames of a file which
+	 * is still being written are found by refresh().
+	 */
+	template<typename K, unsigned CC>
+	class SequenceReader
+	{
+	public:
+		explicit SequenceReader(const std::string& fn)
+		:	fn_(fn),
+			fd_(::open(fn.c_str(), O_RDONLY)),
+			end_(sizeof(detail::SequenceFileHeader)),
+			indexed_(false)
+		{
+			if(fd_ < 0) {
+				throw IoException(fn, "Could not open file");
+			}
+			try {
+				open();
+			}
+			catch(...) {
+				::close(fd_);
+				throw;
+			}
+		}
+
+		SequenceReader(const SequenceReader&) = delete;
+		SequenceReader& operator=(const SequenceReader&) = delete;
+
+		~SequenceReader()
+		{ ::close(fd_); }
+
+		/** Number of frames found so far */
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return index_.size();
+		}
+
+		/** Looks for frames appended since the last call and returns the new number of frames */
+		size_t refresh()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(!indexed_) {
+				scan();
+			}
+			return index_.size();
+		}
+
+		/** Timestamp of frame 'i' as given to SequenceWriter::append */
+		int64_t timestamp(size_t i) const
+		{ return entry(i).timestamp; }
+
+		/** Reads frame 'i' into 'img' which is only reallocated if its size differs */
+		void readInto(size_t i, Image<K,CC>& img) const
+		{
+			const detail::SequenceIndexEntry e = entry(i);
+			const uint64_t payload = e.offset + sizeof(detail::SequenceFrameHeader);
+			if(img.width() != e.width || img.height() != e.height) {
+				img.resize(e.width, e.height);
+			}
+			if(e.codec == static_cast<uint32_t>(SequenceCodec::Depth)) {
+				static thread_local std::vector<uint8_t> buffer;
+				buffer.resize(e.size);
+				readBytes(buffer.data(), e.size, payload);
+				try {
+					detail::SequenceDecompress(buffer.data(), buffer.size(), img);
+				}
+				catch(const ConversionException& ex) {
+					throw IoException(fn_, ex.what());
+				}
+				return;
+			}
+			if(e.codec != static_cast<uint32_t>(SequenceCodec::None)) {
+				throw IoException(fn_, "Unknown sequence frame codec");
+			}
+			const size_t line = img.numElementsScanline()*sizeof(K);
+			if(e.size != static_cast<uint64_t>(line)*img.height()) {
+				throw IoException(fn_, "Invalid sequence frame size");
+			}
+			const ImageView<K,CC> view = img.view();
+			if(view.isContiguous()) {
+				readBytes(view.pixel_pointer(), e.size, payload);
+			}
+			else {
+				for(unsigned y=0; y<img.height(); y++) {
+					readBytes(view.pixel_pointer(0,y), line, payload + line*y);
+				}
+			}
+		}
+
+		/** Reads frame 'i' */
+		Image<K,CC> read(size_t i) const
+		{
+			Image<K,CC> img;
+			readInto(i, img);
+			return img;
+		}
+
+	private:
+		void open()
+		{
+			detail::SequenceFileHeader h;
+			if(detail::SequencePRead(fd_, &h, sizeof(h), 0, fn_) != sizeof(h)
+				|| std::memcmp(h.magic, "SLSEQ\0\0", 8) != 0) {
+				throw IoException(fn_, "Not a sequence file");
+			}
+			if(!detail::IsLittleEndian() || h.version != detail::SequenceVersion) {
+				throw IoException(fn_, "Unsupported sequence file version");
+			}
+			if(h.element_type != static_cast<uint32_t>(ElementTypeOf<K>::value) || h.channels != CC) {
+				throw IoException(fn_, "Image does not have specified type");
+			}
+			// use the index of a closed file, otherwise find the frames from their headers
+			const uint64_t file_size = fileSize();
+			detail::SequenceTrailer t;
+			if(file_size >= sizeof(h) + sizeof(t)
+				&& detail::SequencePRead(fd_, &t, sizeof(t), file_size - sizeof(t), fn_) == sizeof(t)
+				&& std::memcmp(t.magic, "SLSEQIDX", 8) == 0
+				&& t.index_offset + sizeof(detail::SequenceIndexEntry)*t.count + sizeof(t) == file_size) {
+				index_.resize(t.count);
+				const size_t bytes = sizeof(detail::SequenceIndexEntry)*index_.size();
+				if(detail::SequencePRead(fd_, index_.data(), bytes, t.index_offset, fn_) != bytes) {
+					throw IoException(fn_, "Unexpected end of file");
+				}
+				for(const detail::SequenceIndexEntry& e : index_) {
+					if(e.offset + sizeof(detail::SequenceFrameHeader) + e.size > t.index_offset) {
+						throw IoException(fn_, "Invalid sequence file index");
+					}
+				}
+				indexed_ = true;
+			}
+			else {
+				scan();
+			}
+		}
+
+		/** Adds all frames with a complete header and payload after the last known frame */
+		void scan()
+		{
+			const uint64_t file_size = fileSize();
+			while(true) {
+				detail::SequenceFrameHeader h;
+				if(detail::SequencePRead(fd_, &h, sizeof(h), end_, fn_) != sizeof(h)
+					|| !detail::IsValidFrameHeader(h, index_.size())
+					|| end_ + sizeof(h) + h.size > file_size) {
+					return;
+				}
+				index_.push_back(detail::SequenceIndexEntry{end_, h.size, h.timestamp, h.width, h.height, h.codec, 0});
+				end_ += sizeof(h) + detail::SequenceAlign(h.size);
+			}
+		}
+
+		uint64_t fileSize() const
+		{
+			struct stat st;
+			if(::fstat(fd_, &st) != 0) {
+				throw IoException(fn_, "Could not read file");
+			}
+			return st.st_size;
+		}
+
+		detail::SequenceIndexEntry entry(size_t i) const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(i >= index_.size()) {
+				throw IoException(fn_, "Frame number out of range");
+			}
+			return index_[i];
+		}
+
+		void readBytes(void* data, size_t size, uint64_t offset) const
+		{
+			if(detail::SequencePRead(fd_, data, size, offset, fn_) != size) {
+				throw IoException(fn_, "Unexpected end of file");
+			}
+		}
+
+		std::string fn_;
+		int fd_;
+		uint64_t end_; // position after the last frame found by scan
+		bool indexed_;
+		std::vector<detail::SequenceIndexEntry> index_;
+		mutable std::mutex mutex_;
+	};
+
+}
+
+#endif
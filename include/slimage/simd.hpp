@@ -0,0 +1,1200 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+// SIMD kernels are compiled with function level target attributes and selected at
+// runtime, thus no special compiler flags are needed. Define SLIMAGE_NO_SIMD to
+// always use the scalar code paths.
+
+#if !defined SLIMAGE_NO_SIMD
+#  if (defined __x86_64__ || defined __i386__) && (defined __GNUC__ || defined __clang__)
+#    define SLIMAGE_SIMD_X86
+#    include <immintrin.h>
+#    define SLIMAGE_TARGET(X) __attribute__((target(X)))
+#  elif (defined _M_X64 || defined _M_IX86) && defined _MSC_VER
+#    define SLIMAGE_SIMD_X86
+#    include <intrin.h>
+#    include <immintrin.h>
+#    define SLIMAGE_TARGET(X)
+#  elif defined __aarch64__ && defined __ARM_NEON
+#    define SLIMAGE_SIMD_NEON
+#    include <arm_neon.h>
+#  endif
+#endif
+
+namespace slimage
+{
+
+	/** Instruction set extensions used by the SIMD kernels */
+	enum class SimdLevel
+	{
+		Scalar,
+		SSSE3,
+		AVX2,
+		NEON
+	};
+
+	namespace detail
+	{
+		inline
+		SimdLevel DetectSimdLevel()
+		{
+#if defined SLIMAGE_SIMD_X86 && defined _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			const int max_id = info[0];
+			if(max_id >= 7) {
+				__cpuidex(info, 7, 0);
+				const bool avx2 = (info[1] & (1 << 5)) != 0;
+				__cpuid(info, 1);
+				const bool osxsave = (info[2] & (1 << 27)) != 0;
+				if(avx2 && osxsave && (_xgetbv(0) & 6) == 6) {
+					return SimdLevel::AVX2;
+				}
+			}
+			__cpuid(info, 1);
+			if(info[2] & (1 << 9)) {
+				return SimdLevel::SSSE3;
+			}
+			return SimdLevel::Scalar;
+#elif defined SLIMAGE_SIMD_X86
+			__builtin_cpu_init();
+			if(__builtin_cpu_supports("avx2")) {
+				return SimdLevel::AVX2;
+			}
+			if(__builtin_cpu_supports("ssse3")) {
+				return SimdLevel::SSSE3;
+			}
+			return SimdLevel::Scalar;
+#elif defined SLIMAGE_SIMD_NEON
+			return SimdLevel::NEON;
+#else
+			return SimdLevel::Scalar;
+#endif
+		}
+
+		inline
+		SimdLevel& SimdLevelStorage()
+		{
+			static SimdLevel level = DetectSimdLevel();
+			return level;
+		}
+	}
+
+	/** The instruction set used by the SIMD kernels, detected once at startup */
+	inline
+	SimdLevel GetSimdLevel()
+	{ return detail::SimdLevelStorage(); }
+
+	/** Restricts the SIMD kernels to the given level, e.g. to compare against the scalar code path
+	 * Levels which are not supported by the CPU are ignored.
+	 */
+	inline
+	void SetSimdLevel(SimdLevel level)
+	{
+		const SimdLevel detected = detail::DetectSimdLevel();
+		if(level == SimdLevel::Scalar
+			|| level == detected
+			|| (level == SimdLevel::SSSE3 && detected == SimdLevel::AVX2)) {
+			detail::SimdLevelStorage() = level;
+		}
+	}
+
+	namespace detail
+	{
+		enum class SwizzleOp
+		{
+			RGBA_to_BGRA,
+			RGBA_to_BGR,
+			RGB_to_BGRA,
+			RGB_to_BGR
+		};
+
+		/** Byte shuffle which swaps the first and third channel of a block of pixels
+		 * A block is 12 or 16 bytes of source data and 12 or 16 bytes of destination data.
+		 * Destination bytes which are not taken from the source are 0x80 in 'shuffle' and
+		 * are set from 'fill' (used for the alpha channel).
+		 */
+		struct SwizzleMask
+		{
+			unsigned src_block;
+			unsigned dst_block;
+			uint8_t shuffle[16];
+			uint8_t fill[16];
+		};
+
+		inline
+		SwizzleMask CreateSwizzleMask(SwizzleOp op, unsigned s, const void* alpha)
+		{
+			const unsigned src_cc = (op == SwizzleOp::RGBA_to_BGRA || op == SwizzleOp::RGBA_to_BGR) ? 4 : 3;
+			const unsigned dst_cc = (op == SwizzleOp::RGBA_to_BGRA || op == SwizzleOp::RGB_to_BGRA) ? 4 : 3;
+			const unsigned channel_map[4] = { 2, 1, 0, 3 };
+			// 4 bytes per element process one pixel per 16 bytes, 1 byte elements four pixels
+			const unsigned pixels = (src_cc == 4 ? 16 : 12) / (src_cc*s);
+			SwizzleMask m;
+			m.src_block = pixels*src_cc*s;
+			m.dst_block = pixels*dst_cc*s;
+			for(unsigned j=0; j<16; j++) {
+				m.shuffle[j] = 0x80;
+				m.fill[j] = 0;
+				if(j >= m.dst_block) {
+					continue;
+				}
+				const unsigned p = j / (dst_cc*s);
+				const unsigned e = (j % (dst_cc*s)) / s;
+				const unsigned b = j % s;
+				if(e < src_cc) {
+					m.shuffle[j] = static_cast<uint8_t>(p*src_cc*s + channel_map[e]*s + b);
+				}
+				else {
+					m.fill[j] = static_cast<const uint8_t*>(alpha)[b];
+				}
+			}
+			return m;
+		}
+
+#if defined SLIMAGE_SIMD_X86
+		SLIMAGE_TARGET("ssse3")
+		inline
+		size_t SwizzleSsse3(const uint8_t* src, size_t src_bytes, uint8_t* dst, const SwizzleMask& m)
+		{
+			const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.shuffle));
+			const __m128i fill = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.fill));
+			const size_t blocks = src_bytes / m.src_block;
+			size_t i = 0;
+			// every iteration reads and writes 16 bytes, thus stop early enough for the last block
+			for(; (i+1)*m.src_block + (16 - m.src_block) <= src_bytes
+				&& (i+1)*m.dst_block + (16 - m.dst_block) <= blocks*m.dst_block; i++) {
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i*m.src_block));
+				v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), fill);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i*m.dst_block), v);
+			}
+			return i*m.src_block;
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		size_t SwizzleAvx2(const uint8_t* src, size_t src_bytes, uint8_t* dst, const SwizzleMask& m)
+		{
+			const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.shuffle));
+			const __m128i fill128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.fill));
+			const __m256i shuffle = _mm256_inserti128_si256(_mm256_castsi128_si256(shuffle128), shuffle128, 1);
+			const __m256i fill = _mm256_inserti128_si256(_mm256_castsi128_si256(fill128), fill128, 1);
+			const size_t blocks = src_bytes / m.src_block;
+			size_t i = 0;
+			if(m.src_block == 16 && m.dst_block == 16) {
+				for(; (i+2)*16 <= src_bytes; i+=2) {
+					__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i*16));
+					v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), fill);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i*16), v);
+				}
+			}
+			else {
+				// two blocks per iteration, one in each 128 bit lane
+				for(; (i+2)*m.src_block + (16 - m.src_block) <= src_bytes
+					&& (i+2)*m.dst_block + (16 - m.dst_block) <= blocks*m.dst_block; i+=2) {
+					const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i*m.src_block));
+					const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (i+1)*m.src_block));
+					__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+					v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), fill);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i*m.dst_block), _mm256_castsi256_si128(v));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (i+1)*m.dst_block), _mm256_extracti128_si256(v, 1));
+				}
+			}
+			return i*m.src_block + SwizzleSsse3(src + i*m.src_block, src_bytes - i*m.src_block, dst + i*m.dst_block, m);
+		}
+#endif
+
+#if defined SLIMAGE_SIMD_NEON
+		inline
+		size_t SwizzleNeon(const uint8_t* src, size_t src_bytes, uint8_t* dst, const SwizzleMask& m)
+		{
+			// indices >= 16 in the table lookup give zero just like 0x80 with pshufb
+			const uint8x16_t shuffle = vld1q_u8(m.shuffle);
+			const uint8x16_t fill = vld1q_u8(m.fill);
+			const size_t blocks = src_bytes / m.src_block;
+			size_t i = 0;
+			for(; (i+1)*m.src_block + (16 - m.src_block) <= src_bytes
+				&& (i+1)*m.dst_block + (16 - m.dst_block) <= blocks*m.dst_block; i++) {
+				uint8x16_t v = vld1q_u8(src + i*m.src_block);
+				v = vorrq_u8(vqtbl1q_u8(v, shuffle), fill);
+				vst1q_u8(dst + i*m.dst_block, v);
+			}
+			return i*m.src_block;
+		}
+#endif
+
+		/** Applies the byte shuffle 'm' to the largest possible prefix of 'src'
+		 * Returns the number of source bytes processed. Source and destination may
+		 * be identical if the source and destination blocks have the same size.
+		 */
+		inline
+		size_t SimdShuffle(const SwizzleMask& m, const void* src, size_t src_bytes, void* dst)
+		{
+			const uint8_t* psrc = static_cast<const uint8_t*>(src);
+			uint8_t* pdst = static_cast<uint8_t*>(dst);
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: return SwizzleAvx2(psrc, src_bytes, pdst, m);
+			case SimdLevel::SSSE3: return SwizzleSsse3(psrc, src_bytes, pdst, m);
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: return SwizzleNeon(psrc, src_bytes, pdst, m);
+#endif
+			default: return 0;
+			}
+		}
+
+		/** Swizzles the largest possible prefix of 'src' with SIMD instructions
+		 * Returns the number of source bytes processed; the remainder has to be handled
+		 * by the caller. 's' is the size of one element in bytes (1, 2 or 4).
+		 */
+		inline
+		size_t SimdSwizzle(SwizzleOp op, unsigned s, const void* src, size_t src_bytes, void* dst, const void* alpha)
+		{
+			if(GetSimdLevel() == SimdLevel::Scalar || !(s == 1 || s == 2 || s == 4)) {
+				return 0;
+			}
+			const uint32_t zero = 0;
+			return SimdShuffle(CreateSwizzleMask(op, s, alpha ? alpha : &zero), src, src_bytes, dst);
+		}
+
+		/** Swaps the two bytes of the 16 bit values in 'src' and writes them to 'dst'
+		 * Used to convert between big endian file formats and little endian hosts.
+		 * Source and destination may be identical.
+		 */
+		inline
+		void ByteSwap16(const uint16_t* src, size_t n, uint16_t* dst)
+		{
+			size_t i = 0;
+			if(GetSimdLevel() != SimdLevel::Scalar) {
+				SwizzleMask m;
+				m.src_block = 16;
+				m.dst_block = 16;
+				for(unsigned j=0; j<16; j++) {
+					m.shuffle[j] = static_cast<uint8_t>(j ^ 1);
+					m.fill[j] = 0;
+				}
+				i = SimdShuffle(m, src, 2*n, dst) / 2;
+			}
+			for(; i<n; i++) {
+				dst[i] = static_cast<uint16_t>((src[i] >> 8) | (src[i] << 8));
+			}
+		}
+
+		/** Byte shuffles which convert between 3 or 4 interleaved channels and separate rows
+		 * A block is 16/s pixels, i.e. CC vectors of interleaved data and one vector per row.
+		 * Output vector o is the bitwise or of all input vectors i shuffled with shuffle[i][o].
+		 */
+		struct InterleaveMask
+		{
+			uint8_t shuffle[4][4][16];
+		};
+
+		inline
+		InterleaveMask CreateInterleaveMask(unsigned cc, unsigned s, bool deinterleave)
+		{
+			InterleaveMask m;
+			std::memset(m.shuffle, 0x80, sizeof(m.shuffle));
+			for(unsigned k=0; k<cc; k++) {
+				for(unsigned j=0; j<16; j++) {
+					if(deinterleave) {
+						// byte j of row k
+						const unsigned g = ((j / s)*cc + k)*s + j % s;
+						m.shuffle[g / 16][k][j] = static_cast<uint8_t>(g % 16);
+					}
+					else {
+						// byte j of interleaved vector k
+						const unsigned g = 16*k + j;
+						const unsigned c = (g % (cc*s)) / s;
+						m.shuffle[c][k][j] = static_cast<uint8_t>((g / (cc*s))*s + g % s);
+					}
+				}
+			}
+			return m;
+		}
+
+		/** The masks for 3 and 4 channels with elements of 1, 2 or 4 bytes, created once */
+		inline
+		const InterleaveMask& GetInterleaveMask(unsigned cc, unsigned s, bool deinterleave)
+		{
+			struct Table
+			{
+				Table()
+				{
+					for(unsigned i=0; i<12; i++) {
+						masks[i] = CreateInterleaveMask(3 + i/6, 1u << ((i/2) % 3), i % 2 == 1);
+					}
+				}
+				InterleaveMask masks[12];
+			};
+			static const Table table;
+			const unsigned si = (s == 1) ? 0 : ((s == 2) ? 1 : 2);
+			return table.masks[(cc - 3)*6 + si*2 + (deinterleave ? 1 : 0)];
+		}
+
+#if defined SLIMAGE_SIMD_X86
+		template<unsigned CC>
+		SLIMAGE_TARGET("ssse3")
+		void DeinterleaveSsse3(const InterleaveMask& m, const uint8_t* src, size_t blocks, uint8_t* const* dst)
+		{
+			__m128i shuffle[CC][CC];
+			for(unsigned i=0; i<CC; i++) {
+				for(unsigned o=0; o<CC; o++) {
+					shuffle[i][o] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.shuffle[i][o]));
+				}
+			}
+			for(size_t b=0; b<blocks; b++) {
+				__m128i v[CC];
+				for(unsigned i=0; i<CC; i++) {
+					v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (b*CC + i)*16));
+				}
+				for(unsigned o=0; o<CC; o++) {
+					__m128i r = _mm_shuffle_epi8(v[0], shuffle[0][o]);
+					for(unsigned i=1; i<CC; i++) {
+						r = _mm_or_si128(r, _mm_shuffle_epi8(v[i], shuffle[i][o]));
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst[o] + b*16), r);
+				}
+			}
+		}
+
+		template<unsigned CC>
+		SLIMAGE_TARGET("ssse3")
+		void InterleaveSsse3(const InterleaveMask& m, const uint8_t* const* src, size_t blocks, uint8_t* dst)
+		{
+			__m128i shuffle[CC][CC];
+			for(unsigned i=0; i<CC; i++) {
+				for(unsigned o=0; o<CC; o++) {
+					shuffle[i][o] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.shuffle[i][o]));
+				}
+			}
+			for(size_t b=0; b<blocks; b++) {
+				__m128i v[CC];
+				for(unsigned i=0; i<CC; i++) {
+					v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[i] + b*16));
+				}
+				for(unsigned o=0; o<CC; o++) {
+					__m128i r = _mm_shuffle_epi8(v[0], shuffle[0][o]);
+					for(unsigned i=1; i<CC; i++) {
+						r = _mm_or_si128(r, _mm_shuffle_epi8(v[i], shuffle[i][o]));
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (b*CC + o)*16), r);
+				}
+			}
+		}
+
+		// The AVX2 kernels process two blocks per iteration, one in each 128 bit lane.
+
+		template<unsigned CC>
+		SLIMAGE_TARGET("avx2")
+		void DeinterleaveAvx2(const InterleaveMask& m, const uint8_t* src, size_t blocks, uint8_t* const* dst)
+		{
+			__m256i shuffle[CC][CC];
+			for(unsigned i=0; i<CC; i++) {
+				for(unsigned o=0; o<CC; o++) {
+					shuffle[i][o] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m.shuffle[i][o])));
+				}
+			}
+			size_t b = 0;
+			for(; b+2<=blocks; b+=2) {
+				__m256i v[CC];
+				for(unsigned i=0; i<CC; i++) {
+					const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (b*CC + i)*16));
+					const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + ((b+1)*CC + i)*16));
+					v[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+				}
+				for(unsigned o=0; o<CC; o++) {
+					__m256i r = _mm256_shuffle_epi8(v[0], shuffle[0][o]);
+					for(unsigned i=1; i<CC; i++) {
+						r = _mm256_or_si256(r, _mm256_shuffle_epi8(v[i], shuffle[i][o]));
+					}
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst[o] + b*16), r);
+				}
+			}
+			if(b < blocks) {
+				uint8_t* rest[CC];
+				for(unsigned o=0; o<CC; o++) {
+					rest[o] = dst[o] + b*16;
+				}
+				DeinterleaveSsse3<CC>(m, src + b*CC*16, blocks - b, rest);
+			}
+		}
+
+		template<unsigned CC>
+		SLIMAGE_TARGET("avx2")
+		void InterleaveAvx2(const InterleaveMask& m, const uint8_t* const* src, size_t blocks, uint8_t* dst)
+		{
+			__m256i shuffle[CC][CC];
+			for(unsigned i=0; i<CC; i++) {
+				for(unsigned o=0; o<CC; o++) {
+					shuffle[i][o] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m.shuffle[i][o])));
+				}
+			}
+			size_t b = 0;
+			for(; b+2<=blocks; b+=2) {
+				__m256i v[CC];
+				for(unsigned i=0; i<CC; i++) {
+					v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src[i] + b*16));
+				}
+				for(unsigned o=0; o<CC; o++) {
+					__m256i r = _mm256_shuffle_epi8(v[0], shuffle[0][o]);
+					for(unsigned i=1; i<CC; i++) {
+						r = _mm256_or_si256(r, _mm256_shuffle_epi8(v[i], shuffle[i][o]));
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (b*CC + o)*16), _mm256_castsi256_si128(r));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + ((b+1)*CC + o)*16), _mm256_extracti128_si256(r, 1));
+				}
+			}
+			if(b < blocks) {
+				const uint8_t* rest[CC];
+				for(unsigned i=0; i<CC; i++) {
+					rest[i] = src[i] + b*16;
+				}
+				InterleaveSsse3<CC>(m, rest, blocks - b, dst + b*CC*16);
+			}
+		}
+#endif
+
+#if defined SLIMAGE_SIMD_NEON
+		// indices >= 16 in the table lookup give zero just like 0x80 with pshufb
+
+		template<unsigned CC>
+		void DeinterleaveNeon(const InterleaveMask& m, const uint8_t* src, size_t blocks, uint8_t* const* dst)
+		{
+			for(size_t b=0; b<blocks; b++) {
+				uint8x16_t v[CC];
+				for(unsigned i=0; i<CC; i++) {
+					v[i] = vld1q_u8(src + (b*CC + i)*16);
+				}
+				for(unsigned o=0; o<CC; o++) {
+					uint8x16_t r = vqtbl1q_u8(v[0], vld1q_u8(m.shuffle[0][o]));
+					for(unsigned i=1; i<CC; i++) {
+						r = vorrq_u8(r, vqtbl1q_u8(v[i], vld1q_u8(m.shuffle[i][o])));
+					}
+					vst1q_u8(dst[o] + b*16, r);
+				}
+			}
+		}
+
+		template<unsigned CC>
+		void InterleaveNeon(const InterleaveMask& m, const uint8_t* const* src, size_t blocks, uint8_t* dst)
+		{
+			for(size_t b=0; b<blocks; b++) {
+				uint8x16_t v[CC];
+				for(unsigned i=0; i<CC; i++) {
+					v[i] = vld1q_u8(src[i] + b*16);
+				}
+				for(unsigned o=0; o<CC; o++) {
+					uint8x16_t r = vqtbl1q_u8(v[0], vld1q_u8(m.shuffle[0][o]));
+					for(unsigned i=1; i<CC; i++) {
+						r = vorrq_u8(r, vqtbl1q_u8(v[i], vld1q_u8(m.shuffle[i][o])));
+					}
+					vst1q_u8(dst + (b*CC + o)*16, r);
+				}
+			}
+		}
+#endif
+
+		template<unsigned CC>
+		void SimdDeinterleaveBlocks(const InterleaveMask& m, const uint8_t* src, size_t blocks, uint8_t* const* dst)
+		{
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: DeinterleaveAvx2<CC>(m, src, blocks, dst); break;
+			case SimdLevel::SSSE3: DeinterleaveSsse3<CC>(m, src, blocks, dst); break;
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: DeinterleaveNeon<CC>(m, src, blocks, dst); break;
+#endif
+			default: break;
+			}
+		}
+
+		template<unsigned CC>
+		void SimdInterleaveBlocks(const InterleaveMask& m, const uint8_t* const* src, size_t blocks, uint8_t* dst)
+		{
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: InterleaveAvx2<CC>(m, src, blocks, dst); break;
+			case SimdLevel::SSSE3: InterleaveSsse3<CC>(m, src, blocks, dst); break;
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: InterleaveNeon<CC>(m, src, blocks, dst); break;
+#endif
+			default: break;
+			}
+		}
+
+		/** Splits the largest possible prefix of 'n' pixels with 'cc' interleaved channels into 'cc' rows
+		 * Returns the number of pixels processed; the remainder has to be handled by the caller.
+		 * 'cc' is 3 or 4 and 's' is the size of one element in bytes (1, 2 or 4).
+		 */
+		inline
+		size_t SimdDeinterleave(unsigned cc, unsigned s, const void* src, size_t n, void* const* dst)
+		{
+			if(GetSimdLevel() == SimdLevel::Scalar || !(cc == 3 || cc == 4) || !(s == 1 || s == 2 || s == 4)) {
+				return 0;
+			}
+			const size_t blocks = n*s / 16;
+			const InterleaveMask& m = GetInterleaveMask(cc, s, true);
+			uint8_t* rows[4];
+			for(unsigned c=0; c<cc; c++) {
+				rows[c] = static_cast<uint8_t*>(dst[c]);
+			}
+			if(cc == 3) {
+				SimdDeinterleaveBlocks<3>(m, static_cast<const uint8_t*>(src), blocks, rows);
+			}
+			else {
+				SimdDeinterleaveBlocks<4>(m, static_cast<const uint8_t*>(src), blocks, rows);
+			}
+			return blocks*16 / s;
+		}
+
+		/** Merges the largest possible prefix of 'n' pixels from 'cc' rows into interleaved pixels
+		 * Returns the number of pixels processed; see SimdDeinterleave.
+		 */
+		inline
+		size_t SimdInterleave(unsigned cc, unsigned s, const void* const* src, size_t n, void* dst)
+		{
+			if(GetSimdLevel() == SimdLevel::Scalar || !(cc == 3 || cc == 4) || !(s == 1 || s == 2 || s == 4)) {
+				return 0;
+			}
+			const size_t blocks = n*s / 16;
+			const InterleaveMask& m = GetInterleaveMask(cc, s, false);
+			const uint8_t* rows[4];
+			for(unsigned c=0; c<cc; c++) {
+				rows[c] = static_cast<const uint8_t*>(src[c]);
+			}
+			if(cc == 3) {
+				SimdInterleaveBlocks<3>(m, rows, blocks, static_cast<uint8_t*>(dst));
+			}
+			else {
+				SimdInterleaveBlocks<4>(m, rows, blocks, static_cast<uint8_t*>(dst));
+			}
+			return blocks*16 / s;
+		}
+
+#if defined SLIMAGE_SIMD_X86
+		SLIMAGE_TARGET("ssse3")
+		inline
+		size_t MulAddSsse3(float w, const float* src, float* dst, size_t n)
+		{
+			const __m128 vw = _mm_set1_ps(w);
+			size_t i = 0;
+			for(; i+4 <= n; i+=4) {
+				const __m128 v = _mm_mul_ps(vw, _mm_loadu_ps(src + i));
+				_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+			}
+			return i;
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		size_t MulAddAvx2(float w, const float* src, float* dst, size_t n)
+		{
+			// separate multiply and add instead of FMA give the same results as the scalar code
+			const __m256 vw = _mm256_set1_ps(w);
+			size_t i = 0;
+			for(; i+16 <= n; i+=16) {
+				const __m256 a = _mm256_mul_ps(vw, _mm256_loadu_ps(src + i));
+				const __m256 b = _mm256_mul_ps(vw, _mm256_loadu_ps(src + i + 8));
+				_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), a));
+				_mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), b));
+			}
+			return i + MulAddSsse3(w, src + i, dst + i, n - i);
+		}
+#endif
+
+#if defined SLIMAGE_SIMD_NEON
+		inline
+		size_t MulAddNeon(float w, const float* src, float* dst, size_t n)
+		{
+			const float32x4_t vw = vdupq_n_f32(w);
+			size_t i = 0;
+			for(; i+4 <= n; i+=4) {
+				const float32x4_t v = vmulq_f32(vw, vld1q_f32(src + i));
+				vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), v));
+			}
+			return i;
+		}
+#endif
+
+		/** Computes dst[i] += w*src[i] for n values; the workhorse of the convolution filters */
+		inline
+		void MulAdd(float w, const float* src, float* dst, size_t n)
+		{
+			size_t i = 0;
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: i = MulAddAvx2(w, src, dst, n); break;
+			case SimdLevel::SSSE3: i = MulAddSsse3(w, src, dst, n); break;
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: i = MulAddNeon(w, src, dst, n); break;
+#endif
+			default: break;
+			}
+			for(; i<n; i++) {
+				dst[i] += w*src[i];
+			}
+		}
+
+#if defined SLIMAGE_SIMD_X86
+		template<typename K, typename V>
+		void ReduceMinMaxLanes(const V& vlo, const V& vhi, K& lo, K& hi)
+		{
+			K a[sizeof(V)/sizeof(K)];
+			K b[sizeof(V)/sizeof(K)];
+			std::memcpy(a, &vlo, sizeof(V));
+			std::memcpy(b, &vhi, sizeof(V));
+			for(size_t i=0; i<sizeof(V)/sizeof(K); i++) {
+				lo = (a[i] < lo) ? a[i] : lo;
+				hi = (hi < b[i]) ? b[i] : hi;
+			}
+		}
+
+		SLIMAGE_TARGET("ssse3")
+		inline
+		size_t MinMaxSsse3(const uint8_t* src, size_t n, uint8_t& lo, uint8_t& hi)
+		{
+			__m128i vlo = _mm_set1_epi8(static_cast<char>(lo));
+			__m128i vhi = _mm_set1_epi8(static_cast<char>(hi));
+			size_t i = 0;
+			for(; i+16 <= n; i+=16) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				vlo = _mm_min_epu8(vlo, v);
+				vhi = _mm_max_epu8(vhi, v);
+			}
+			ReduceMinMaxLanes(vlo, vhi, lo, hi);
+			return i;
+		}
+
+		SLIMAGE_TARGET("ssse3")
+		inline
+		size_t MinMaxSsse3(const uint16_t* src, size_t n, uint16_t& lo, uint16_t& hi)
+		{
+			// there is no unsigned 16 bit min/max before SSE4.1, thus values are biased to signed
+			const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+			__m128i vlo = _mm_set1_epi16(static_cast<short>(lo ^ 0x8000));
+			__m128i vhi = _mm_set1_epi16(static_cast<short>(hi ^ 0x8000));
+			size_t i = 0;
+			for(; i+8 <= n; i+=8) {
+				const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), bias);
+				vlo = _mm_min_epi16(vlo, v);
+				vhi = _mm_max_epi16(vhi, v);
+			}
+			ReduceMinMaxLanes(_mm_xor_si128(vlo, bias), _mm_xor_si128(vhi, bias), lo, hi);
+			return i;
+		}
+
+		SLIMAGE_TARGET("ssse3")
+		inline
+		size_t MinMaxSsse3(const float* src, size_t n, float& lo, float& hi)
+		{
+			// the second operand is returned if one is NaN, thus NaN values are skipped
+			__m128 vlo = _mm_set1_ps(lo);
+			__m128 vhi = _mm_set1_ps(hi);
+			size_t i = 0;
+			for(; i+4 <= n; i+=4) {
+				const __m128 v = _mm_loadu_ps(src + i);
+				vlo = _mm_min_ps(v, vlo);
+				vhi = _mm_max_ps(v, vhi);
+			}
+			ReduceMinMaxLanes(vlo, vhi, lo, hi);
+			return i;
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		size_t MinMaxAvx2(const uint8_t* src, size_t n, uint8_t& lo, uint8_t& hi)
+		{
+			__m256i vlo = _mm256_set1_epi8(static_cast<char>(lo));
+			__m256i vhi = _mm256_set1_epi8(static_cast<char>(hi));
+			size_t i = 0;
+			for(; i+32 <= n; i+=32) {
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+				vlo = _mm256_min_epu8(vlo, v);
+				vhi = _mm256_max_epu8(vhi, v);
+			}
+			ReduceMinMaxLanes(vlo, vhi, lo, hi);
+			return i + MinMaxSsse3(src + i, n - i, lo, hi);
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		size_t MinMaxAvx2(const uint16_t* src, size_t n, uint16_t& lo, uint16_t& hi)
+		{
+			__m256i vlo = _mm256_set1_epi16(static_cast<short>(lo));
+			__m256i vhi = _mm256_set1_epi16(static_cast<short>(hi));
+			size_t i = 0;
+			for(; i+16 <= n; i+=16) {
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+				vlo = _mm256_min_epu16(vlo, v);
+				vhi = _mm256_max_epu16(vhi, v);
+			}
+			ReduceMinMaxLanes(vlo, vhi, lo, hi);
+			return i + MinMaxSsse3(src + i, n - i, lo, hi);
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		size_t MinMaxAvx2(const float* src, size_t n, float& lo, float& hi)
+		{
+			__m256 vlo = _mm256_set1_ps(lo);
+			__m256 vhi = _mm256_set1_ps(hi);
+			size_t i = 0;
+			for(; i+8 <= n; i+=8) {
+				const __m256 v = _mm256_loadu_ps(src + i);
+				vlo = _mm256_min_ps(v, vlo);
+				vhi = _mm256_max_ps(v, vhi);
+			}
+			ReduceMinMaxLanes(vlo, vhi, lo, hi);
+			return i + MinMaxSsse3(src + i, n - i, lo, hi);
+		}
+#endif
+
+#if defined SLIMAGE_SIMD_NEON
+		inline
+		size_t MinMaxNeon(const uint8_t* src, size_t n, uint8_t& lo, uint8_t& hi)
+		{
+			uint8x16_t vlo = vdupq_n_u8(lo);
+			uint8x16_t vhi = vdupq_n_u8(hi);
+			size_t i = 0;
+			for(; i+16 <= n; i+=16) {
+				const uint8x16_t v = vld1q_u8(src + i);
+				vlo = vminq_u8(vlo, v);
+				vhi = vmaxq_u8(vhi, v);
+			}
+			lo = std::min(lo, vminvq_u8(vlo));
+			hi = std::max(hi, vmaxvq_u8(vhi));
+			return i;
+		}
+
+		inline
+		size_t MinMaxNeon(const uint16_t* src, size_t n, uint16_t& lo, uint16_t& hi)
+		{
+			uint16x8_t vlo = vdupq_n_u16(lo);
+			uint16x8_t vhi = vdupq_n_u16(hi);
+			size_t i = 0;
+			for(; i+8 <= n; i+=8) {
+				const uint16x8_t v = vld1q_u16(src + i);
+				vlo = vminq_u16(vlo, v);
+				vhi = vmaxq_u16(vhi, v);
+			}
+			lo = std::min(lo, vminvq_u16(vlo));
+			hi = std::max(hi, vmaxvq_u16(vhi));
+			return i;
+		}
+
+		inline
+		size_t MinMaxNeon(const float* src, size_t n, float& lo, float& hi)
+		{
+			// vminnm/vmaxnm return the number if one operand is NaN
+			float32x4_t vlo = vdupq_n_f32(lo);
+			float32x4_t vhi = vdupq_n_f32(hi);
+			size_t i = 0;
+			for(; i+4 <= n; i+=4) {
+				const float32x4_t v = vld1q_f32(src + i);
+				vlo = vminnmq_f32(vlo, v);
+				vhi = vmaxnmq_f32(vhi, v);
+			}
+			lo = std::min(lo, vminnmvq_f32(vlo));
+			hi = std::max(hi, vmaxnmvq_f32(vhi));
+			return i;
+		}
+#endif
+
+		/** Number of values the SIMD kernels have folded into lo and hi; other types are left to scalar code */
+		template<typename K>
+		size_t SimdMinMax(const K*, size_t, K&, K&)
+		{ return 0; }
+
+		template<typename K>
+		size_t SimdMinMaxImpl(const K* src, size_t n, K& lo, K& hi)
+		{
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: return MinMaxAvx2(src, n, lo, hi);
+			case SimdLevel::SSSE3: return MinMaxSsse3(src, n, lo, hi);
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: return MinMaxNeon(src, n, lo, hi);
+#endif
+			default: break;
+			}
+			(void)src; (void)n; (void)lo; (void)hi;
+			return 0;
+		}
+
+		inline
+		size_t SimdMinMax(const uint8_t* src, size_t n, uint8_t& lo, uint8_t& hi)
+		{ return SimdMinMaxImpl(src, n, lo, hi); }
+
+		inline
+		size_t SimdMinMax(const uint16_t* src, size_t n, uint16_t& lo, uint16_t& hi)
+		{ return SimdMinMaxImpl(src, n, lo, hi); }
+
+		inline
+		size_t SimdMinMax(const float* src, size_t n, float& lo, float& hi)
+		{ return SimdMinMaxImpl(src, n, lo, hi); }
+
+		/** Folds n values into lo and hi; NaN values are skipped */
+		template<typename K>
+		void MinMax(const K* src, size_t n, K& lo, K& hi)
+		{
+			size_t i = SimdMinMax(src, n, lo, hi);
+			for(; i<n; i++) {
+				lo = (src[i] < lo) ? src[i] : lo;
+				hi = (hi < src[i]) ? src[i] : hi;
+			}
+		}
+
+#if defined SLIMAGE_SIMD_X86
+		SLIMAGE_TARGET("ssse3")
+		inline
+		size_t DepthToFloatSsse3(const uint16_t* src, size_t n, float scale, uint16_t lo, uint16_t hi, float* dst)
+		{
+			const __m128i vlo = _mm_set1_epi16(static_cast<short>(lo));
+			const __m128i vhi = _mm_set1_epi16(static_cast<short>(hi));
+			const __m128i zero = _mm_setzero_si128();
+			const __m128 vs = _mm_set1_ps(scale);
+			size_t i = 0;
+			for(; i+8 <= n; i+=8) {
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				// saturating differences are zero exactly for values in [lo,hi]
+				const __m128i out = _mm_or_si128(_mm_subs_epu16(vlo, v), _mm_subs_epu16(v, vhi));
+				v = _mm_and_si128(v, _mm_cmpeq_epi16(out, zero));
+				_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), vs));
+				_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), vs));
+			}
+			return i;
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		size_t DepthToFloatAvx2(const uint16_t* src, size_t n, float scale, uint16_t lo, uint16_t hi, float* dst)
+		{
+			const __m256i vlo = _mm256_set1_epi16(static_cast<short>(lo));
+			const __m256i vhi = _mm256_set1_epi16(static_cast<short>(hi));
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256 vs = _mm256_set1_ps(scale);
+			size_t i = 0;
+			for(; i+16 <= n; i+=16) {
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+				const __m256i out = _mm256_or_si256(_mm256_subs_epu16(vlo, v), _mm256_subs_epu16(v, vhi));
+				v = _mm256_and_si256(v, _mm256_cmpeq_epi16(out, zero));
+				const __m256i a = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+				const __m256i b = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+				_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), vs));
+				_mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), vs));
+			}
+			return i + DepthToFloatSsse3(src + i, n - i, scale, lo, hi, dst + i);
+		}
+#endif
+
+#if defined SLIMAGE_SIMD_NEON
+		inline
+		size_t DepthToFloatNeon(const uint16_t* src, size_t n, float scale, uint16_t lo, uint16_t hi, float* dst)
+		{
+			const uint16x8_t vlo = vdupq_n_u16(lo);
+			const uint16x8_t vhi = vdupq_n_u16(hi);
+			size_t i = 0;
+			for(; i+8 <= n; i+=8) {
+				uint16x8_t v = vld1q_u16(src + i);
+				v = vandq_u16(v, vandq_u16(vcgeq_u16(v, vlo), vcleq_u16(v, vhi)));
+				vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), scale));
+				vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), scale));
+			}
+			return i;
+		}
+#endif
+
+		/** Computes dst[i] = scale*src[i] for src[i] in [lo,hi] and 0 otherwise */
+		inline
+		void DepthToFloat(const uint16_t* src, size_t n, float scale, uint16_t lo, uint16_t hi, float* dst)
+		{
+			size_t i = 0;
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: i = DepthToFloatAvx2(src, n, scale, lo, hi, dst); break;
+			case SimdLevel::SSSE3: i = DepthToFloatSsse3(src, n, scale, lo, hi, dst); break;
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: i = DepthToFloatNeon(src, n, scale, lo, hi, dst); break;
+#endif
+			default: break;
+			}
+			for(; i<n; i++) {
+				const uint16_t v = (src[i] >= lo && src[i] <= hi) ? src[i] : 0;
+				dst[i] = static_cast<float>(v)*scale;
+			}
+		}
+
+		/** Shuffles which unpack 8 values of B bits from 16 bytes into 16 bit lanes
+		 * Value k starts at bit s = k*B%8 of byte o = k*B/8 and is (w >> s) & mask for the
+		 * 24 bits w starting at byte o. 'lo' moves byte o into the high byte of lane k and
+		 * 'hi' moves bytes o+1 and o+2 into lane k. With m = 2^(8-s), (w >> s) is the
+		 * high half of lo*m or'ed with the low half of hi*m, thus no per-lane shifts are needed.
+		 */
+		struct BitUnpackMask
+		{
+			uint8_t lo[16];
+			uint8_t hi[16];
+			uint16_t mul[8];
+			uint16_t shift[8];
+			uint16_t mask[8];
+		};
+
+		inline
+		BitUnpackMask CreateBitUnpackMask(unsigned bits)
+		{
+			BitUnpackMask m;
+			for(unsigned k=0; k<8; k++) {
+				const unsigned o = k*bits / 8;
+				const unsigned s = k*bits % 8;
+				m.lo[2*k] = 0x80;
+				m.lo[2*k + 1] = static_cast<uint8_t>(o);
+				// bytes past the 16 loaded bytes are only addressed for 16 bits, where s is 0 and they are not needed
+				m.hi[2*k] = (o + 1 < 16) ? static_cast<uint8_t>(o + 1) : 0x80;
+				m.hi[2*k + 1] = (o + 2 < 16) ? static_cast<uint8_t>(o + 2) : 0x80;
+				m.mul[k] = static_cast<uint16_t>(1u << (8 - s));
+				m.shift[k] = static_cast<uint16_t>(s);
+				m.mask[k] = static_cast<uint16_t>((1u << bits) - 1);
+			}
+			return m;
+		}
+
+		/** The masks for 0 to 16 bits, created once */
+		inline
+		const BitUnpackMask& GetBitUnpackMask(unsigned bits)
+		{
+			struct Table
+			{
+				Table()
+				{
+					for(unsigned b=0; b<=16; b++) {
+						masks[b] = CreateBitUnpackMask(b);
+					}
+				}
+				BitUnpackMask masks[17];
+			};
+			static const Table table;
+			return table.masks[bits];
+		}
+
+		// Groups of the depth codec (slimage/depth_codec.hpp) are one byte B followed by 16 zigzag
+		// coded residuals with B bits each. Values 0 to 7 are stored in the first B bytes and values
+		// 8 to 15 in the next B bytes, thus both halves are unpacked with the same shuffles from
+		// 16 bytes each. The kernels decode groups while 16 bytes can be read for the second half
+		// and leave the remaining groups and the error handling to the scalar code.
+
+#if defined SLIMAGE_SIMD_X86
+		SLIMAGE_TARGET("ssse3")
+		inline
+		__m128i UnpackBitsSsse3(__m128i v, const BitUnpackMask& m)
+		{
+			const __m128i mul = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.mul));
+			const __m128i lo = _mm_shuffle_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.lo)));
+			const __m128i hi = _mm_shuffle_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.hi)));
+			const __m128i w = _mm_or_si128(_mm_mulhi_epu16(lo, mul), _mm_mullo_epi16(hi, mul));
+			return _mm_and_si128(w, _mm_loadu_si128(reinterpret_cast<const __m128i*>(m.mask)));
+		}
+
+		SLIMAGE_TARGET("ssse3")
+		inline
+		__m128i UnZigZagSsse3(__m128i z)
+		{ return _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi16(1)))); }
+
+		/** Inclusive prefix sum of 8 lanes plus 'carry' */
+		SLIMAGE_TARGET("ssse3")
+		inline
+		__m128i PrefixSumSsse3(__m128i v, uint16_t carry)
+		{
+			v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+			v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+			v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+			return _mm_add_epi16(v, _mm_set1_epi16(static_cast<short>(carry)));
+		}
+
+		SLIMAGE_TARGET("ssse3")
+		inline
+		unsigned DecodeDepthGroupsSsse3(const uint8_t*& src, const uint8_t* end, unsigned groups, const uint16_t* above, uint16_t* dst)
+		{
+			uint16_t left = 0;
+			unsigned g = 0;
+			for(; g<groups; g++) {
+				if(static_cast<size_t>(end - src) < 17) {
+					break;
+				}
+				const unsigned bits = src[0];
+				if(bits > 16 || static_cast<size_t>(end - src) < 17 + bits) {
+					break;
+				}
+				const BitUnpackMask& m = GetBitUnpackMask(bits);
+				__m128i v0 = UnZigZagSsse3(UnpackBitsSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 1)), m));
+				__m128i v1 = UnZigZagSsse3(UnpackBitsSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 1 + bits)), m));
+				uint16_t* d = dst + 16*g;
+				if(above) {
+					const uint16_t* a = above + 16*g;
+					v0 = _mm_add_epi16(v0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+					v1 = _mm_add_epi16(v1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 8)));
+				}
+				else {
+					v0 = PrefixSumSsse3(v0, left);
+					v1 = PrefixSumSsse3(v1, static_cast<uint16_t>(_mm_extract_epi16(v0, 7)));
+					left = static_cast<uint16_t>(_mm_extract_epi16(v1, 7));
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(d), v0);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 8), v1);
+				src += 1 + 2*bits;
+			}
+			return g;
+		}
+
+		SLIMAGE_TARGET("avx2")
+		inline
+		unsigned DecodeDepthGroupsAvx2(const uint8_t*& src, const uint8_t* end, unsigned groups, const uint16_t* above, uint16_t* dst)
+		{
+			const __m256i one = _mm256_set1_epi16(1);
+			// broadcasts lane 7 of the lower half into the upper half, zero in the lower half
+			const __m256i last = _mm256_setr_epi8(
+				14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15,
+				14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15);
+			uint16_t left = 0;
+			unsigned g = 0;
+			for(; g<groups; g++) {
+				if(static_cast<size_t>(end - src) < 17) {
+					break;
+				}
+				const unsigned bits = src[0];
+				if(bits > 16 || static_cast<size_t>(end - src) < 17 + bits) {
+					break;
+				}
+				const BitUnpackMask& m = GetBitUnpackMask(bits);
+				const __m256i mul = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m.mul)));
+				const __m256i mlo = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m.lo)));
+				const __m256i mhi = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m.hi)));
+				const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m.mask)));
+				// values 0 to 7 in the lower and 8 to 15 in the upper 128 bit lane
+				const __m256i v = _mm256_inserti128_si256(
+					_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 1))),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 1 + bits)), 1);
+				const __m256i lo = _mm256_shuffle_epi8(v, mlo);
+				const __m256i hi = _mm256_shuffle_epi8(v, mhi);
+				__m256i z = _mm256_and_si256(_mm256_or_si256(_mm256_mulhi_epu16(lo, mul), _mm256_mullo_epi16(hi, mul)), mask);
+				z = _mm256_xor_si256(_mm256_srli_epi16(z, 1), _mm256_sub_epi16(_mm256_setzero_si256(), _mm256_and_si256(z, one)));
+				uint16_t* d = dst + 16*g;
+				if(above) {
+					z = _mm256_add_epi16(z, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + 16*g)));
+				}
+				else {
+					z = _mm256_add_epi16(z, _mm256_slli_si256(z, 2));
+					z = _mm256_add_epi16(z, _mm256_slli_si256(z, 4));
+					z = _mm256_add_epi16(z, _mm256_slli_si256(z, 8));
+					const __m256i t = _mm256_shuffle_epi8(z, last);
+					z = _mm256_add_epi16(z, _mm256_permute2x128_si256(t, t, 0x08));
+					z = _mm256_add_epi16(z, _mm256_set1_epi16(static_cast<short>(left)));
+					left = static_cast<uint16_t>(_mm256_extract_epi16(z, 15));
+				}
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(d), z);
+				src += 1 + 2*bits;
+			}
+			return g;
+		}
+#endif
+
+#if defined SLIMAGE_SIMD_NEON
+		inline
+		uint16x8_t UnpackBitsNeon(uint8x16_t v, const BitUnpackMask& m)
+		{
+			const int16x8_t s = vreinterpretq_s16_u16(vld1q_u16(m.shift));
+			const uint16x8_t lo = vreinterpretq_u16_u8(vqtbl1q_u8(v, vld1q_u8(m.lo)));
+			const uint16x8_t hi = vreinterpretq_u16_u8(vqtbl1q_u8(v, vld1q_u8(m.hi)));
+			// negative counts shift to the right
+			const uint16x8_t a = vshlq_u16(lo, vnegq_s16(vaddq_s16(s, vdupq_n_s16(8))));
+			const uint16x8_t b = vshlq_u16(hi, vsubq_s16(vdupq_n_s16(8), s));
+			return vandq_u16(vorrq_u16(a, b), vld1q_u16(m.mask));
+		}
+
+		inline
+		uint16x8_t UnZigZagNeon(uint16x8_t z)
+		{ return veorq_u16(vshrq_n_u16(z, 1), vsubq_u16(vdupq_n_u16(0), vandq_u16(z, vdupq_n_u16(1)))); }
+
+		inline
+		uint16x8_t PrefixSumNeon(uint16x8_t v, uint16_t carry)
+		{
+			const uint16x8_t zero = vdupq_n_u16(0);
+			v = vaddq_u16(v, vextq_u16(zero, v, 7));
+			v = vaddq_u16(v, vextq_u16(zero, v, 6));
+			v = vaddq_u16(v, vextq_u16(zero, v, 4));
+			return vaddq_u16(v, vdupq_n_u16(carry));
+		}
+
+		inline
+		unsigned DecodeDepthGroupsNeon(const uint8_t*& src, const uint8_t* end, unsigned groups, const uint16_t* above, uint16_t* dst)
+		{
+			uint16_t left = 0;
+			unsigned g = 0;
+			for(; g<groups; g++) {
+				if(static_cast<size_t>(end - src) < 17) {
+					break;
+				}
+				const unsigned bits = src[0];
+				if(bits > 16 || static_cast<size_t>(end - src) < 17 + bits) {
+					break;
+				}
+				const BitUnpackMask& m = GetBitUnpackMask(bits);
+				uint16x8_t v0 = UnZigZagNeon(UnpackBitsNeon(vld1q_u8(src + 1), m));
+				uint16x8_t v1 = UnZigZagNeon(UnpackBitsNeon(vld1q_u8(src + 1 + bits), m));
+				uint16_t* d = dst + 16*g;
+				if(above) {
+					v0 = vaddq_u16(v0, vld1q_u16(above + 16*g));
+					v1 = vaddq_u16(v1, vld1q_u16(above + 16*g + 8));
+				}
+				else {
+					v0 = PrefixSumNeon(v0, left);
+					v1 = PrefixSumNeon(v1, vgetq_lane_u16(v0, 7));
+					left = vgetq_lane_u16(v1, 7);
+				}
+				vst1q_u16(d, v0);
+				vst1q_u16(d + 8, v1);
+				src += 1 + 2*bits;
+			}
+			return g;
+		}
+#endif
+
+		/** Decodes the first groups of a line of the depth codec and advances 'src' past them
+		 * Reconstructs dst[x] = above[x] + residual, or the running sum of the residuals if
+		 * 'above' is null. Returns the number of groups decoded; the remaining groups, at
+		 * most 'groups', have to be decoded by the caller.
+		 */
+		inline
+		unsigned SimdDecodeDepthGroups(const uint8_t*& src, const uint8_t* end, unsigned groups, const uint16_t* above, uint16_t* dst)
+		{
+			switch(GetSimdLevel()) {
+#if defined SLIMAGE_SIMD_X86
+			case SimdLevel::AVX2: return DecodeDepthGroupsAvx2(src, end, groups, above, dst);
+			case SimdLevel::SSSE3: return DecodeDepthGroupsSsse3(src, end, groups, above, dst);
+#endif
+#if defined SLIMAGE_SIMD_NEON
+			case SimdLevel::NEON: return DecodeDepthGroupsNeon(src, end, groups, above, dst);
+#endif
+			default: return 0;
+			}
+		}
+
+		/** True if the host stores the least significant byte first */
+		inline
+		bool IsLittleEndian()
+		{
+			const uint16_t x = 1;
+			return *reinterpret_cast<const uint8_t*>(&x) == 1;
+		}
+	}
+
+}
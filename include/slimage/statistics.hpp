@@ -0,0 +1,731 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/algorithm.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/simd.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// Reductions compute partial results for blocks of lines and merge them in the order of
+// the blocks. The blocks only depend on the image size, thus sequential and parallel
+// versions give identical results independent of the number of threads.
+
+namespace slimage
+{
+
+	/** Per channel minimum and maximum of an image */
+	template<typename K, unsigned CC>
+	struct Extrema
+	{
+		std::array<K,CC> min;
+		std::array<K,CC> max;
+	};
+
+	namespace detail
+	{
+		/** Number of lines reduced together such that a block has roughly 64k elements */
+		inline
+		unsigned ReductionBlockRows(size_t elements_per_line)
+		{ return static_cast<unsigned>(std::max<size_t>(1, 65536 / std::max<size_t>(1, elements_per_line))); }
+
+		/** Computes partial(y0,y1) for all blocks of lines and merges them in block order */
+		template<typename T, typename P, typename M>
+		T ReduceBlocks(unsigned height, unsigned rows, T init, P partial, M merge)
+		{
+			for(unsigned y=0; y<height; y+=rows) {
+				init = merge(init, partial(y, std::min(height, y + rows)));
+			}
+			return init;
+		}
+
+		template<typename T, typename P, typename M>
+		T ReduceBlocks(const ParallelPolicy& policy, unsigned height, unsigned rows, T init, P partial, M merge)
+		{
+			const unsigned blocks = (height + rows - 1) / rows;
+			std::vector<T> results(blocks, init);
+			policy.threads().run(blocks, [&](size_t b) {
+				const unsigned y0 = static_cast<unsigned>(b*rows);
+				results[b] = partial(y0, std::min(height, y0 + rows));
+			});
+			for(const T& r : results) {
+				init = merge(init, r);
+			}
+			return init;
+		}
+
+		template<typename K, unsigned CC>
+		Extrema<K,CC> EmptyExtrema()
+		{
+			const std::pair<K,K> e = EmptyMinMax<K>();
+			Extrema<K,CC> r;
+			r.min.fill(e.first);
+			r.max.fill(e.second);
+			return r;
+		}
+
+		template<typename K, unsigned CC>
+		Extrema<K,CC> MergeExtrema(const Extrema<K,CC>& a, const Extrema<K,CC>& b)
+		{
+			Extrema<K,CC> r;
+			for(unsigned c=0; c<CC; c++) {
+				r.min[c] = (b.min[c] < a.min[c]) ? b.min[c] : a.min[c];
+				r.max[c] = (a.max[c] < b.max[c]) ? b.max[c] : a.max[c];
+			}
+			return r;
+		}
+
+		template<typename K, unsigned CC>
+		Extrema<K,CC> ExtremaRows(const ImageView<const K,CC>& img, unsigned y0, unsigned y1)
+		{
+			Extrema<K,CC> r = EmptyExtrema<K,CC>();
+			if(CC == 1) {
+				// all elements belong to the same channel
+				const std::pair<K,K> mm = MinMaxRows(img, y0, y1);
+				r.min[0] = mm.first;
+				r.max[0] = mm.second;
+				return r;
+			}
+			for(unsigned y=y0; y<y1; y++) {
+				const K* p = img.pixel_pointer(0,y);
+				for(unsigned x=0; x<img.width(); x++, p+=CC) {
+					for(unsigned c=0; c<CC; c++) {
+						r.min[c] = (p[c] < r.min[c]) ? p[c] : r.min[c];
+						r.max[c] = (r.max[c] < p[c]) ? p[c] : r.max[c];
+					}
+				}
+			}
+			return r;
+		}
+
+		/** Type used to sum elements of type K: 64 bit integers or double */
+		template<typename K>
+		using ReductionSum = typename std::conditional<std::is_integral<K>::value,
+			typename std::conditional<std::is_signed<K>::value, int64_t, uint64_t>::type,
+			double>::type;
+
+		template<typename K, unsigned CC>
+		std::array<ReductionSum<K>,CC> SumRows(const ImageView<const K,CC>& img, unsigned y0, unsigned y1)
+		{
+			std::array<ReductionSum<K>,CC> s;
+			s.fill(ReductionSum<K>(0));
+			for(unsigned y=y0; y<y1; y++) {
+				const K* p = img.pixel_pointer(0,y);
+				for(unsigned x=0; x<img.width(); x++, p+=CC) {
+					for(unsigned c=0; c<CC; c++) {
+						s[c] += p[c];
+					}
+				}
+			}
+			return s;
+		}
+
+		/** Count, mean and sum of squared deviations from the mean of a set of values */
+		struct Moments
+		{
+			double count;
+			double mean;
+			double m2;
+		};
+
+		/** Combines the moments of two disjoint sets (Chan et al.) */
+		inline
+		Moments MergeMoments(const Moments& a, const Moments& b)
+		{
+			if(b.count == 0.0) {
+				return a;
+			}
+			if(a.count == 0.0) {
+				return b;
+			}
+			const double n = a.count + b.count;
+			const double delta = b.mean - a.mean;
+			return Moments{n, a.mean + delta*b.count/n, a.m2 + b.m2 + delta*delta*a.count*b.count/n};
+		}
+
+		template<typename K, unsigned CC>
+		std::array<Moments,CC> MomentsRows(const ImageView<const K,CC>& img, unsigned y0, unsigned y1)
+		{
+			std::array<Moments,CC> m;
+			m.fill(Moments{0.0, 0.0, 0.0});
+			if(img.width() == 0 || y0 == y1) {
+				return m;
+			}
+			// values are shifted by the first pixel of the block to avoid cancellation
+			std::array<double,CC> shift, sum, sum2;
+			for(unsigned c=0; c<CC; c++) {
+				shift[c] = static_cast<double>(img.pixel_pointer(0,y0)[c]);
+				sum[c] = 0.0;
+				sum2[c] = 0.0;
+			}
+			for(unsigned y=y0; y<y1; y++) {
+				const K* p = img.pixel_pointer(0,y);
+				for(unsigned x=0; x<img.width(); x++, p+=CC) {
+					for(unsigned c=0; c<CC; c++) {
+						const double d = static_cast<double>(p[c]) - shift[c];
+						sum[c] += d;
+						sum2[c] += d*d;
+					}
+				}
+			}
+			const double n = static_cast<double>(img.width())*(y1 - y0);
+			for(unsigned c=0; c<CC; c++) {
+				m[c] = Moments{n, shift[c] + sum[c]/n, std::max(0.0, sum2[c] - sum[c]*sum[c]/n)};
+			}
+			return m;
+		}
+
+		template<std::size_t CC>
+		std::array<Moments,CC> MergeMoments(const std::array<Moments,CC>& a, const std::array<Moments,CC>& b)
+		{
+			std::array<Moments,CC> r;
+			for(unsigned c=0; c<CC; c++) {
+				r[c] = MergeMoments(a[c], b[c]);
+			}
+			return r;
+		}
+
+		/** Maps values to histogram bins; values outside of the range go to the first or last bin */
+		struct HistogramBins
+		{
+			HistogramBins(unsigned bins, double lo, double hi)
+			:	bins(bins), lo(lo), scale(bins/(hi - lo))
+			{}
+
+			template<typename K>
+			bool operator()(K v, unsigned& bin) const
+			{
+				const double x = (static_cast<double>(v) - lo)*scale;
+				if(x != x) {
+					return false;
+				}
+				bin = (x <= 0.0) ? 0 : ((x >= bins) ? bins - 1 : static_cast<unsigned>(x));
+				return true;
+			}
+
+			unsigned bins;
+			double lo;
+			double scale;
+		};
+
+		/** Full range histograms of 8 and 16 bit integers have one bin per value */
+		template<typename K>
+		struct HasFullHistogram
+		:	std::integral_constant<bool, std::is_integral<K>::value && sizeof(K) <= 2>
+		{};
+
+		template<typename K, unsigned CC>
+		void FullHistogramRows(const ImageView<const K,CC>& img, unsigned channel, unsigned y0, unsigned y1, std::vector<uint64_t>& hist)
+		{
+			const int offset = std::numeric_limits<K>::min();
+			for(unsigned y=y0; y<y1; y++) {
+				const K* p = img.pixel_pointer(0,y) + channel;
+				for(unsigned x=0; x<img.width(); x++, p+=CC) {
+					hist[static_cast<int>(*p) - offset]++;
+				}
+			}
+		}
+
+		template<typename K, unsigned CC>
+		void RangeHistogramRows(const ImageView<const K,CC>& img, unsigned channel, const HistogramBins& bins,
+			unsigned y0, unsigned y1, std::vector<uint64_t>& hist)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				const K* p = img.pixel_pointer(0,y) + channel;
+				for(unsigned x=0; x<img.width(); x++, p+=CC) {
+					unsigned b;
+					if(bins(*p, b)) {
+						hist[b]++;
+					}
+				}
+			}
+		}
+
+		/** Builds one sub-histogram per thread on equal parts of the image and adds them */
+		template<typename F>
+		std::vector<uint64_t> ParallelHistogram(const ParallelPolicy& policy, unsigned height, unsigned bins, F fnc)
+		{
+			ThreadPool& pool = policy.threads();
+			const unsigned parts = std::max(1u, std::min(pool.size(), height));
+			const unsigned rows = (height + parts - 1) / parts;
+			std::vector<std::vector<uint64_t>> sub(parts, std::vector<uint64_t>(bins, 0));
+			pool.run(parts, [&](size_t i) {
+				const unsigned y0 = std::min(height, static_cast<unsigned>(i*rows));
+				fnc(y0, std::min(height, y0 + rows), sub[i]);
+			});
+			for(unsigned i=1; i<parts; i++) {
+				for(unsigned b=0; b<bins; b++) {
+					sub[0][b] += sub[i][b];
+				}
+			}
+			return std::move(sub[0]);
+		}
+
+		template<typename K, unsigned CC>
+		void CheckChannel(unsigned channel)
+		{
+			if(channel >= CC) {
+				throw ConversionException("Invalid channel index");
+			}
+		}
+
+		/** Index of the element at percentile p in [0,1] among n sorted elements */
+		inline
+		uint64_t PercentileRank(double p, uint64_t n)
+		{
+			const double r = std::floor(std::min(1.0, std::max(0.0, p))*static_cast<double>(n - 1) + 0.5);
+			return std::min<uint64_t>(n - 1, static_cast<uint64_t>(r));
+		}
+	}
+
+	/** Per channel minimum and maximum; NaN values are skipped
+	 * For an empty image min is the largest and max the smallest value of K.
+	 */
+	template<typename K, unsigned CC>
+	Extrema<typename std::remove_const<K>::type,CC> MinMax(const ImageView<K,CC>& img)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		const ImageView<const base_t,CC> v = img;
+		return detail::ReduceBlocks(img.height(), detail::ReductionBlockRows(img.numElementsScanline()),
+			detail::EmptyExtrema<base_t,CC>(),
+			[&v](unsigned y0, unsigned y1) { return detail::ExtremaRows(v, y0, y1); },
+			detail::MergeExtrema<base_t,CC>);
+	}
+
+	template<typename K, unsigned CC>
+	Extrema<typename std::remove_const<K>::type,CC> MinMax(const ParallelPolicy& policy, const ImageView<K,CC>& img)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		const ImageView<const base_t,CC> v = img;
+		return detail::ReduceBlocks(policy, img.height(), detail::ReductionBlockRows(img.numElementsScanline()),
+			detail::EmptyExtrema<base_t,CC>(),
+			[&v](unsigned y0, unsigned y1) { return detail::ExtremaRows(v, y0, y1); },
+			detail::MergeExtrema<base_t,CC>);
+	}
+
+	template<typename K, unsigned CC>
+	Extrema<K,CC> MinMax(const Image<K,CC>& img)
+	{ return MinMax(img.view()); }
+
+	template<typename K, unsigned CC>
+	Extrema<K,CC> MinMax(const ParallelPolicy& policy, const Image<K,CC>& img)
+	{ return MinMax(policy, img.view()); }
+
+	/** Per channel sum; integer types are summed exactly with 64 bit integers */
+	template<typename K, unsigned CC>
+	std::array<double,CC> Sum(const ImageView<K,CC>& img)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		using sum_t = detail::ReductionSum<base_t>;
+		const ImageView<const base_t,CC> v = img;
+		std::array<sum_t,CC> zero;
+		zero.fill(sum_t(0));
+		const std::array<sum_t,CC> s = detail::ReduceBlocks(img.height(), detail::ReductionBlockRows(img.numElementsScanline()), zero,
+			[&v](unsigned y0, unsigned y1) { return detail::SumRows(v, y0, y1); },
+			[](std::array<sum_t,CC> a, const std::array<sum_t,CC>& b) { for(unsigned c=0; c<CC; c++) a[c] += b[c]; return a; });
+		std::array<double,CC> r;
+		std::copy(s.begin(), s.end(), r.begin());
+		return r;
+	}
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Sum(const ParallelPolicy& policy, const ImageView<K,CC>& img)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		using sum_t = detail::ReductionSum<base_t>;
+		const ImageView<const base_t,CC> v = img;
+		std::array<sum_t,CC> zero;
+		zero.fill(sum_t(0));
+		const std::array<sum_t,CC> s = detail::ReduceBlocks(policy, img.height(), detail::ReductionBlockRows(img.numElementsScanline()), zero,
+			[&v](unsigned y0, unsigned y1) { return detail::SumRows(v, y0, y1); },
+			[](std::array<sum_t,CC> a, const std::array<sum_t,CC>& b) { for(unsigned c=0; c<CC; c++) a[c] += b[c]; return a; });
+		std::array<double,CC> r;
+		std::copy(s.begin(), s.end(), r.begin());
+		return r;
+	}
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Sum(const Image<K,CC>& img)
+	{ return Sum(img.view()); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Sum(const ParallelPolicy& policy, const Image<K,CC>& img)
+	{ return Sum(policy, img.view()); }
+
+	namespace detail
+	{
+		template<typename K, unsigned CC, typename POLICY>
+		std::array<Moments,CC> ComputeMoments(const POLICY& policy, const ImageView<K,CC>& img)
+		{
+			using base_t = typename std::remove_const<K>::type;
+			const ImageView<const base_t,CC> v = img;
+			std::array<Moments,CC> zero;
+			zero.fill(Moments{0.0, 0.0, 0.0});
+			return ReduceBlocks(policy, img.height(), ReductionBlockRows(img.numElementsScanline()), zero,
+				[&v](unsigned y0, unsigned y1) { return MomentsRows(v, y0, y1); },
+				MergeMoments<CC>);
+		}
+
+		template<typename K, unsigned CC>
+		std::array<Moments,CC> ComputeMoments(const SequentialPolicy&, const ImageView<K,CC>& img)
+		{
+			using base_t = typename std::remove_const<K>::type;
+			const ImageView<const base_t,CC> v = img;
+			std::array<Moments,CC> zero;
+			zero.fill(Moments{0.0, 0.0, 0.0});
+			return ReduceBlocks(img.height(), ReductionBlockRows(img.numElementsScanline()), zero,
+				[&v](unsigned y0, unsigned y1) { return MomentsRows(v, y0, y1); },
+				MergeMoments<CC>);
+		}
+
+		template<std::size_t CC>
+		std::array<double,CC> MomentsMean(const std::array<Moments,CC>& m)
+		{
+			std::array<double,CC> r;
+			for(unsigned c=0; c<CC; c++) {
+				r[c] = m[c].mean;
+			}
+			return r;
+		}
+
+		template<std::size_t CC>
+		std::array<double,CC> MomentsVariance(const std::array<Moments,CC>& m)
+		{
+			std::array<double,CC> r;
+			for(unsigned c=0; c<CC; c++) {
+				r[c] = (m[c].count > 0.0) ? m[c].m2 / m[c].count : 0.0;
+			}
+			return r;
+		}
+	}
+
+	/** Per channel mean; 0 for an empty image */
+	template<typename K, unsigned CC>
+	std::array<double,CC> Mean(const ImageView<K,CC>& img)
+	{ return detail::MomentsMean(detail::ComputeMoments(seq, img)); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Mean(const ParallelPolicy& policy, const ImageView<K,CC>& img)
+	{ return detail::MomentsMean(detail::ComputeMoments(policy, img)); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Mean(const Image<K,CC>& img)
+	{ return Mean(img.view()); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Mean(const ParallelPolicy& policy, const Image<K,CC>& img)
+	{ return Mean(policy, img.view()); }
+
+	/** Per channel population variance computed in one pass with a numerically stable merge */
+	template<typename K, unsigned CC>
+	std::array<double,CC> Variance(const ImageView<K,CC>& img)
+	{ return detail::MomentsVariance(detail::ComputeMoments(seq, img)); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Variance(const ParallelPolicy& policy, const ImageView<K,CC>& img)
+	{ return detail::MomentsVariance(detail::ComputeMoments(policy, img)); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Variance(const Image<K,CC>& img)
+	{ return Variance(img.view()); }
+
+	template<typename K, unsigned CC>
+	std::array<double,CC> Variance(const ParallelPolicy& policy, const Image<K,CC>& img)
+	{ return Variance(policy, img.view()); }
+
+	/** Histogram of one channel of an 8 or 16 bit integer image with one bin per value
+	 * Bin i counts the value std::numeric_limits<K>::min() + i.
+	 */
+	template<typename K, unsigned CC>
+	typename std::enable_if<detail::HasFullHistogram<typename std::remove_const<K>::type>::value, std::vector<uint64_t>>::type
+	Histogram(const ImageView<K,CC>& img, unsigned channel=0)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::CheckChannel<K,CC>(channel);
+		std::vector<uint64_t> hist(1u << (8*sizeof(base_t)), 0);
+		detail::FullHistogramRows(ImageView<const base_t,CC>(img), channel, 0, img.height(), hist);
+		return hist;
+	}
+
+	/** Histogram with sub-histograms built in parallel */
+	template<typename K, unsigned CC>
+	typename std::enable_if<detail::HasFullHistogram<typename std::remove_const<K>::type>::value, std::vector<uint64_t>>::type
+	Histogram(const ParallelPolicy& policy, const ImageView<K,CC>& img, unsigned channel=0)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::CheckChannel<K,CC>(channel);
+		const ImageView<const base_t,CC> v = img;
+		return detail::ParallelHistogram(policy, img.height(), 1u << (8*sizeof(base_t)),
+			[&v,channel](unsigned y0, unsigned y1, std::vector<uint64_t>& hist) {
+				detail::FullHistogramRows(v, channel, y0, y1, hist);
+			});
+	}
+
+	/** Histogram of one channel with 'bins' equal bins covering [lo,hi)
+	 * Values outside of the range are counted in the first or last bin; NaN values are skipped.
+	 */
+	template<typename K, unsigned CC>
+	std::vector<uint64_t> Histogram(const ImageView<K,CC>& img, unsigned bins, double lo, double hi, unsigned channel=0)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::CheckChannel<K,CC>(channel);
+		if(bins == 0 || !(lo < hi)) {
+			throw ConversionException("Histogram needs at least one bin and a non-empty range");
+		}
+		std::vector<uint64_t> hist(bins, 0);
+		detail::RangeHistogramRows(ImageView<const base_t,CC>(img), channel, detail::HistogramBins(bins, lo, hi), 0, img.height(), hist);
+		return hist;
+	}
+
+	template<typename K, unsigned CC>
+	std::vector<uint64_t> Histogram(const ParallelPolicy& policy, const ImageView<K,CC>& img, unsigned bins, double lo, double hi, unsigned channel=0)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::CheckChannel<K,CC>(channel);
+		if(bins == 0 || !(lo < hi)) {
+			throw ConversionException("Histogram needs at least one bin and a non-empty range");
+		}
+		const ImageView<const base_t,CC> v = img;
+		const detail::HistogramBins mapping(bins, lo, hi);
+		return detail::ParallelHistogram(policy, img.height(), bins,
+			[&v,&mapping,channel](unsigned y0, unsigned y1, std::vector<uint64_t>& hist) {
+				detail::RangeHistogramRows(v, channel, mapping, y0, y1, hist);
+			});
+	}
+
+	template<typename K, unsigned CC>
+	auto Histogram(const Image<K,CC>& img, unsigned channel=0)
+	-> decltype(Histogram(img.view(), channel))
+	{ return Histogram(img.view(), channel); }
+
+	template<typename K, unsigned CC>
+	auto Histogram(const ParallelPolicy& policy, const Image<K,CC>& img, unsigned channel=0)
+	-> decltype(Histogram(policy, img.view(), channel))
+	{ return Histogram(policy, img.view(), channel); }
+
+	template<typename K, unsigned CC>
+	std::vector<uint64_t> Histogram(const Image<K,CC>& img, unsigned bins, double lo, double hi, unsigned channel=0)
+	{ return Histogram(img.view(), bins, lo, hi, channel); }
+
+	template<typename K, unsigned CC>
+	std::vector<uint64_t> Histogram(const ParallelPolicy& policy, const Image<K,CC>& img, unsigned bins, double lo, double hi, unsigned channel=0)
+	{ return Histogram(policy, img.view(), bins, lo, hi, channel); }
+
+	/** Bin of a histogram which contains the value at percentile p in [0,1]
+	 * Percentile p is the element with index round(p*(n-1)) of the n sorted values.
+	 * Returns 0 for an empty histogram.
+	 */
+	inline
+	unsigned HistogramPercentile(const std::vector<uint64_t>& hist, double p)
+	{
+		uint64_t n = 0;
+		for(uint64_t h : hist) {
+			n += h;
+		}
+		if(n == 0) {
+			return 0;
+		}
+		const uint64_t rank = detail::PercentileRank(p, n);
+		uint64_t sum = 0;
+		for(unsigned b=0; b<hist.size(); b++) {
+			sum += hist[b];
+			if(sum > rank) {
+				return b;
+			}
+		}
+		return hist.size() - 1;
+	}
+
+	namespace detail
+	{
+		template<typename K, unsigned CC>
+		std::vector<uint64_t> HistogramWithPolicy(const SequentialPolicy&, const ImageView<const K,CC>& img, unsigned channel)
+		{ return Histogram(img, channel); }
+
+		template<typename K, unsigned CC>
+		std::vector<uint64_t> HistogramWithPolicy(const ParallelPolicy& policy, const ImageView<const K,CC>& img, unsigned channel)
+		{ return Histogram(policy, img, channel); }
+
+		/** Exact percentiles using the full range histogram */
+		template<typename K, unsigned CC, typename POLICY>
+		typename std::enable_if<HasFullHistogram<K>::value, std::vector<double>>::type
+		PercentilesImpl(const POLICY& policy, const ImageView<const K,CC>& img, const std::vector<double>& ps, unsigned channel)
+		{
+			const std::vector<uint64_t> hist = HistogramWithPolicy(policy, img, channel);
+			std::vector<double> result;
+			for(double p : ps) {
+				result.push_back(static_cast<double>(std::numeric_limits<K>::min()) + HistogramPercentile(hist, p));
+			}
+			return result;
+		}
+
+		/** Copies the values of one channel in lines [y0,y1) to 'dst' skipping NaN and returns the end */
+		template<typename K, unsigned CC>
+		K* CopyChannelRows(const ImageView<const K,CC>& img, unsigned channel, unsigned y0, unsigned y1, K* dst)
+		{
+			for(unsigned y=y0; y<y1; y++) {
+				const K* p = img.pixel_pointer(0,y) + channel;
+				for(unsigned x=0; x<img.width(); x++, p+=CC) {
+					if(*p == *p) {
+						*dst++ = *p;
+					}
+				}
+			}
+			return dst;
+		}
+
+		template<typename K, unsigned CC>
+		std::vector<K> ChannelValues(const SequentialPolicy&, const ImageView<const K,CC>& img, unsigned channel)
+		{
+			std::vector<K> values(static_cast<size_t>(img.width())*img.height());
+			values.resize(CopyChannelRows(img, channel, 0, img.height(), values.data()) - values.data());
+			return values;
+		}
+
+		/** Copies equal parts of the image in parallel, each to the position of its first line
+		 * Parts are only moved together if NaN values were skipped.
+		 */
+		template<typename K, unsigned CC>
+		std::vector<K> ChannelValues(const ParallelPolicy& policy, const ImageView<const K,CC>& img, unsigned channel)
+		{
+			ThreadPool& pool = policy.threads();
+			const unsigned height = img.height();
+			const unsigned parts = std::max(1u, std::min(pool.size(), height));
+			const unsigned rows = (height + parts - 1) / parts;
+			std::vector<K> values(static_cast<size_t>(img.width())*height);
+			std::vector<size_t> ends(parts);
+			pool.run(parts, [&](size_t i) {
+				const unsigned y0 = std::min(height, static_cast<unsigned>(i*rows));
+				K* first = values.data() + static_cast<size_t>(img.width())*y0;
+				ends[i] = CopyChannelRows(img, channel, y0, std::min(height, y0 + rows), first) - values.data();
+			});
+			size_t n = 0;
+			for(unsigned i=0; i<parts; i++) {
+				const size_t first = static_cast<size_t>(img.width())*std::min(height, i*rows);
+				if(first != n) {
+					std::copy(values.begin() + first, values.begin() + ends[i], values.begin() + n);
+				}
+				n += ends[i] - first;
+			}
+			values.resize(n);
+			return values;
+		}
+
+		/** Exact percentiles by partially sorting a copy of the channel
+		 * Percentiles are selected in increasing order, thus every selection only has to
+		 * partition the values above the previous one.
+		 */
+		template<typename K, unsigned CC, typename POLICY>
+		typename std::enable_if<!HasFullHistogram<K>::value, std::vector<double>>::type
+		PercentilesImpl(const POLICY& policy, const ImageView<const K,CC>& img, const std::vector<double>& ps, unsigned channel)
+		{
+			std::vector<K> values = ChannelValues(policy, img, channel);
+			std::vector<double> result(ps.size(), 0.0);
+			if(values.empty()) {
+				return result;
+			}
+			std::vector<std::pair<uint64_t,size_t>> ranks;
+			for(size_t i=0; i<ps.size(); i++) {
+				ranks.push_back(std::make_pair(PercentileRank(ps[i], values.size()), i));
+			}
+			std::sort(ranks.begin(), ranks.end());
+			auto first = values.begin();
+			for(const auto& r : ranks) {
+				const auto it = values.begin() + r.first;
+				if(it >= first) {
+					std::nth_element(first, it, values.end());
+					first = it + 1;
+				}
+				result[r.second] = static_cast<double>(*it);
+			}
+			return result;
+		}
+
+	}
+
+	/** Values at the percentiles 'ps' in [0,1] of one channel
+	 * 8 and 16 bit integer images use a histogram, other types partially sort a copy of the
+	 * channel. NaN values are skipped. Returns 0 for each percentile of an empty image.
+	 */
+	template<typename K, unsigned CC>
+	std::vector<double> Percentiles(const ImageView<K,CC>& img, const std::vector<double>& ps, unsigned channel=0)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::CheckChannel<K,CC>(channel);
+		return detail::PercentilesImpl(seq, ImageView<const base_t,CC>(img), ps, channel);
+	}
+
+	template<typename K, unsigned CC>
+	std::vector<double> Percentiles(const ParallelPolicy& policy, const ImageView<K,CC>& img, const std::vector<double>& ps, unsigned channel=0)
+	{
+		using base_t = typename std::remove_const<K>::type;
+		detail::CheckChannel<K,CC>(channel);
+		return detail::PercentilesImpl(policy, ImageView<const base_t,CC>(img), ps, channel);
+	}
+
+	template<typename K, unsigned CC>
+	std::vector<double> Percentiles(const Image<K,CC>& img, const std::vector<double>& ps, unsigned channel=0)
+	{ return Percentiles(img.view(), ps, channel); }
+
+	template<typename K, unsigned CC>
+	std::vector<double> Percentiles(const ParallelPolicy& policy, const Image<K,CC>& img, const std::vector<double>& ps, unsigned channel=0)
+	{ return Percentiles(policy, img.view(), ps, channel); }
+
+	/** Value at percentile p in [0,1] of one channel, see Percentiles */
+	template<typename K, unsigned CC>
+	double Percentile(const Image<K,CC>& img, double p, unsigned channel=0)
+	{ return Percentiles(img.view(), std::vector<double>{p}, channel)[0]; }
+
+	template<typename K, unsigned CC>
+	double Percentile(const ParallelPolicy& policy, const Image<K,CC>& img, double p, unsigned channel=0)
+	{ return Percentiles(policy, img.view(), std::vector<double>{p}, channel)[0]; }
+
+	/** Rescale with the range computed and the image converted in parallel */
+	template<typename K>
+	Image1f Rescale(const ParallelPolicy& policy, const Image<K,1>& img, float min, float max)
+	{
+		if(min == max) {
+			return Image1f(img.dimensions(), 0.5f);
+		}
+		float scl = 1.0f / (max - min);
+		return Convert(policy, img, [scl,min](float v) { return std::min(std::max(0.0f,scl*(v - min)),1.0f); });
+	}
+
+	template<typename K>
+	Image1f Rescale(const ParallelPolicy& policy, const Image<K,1>& img)
+	{
+		const Extrema<K,1> range = MinMax(policy, img);
+		const float min = range.min[0], max = range.max[0];
+		if(!(min < max)) {
+			return Image1f(img.dimensions(), 0.5f);
+		}
+		float scl = 1.0f / (max - min);
+		return Convert(policy, img, [scl,min](float v) { return scl*(v - min); });
+	}
+
+	/** Rescales the values between the percentiles 'lower' and 'upper' to [0,1] and clamps the others
+	 * Unlike Rescale a few outliers do not compress the range of the remaining values.
+	 */
+	template<typename K>
+	Image1f RescalePercentile(const Image<K,1>& img, double lower=0.01, double upper=0.99)
+	{
+		const std::vector<double> range = Percentiles(img, {lower, upper});
+		return Rescale(img, static_cast<float>(range[0]), static_cast<float>(range[1]));
+	}
+
+	template<typename K>
+	Image1f RescalePercentile(const ParallelPolicy& policy, const Image<K,1>& img, double lower=0.01, double upper=0.99)
+	{
+		const std::vector<double> range = Percentiles(policy, img, {lower, upper});
+		return Rescale(policy, img, static_cast<float>(range[0]), static_cast<float>(range[1]));
+	}
+
+}
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/view.hpp>
+#include <slimage/algorithm.hpp>
+#include <slimage/parallel.hpp>
+#include <slimage/netpbm.hpp>
+#include <slimage/mapped.hpp>
+#include <slimage/error.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <cassert>
+
+namespace slimage
+{
+
+	/** Reads a PGM/PPM or raw image file a band of lines at a time
+	 * Only the band which is currently read has to fit into memory.
+	 */
+	template<typename K, unsigned CC>
+	class ScanlineSource
+	{
+	public:
+		using dim_t = std::tuple<unsigned,unsigned>;
+
+		explicit ScanlineSource(const std::string& fn)
+		:	fn_(fn),
+			is_(fn, std::ios::binary),
+			y_(0),
+			raw_(false),
+			raw_offset_(0),
+			raw_stride_(0),
+			netpbm_()
+		{
+			if(!is_.is_open()) {
+				throw IoException(fn, "Could not open file");
+			}
+			if(IsRawFilename(fn)) {
+				const detail::RawHeader h = detail::ReadRawHeader(is_, fn);
+				detail::CheckRawType<K,CC>(h, fn);
+				width_ = h.width;
+				height_ = h.height;
+				raw_ = true;
+				raw_offset_ = h.data_offset;
+				raw_stride_ = h.stride;
+			}
+			else {
+				netpbm_ = detail::ReadNetpbmHeader(is_, fn);
+				if(!detail::IsNetpbmType<K,CC>::value || netpbm_.channels != CC || netpbm_.bytes() != sizeof(K)) {
+					throw IoException(fn, "Image does not have specified type");
+				}
+				width_ = netpbm_.width;
+				height_ = netpbm_.height;
+			}
+		}
+
+		ScanlineSource(const ScanlineSource&) = delete;
+		ScanlineSource& operator=(const ScanlineSource&) = delete;
+
+		/** Width of image */
+		unsigned width() const
+		{ return width_; }
+
+		/** Height of image */
+		unsigned height() const
+		{ return height_; }
+
+		dim_t dimensions() const
+		{ return std::make_tuple(width(), height()); }
+
+		/** Number of elements per pixel */
+		unsigned channelCount() const
+		{ return CC; }
+
+		/** Index of the next line which will be read */
+		unsigned position() const
+		{ return y_; }
+
+		/** True if all lines have been read */
+		bool done() const
+		{ return y_ == height_; }
+
+		/** Reads the next lines into 'band' which has the width of the image
+		 * Returns the number of lines read which is less than the height of 'band'
+		 * only for the last band and 0 if all lines have been read.
+		 */
+		unsigned read(const ImageView<K,CC>& band)
+		{
+			assert(band.width() == width_);
+			const unsigned n = std::min(band.height(), height_ - y_);
+			if(n == 0) {
+				return 0;
+			}
+			const ImageView<K,CC> part = band.sub(0, 0, width_, n);
+			if(raw_) {
+				const size_t line = part.numElementsScanline()*sizeof(K);
+				for(unsigned y=0; y<n; y++) {
+					is_.seekg(raw_offset_ + raw_stride_*(y_ + y), std::ios::beg);
+					if(!is_.read(reinterpret_cast<char*>(part.pixel_pointer(0,y)), line)) {
+						throw IoException(fn_, "Unexpected end of file");
+					}
+				}
+			}
+			else {
+				detail::ReadNetpbmData(is_, fn_, netpbm_, part);
+			}
+			y_ += n;
+			return n;
+		}
+
+		unsigned read(Image<K,CC>& band)
+		{ return read(band.view()); }
+
+	private:
+		std::string fn_;
+		std::ifstream is_;
+		unsigned width_, height_;
+		unsigned y_;
+		bool raw_;
+		uint64_t raw_offset_, raw_stride_;
+		detail::NetpbmHeader netpbm_;
+	};
+
+	/** Writes a PGM/PPM or raw image file a band of lines at a time
+	 * The format is chosen by the file extension. All lines have to be written before close.
+	 */
+	template<typename K, unsigned CC>
+	class ScanlineSink
+	{
+	public:
+		using dim_t = std::tuple<unsigned,unsigned>;
+
+		ScanlineSink(const std::string& fn, unsigned width, unsigned height)
+		:	fn_(fn),
+			width_(width),
+			height_(height),
+			y_(0),
+			raw_(IsRawFilename(fn))
+		{
+			if(!raw_) {
+				detail::CheckNetpbmType<K,CC>(fn);
+			}
+			else if(ElementTypeOf<K>::value == ElementType::Unknown || !detail::IsLittleEndian()) {
+				throw IoException(fn, "Raw images need a known element type and a little endian machine");
+			}
+			os_.open(fn, std::ios::binary);
+			if(!os_.is_open()) {
+				throw IoException(fn, "Could not open file");
+			}
+			if(raw_) {
+				const detail::RawHeader h = detail::CreateRawHeader(ElementTypeOf<K>::value, CC, width, height);
+				os_.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			}
+			else {
+				detail::WriteNetpbmHeader<K,CC>(os_, width, height);
+			}
+		}
+
+		ScanlineSink(const std::string& fn, dim_t dim)
+		:	ScanlineSink(fn, std::get<0>(dim), std::get<1>(dim))
+		{}
+
+		ScanlineSink(const ScanlineSink&) = delete;
+		ScanlineSink& operator=(const ScanlineSink&) = delete;
+
+		/** Width of image */
+		unsigned width() const
+		{ return width_; }
+
+		/** Height of image */
+		unsigned height() const
+		{ return height_; }
+
+		dim_t dimensions() const
+		{ return std::make_tuple(width(), height()); }
+
+		/** Index of the next line which will be written */
+		unsigned position() const
+		{ return y_; }
+
+		/** Appends the lines of 'band' which has the width of the image */
+		void write(const ImageView<const K,CC>& band)
+		{
+			assert(band.width() == width_);
+			if(band.height() > height_ - y_) {
+				throw IoException(fn_, "More lines written than the image has");
+			}
+			if(raw_) {
+				const size_t line = band.numElementsScanline()*sizeof(K);
+				for(unsigned y=0; y<band.height(); y++) {
+					os_.write(reinterpret_cast<const char*>(band.pixel_pointer(0,y)), line);
+				}
+			}
+			else {
+				detail::WriteNetpbmData(os_, band);
+			}
+			if(!os_) {
+				throw IoException(fn_, "Could not write file");
+			}
+			y_ += band.height();
+		}
+
+		void write(const ImageView<K,CC>& band)
+		{ write(ImageView<const K,CC>(band)); }
+
+		void write(const Image<K,CC>& band)
+		{ write(band.view()); }
+
+		/** Closes the file; throws if not all lines have been written */
+		void close()
+		{
+			if(!os_.is_open()) {
+				return;
+			}
+			os_.close();
+			if(y_ != height_) {
+				throw IoException(fn_, "Not all lines have been written");
+			}
+			if(os_.fail()) {
+				throw IoException(fn_, "Could not write file");
+			}
+		}
+
+		/** Closes the file without reporting errors; call close() to check for errors */
+		~ScanlineSink()
+		{
+			if(os_.is_open()) {
+				os_.close();
+			}
+		}
+
+	private:
+		std::string fn_;
+		std::ofstream os_;
+		unsigned width_, height_;
+		unsigned y_;
+		bool raw_;
+	};
+
+	namespace detail
+	{
+		/** Reads the bands of a source on one thread which lives as long as the reader
+		 * Bands are read alternately into two buffers, so the next band is read while the
+		 * consumer processes the current one.
+		 */
+		template<typename K, unsigned CC>
+		class BandReader
+		{
+		public:
+			BandReader(ScanlineSource<K,CC>& src, unsigned band_lines)
+			:	src_(src),
+				bands_{ Image<K,CC>(src.width(), band_lines), Image<K,CC>(src.width(), band_lines) },
+				lines_{ 0, 0 },
+				filled_{ false, false },
+				current_(0),
+				stop_(false)
+			{
+				thread_ = std::thread([this]() { run(); });
+			}
+
+			BandReader(const BandReader&) = delete;
+			BandReader& operator=(const BandReader&) = delete;
+
+			/** Waits for a band which is currently read */
+			~BandReader()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				changed_.notify_all();
+				thread_.join();
+			}
+
+			/** Waits for the next band and returns it; the view is empty after the last band
+			 * Rethrows the exception if the band could not be read.
+			 */
+			ImageView<K,CC> acquire()
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				changed_.wait(lock, [this]() { return filled_[current_]; });
+				if(error_) {
+					std::rethrow_exception(error_);
+				}
+				return bands_[current_].view().sub(0, 0, src_.width(), lines_[current_]);
+			}
+
+			/** Returns the band from the last call to acquire to the reader */
+			void release()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					filled_[current_] = false;
+					current_ = 1 - current_;
+				}
+				changed_.notify_all();
+			}
+
+		private:
+			void run()
+			{
+				for(unsigned i=0; ; i=1-i) {
+					{
+						std::unique_lock<std::mutex> lock(mutex_);
+						changed_.wait(lock, [this,i]() { return stop_ || !filled_[i]; });
+						if(stop_) {
+							return;
+						}
+					}
+					// the consumer does not access band i until it is marked as filled
+					unsigned n = 0;
+					std::exception_ptr error;
+					try {
+						n = src_.read(bands_[i]);
+					}
+					catch(...) {
+						error = std::current_exception();
+					}
+					{
+						std::lock_guard<std::mutex> lock(mutex_);
+						lines_[i] = n;
+						filled_[i] = true;
+						error_ = error;
+					}
+					changed_.notify_all();
+					if(n == 0 || error) {
+						return;
+					}
+				}
+			}
+
+			ScanlineSource<K,CC>& src_;
+			Image<K,CC> bands_[2];
+			unsigned lines_[2];
+			bool filled_[2];
+			unsigned current_; // band of the consumer
+			bool stop_;
+			std::exception_ptr error_;
+			std::mutex mutex_;
+			std::condition_variable changed_;
+			std::thread thread_;
+		};
+
+		/** Streams bands of 'band_lines' lines from 'src' through 'process' into 'dst'
+		 * The next band is read on a separate thread while the current one is processed.
+		 */
+		template<typename K, unsigned CC, typename L, unsigned DD, typename P>
+		void StreamBands(ScanlineSource<K,CC>& src, ScanlineSink<L,DD>& dst, unsigned band_lines, P process)
+		{
+			if(src.dimensions() != dst.dimensions()) {
+				throw ConversionException("Source and sink of a stream must have the same size");
+			}
+			band_lines = std::max(1u, band_lines);
+			Image<L,DD> out(src.width(), band_lines);
+			BandReader<K,CC> reader(src, band_lines);
+			while(true) {
+				const ImageView<K,CC> band = reader.acquire();
+				if(band.height() == 0) {
+					break;
+				}
+				const ImageView<L,DD> result = out.view().sub(0, 0, src.width(), band.height());
+				process(ImageView<const K,CC>(band), result);
+				dst.write(result);
+				reader.release();
+			}
+		}
+	}
+
+	/** Converts a stream band by band with dst = fnc(src) for each pixel like Convert
+	 * At most three bands of 'band_lines' lines are kept in memory.
+	 */
+	template<typename K, unsigned CC, typename L, unsigned DD, typename F>
+	void StreamConvert(ScanlineSource<K,CC>& src, ScanlineSink<L,DD>& dst, F fnc, unsigned band_lines=64)
+	{
+		detail::StreamBands(src, dst, band_lines,
+			[&fnc](const ImageView<const K,CC>& band, const ImageView<L,DD>& result) {
+				detail::ConvertRows(band, result, fnc, 0, band.height());
+			});
+	}
+
+	/** StreamConvert with the lines of each band processed in parallel; 'fnc' is called concurrently */
+	template<typename K, unsigned CC, typename L, unsigned DD, typename F>
+	void StreamConvert(const ParallelPolicy& policy, ScanlineSource<K,CC>& src, ScanlineSink<L,DD>& dst, F fnc, unsigned band_lines=256)
+	{
+		detail::StreamBands(src, dst, band_lines,
+			[&policy,&fnc](const ImageView<const K,CC>& band, const ImageView<L,DD>& result) {
+				ParallelRows(policy, band.height(), [&band,&result,&fnc](unsigned y0, unsigned y1) {
+					detail::ConvertRows(band, result, fnc, y0, y1);
+				});
+			});
+	}
+
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <slimage/image.hpp>
+#include <slimage/algorithm.hpp>
+#include <slimage/allocator.hpp>
+#include <slimage/parallel.hpp>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <cassert>
+
+namespace slimage
+{
+
+	/** An image stored as square tiles of T x T pixels
+	 * Each tile is contiguous in memory which keeps vertical neighbourhoods close
+	 * together. Tiles are exposed as ImageView, thus every algorithm accepting views
+	 * can process the image one tile at a time. Tiles at the right and bottom border
+	 * are clipped to the image size.
+	 */
+	template<typename K, unsigned CC, unsigned T=64>
+	class TiledImage
+	{
+	public:
+		using element_t = K;
+		using reference_t = typename Iterator<K,CC>::reference;
+		using const_reference_t = typename Iterator<const K,CC>::reference;
+		using dim_t = std::tuple<unsigned,unsigned>;
+
+		/** A tile with the position of its top left pixel */
+		template<typename L>
+		struct TileT
+		{
+			unsigned x, y;
+			ImageView<L,CC> view;
+		};
+
+		using tile_t = TileT<K>;
+		using const_tile_t = TileT<const K>;
+
+		/** Forward iterator over all tiles in storage order */
+		template<typename L, typename IMG>
+		class TileIterator
+		:	public std::iterator<std::forward_iterator_tag, TileT<L>>
+		{
+		public:
+			TileIterator(IMG* img, unsigned i)
+			:	img_(img),
+				i_(i)
+			{}
+
+			TileT<L> operator*() const
+			{
+				const unsigned tx = i_ % img_->numTilesX();
+				const unsigned ty = i_ / img_->numTilesX();
+				return TileT<L>{tx*T, ty*T, img_->tile(tx, ty)};
+			}
+
+			TileIterator& operator++()
+			{ i_++; return *this; }
+
+			TileIterator operator++(int)
+			{ TileIterator old = *this; i_++; return old; }
+
+			bool operator==(const TileIterator& it) const
+			{ return i_ == it.i_; }
+
+			bool operator!=(const TileIterator& it) const
+			{ return i_ != it.i_; }
+
+		private:
+			IMG* img_;
+			unsigned i_;
+		};
+
+		template<typename IT>
+		struct TileRange
+		{
+			IT first, last;
+
+			IT begin() const
+			{ return first; }
+
+			IT end() const
+			{ return last; }
+		};
+
+		using tile_iterator_t = TileIterator<K,TiledImage>;
+		using const_tile_iterator_t = TileIterator<const K,const TiledImage>;
+
+		TiledImage()
+		:	width_(0),
+			height_(0),
+			tiles_x_(0),
+			tiles_y_(0)
+		{}
+
+		TiledImage(unsigned width, unsigned height)
+		:	TiledImage()
+		{ resize(width, height); }
+
+		TiledImage(dim_t dim)
+		:	TiledImage(std::get<0>(dim), std::get<1>(dim))
+		{}
+
+		void resize(unsigned width, unsigned height)
+		{
+			width_ = width;
+			height_ = height;
+			tiles_x_ = (width + T - 1) / T;
+			tiles_y_ = (height + T - 1) / T;
+			data_.resize(static_cast<size_t>(tiles_x_)*tiles_y_*ElementsPerTile);
+		}
+
+		void resize(dim_t dim)
+		{ resize(std::get<0>(dim), std::get<1>(dim)); }
+
+		bool empty() const
+		{ return width_ == 0 && height_ == 0; }
+
+		/** Width of image */
+		unsigned width() const
+		{ return width_; }
+
+		/** Height of image */
+		unsigned height() const
+		{ return height_; }
+
+		dim_t dimensions() const
+		{ return std::make_tuple(width(), height()); }
+
+		/** Number of elements per pixel */
+		unsigned channelCount() const
+		{ return CC; }
+
+		/** Number of pixels, i.e. width()*height() */
+		size_t size() const
+		{ return static_cast<size_t>(width_)*height_; }
+
+		/** Width and height of a tile in pixels */
+		unsigned tileSize() const
+		{ return T; }
+
+		/** Number of tiles in a row */
+		unsigned numTilesX() const
+		{ return tiles_x_; }
+
+		/** Number of tiles in a column */
+		unsigned numTilesY() const
+		{ return tiles_y_; }
+
+		bool isValidIndex(unsigned x, unsigned y) const
+		{ return x < width_ && y < height_; }
+
+		reference_t operator()(unsigned x, unsigned y)
+		{ return *Iterator<K,CC>{pixel_pointer(x,y)}; }
+
+		const_reference_t operator()(unsigned x, unsigned y) const
+		{ return *Iterator<const K,CC>{pixel_pointer(x,y)}; }
+
+		element_t* pixel_pointer(unsigned x, unsigned y)
+		{ return data_.data() + offset(x,y); }
+
+		const element_t* pixel_pointer(unsigned x, unsigned y) const
+		{ return data_.data() + offset(x,y); }
+
+		/** View onto tile (tx,ty) */
+		ImageView<K,CC> tile(unsigned tx, unsigned ty)
+		{ return ImageView<K,CC>(tile_pointer(tx,ty), tileWidth(tx), tileHeight(ty), TileStride); }
+
+		ImageView<const K,CC> tile(unsigned tx, unsigned ty) const
+		{ return ImageView<const K,CC>(tile_pointer(tx,ty), tileWidth(tx), tileHeight(ty), TileStride); }
+
+		/** All tiles, e.g. for(auto t : img.tiles()) { Fill(t.view, v); } */
+		TileRange<tile_iterator_t> tiles()
+		{ return {tile_iterator_t(this, 0), tile_iterator_t(this, tiles_x_*tiles_y_)}; }
+
+		TileRange<const_tile_iterator_t> tiles() const
+		{ return {const_tile_iterator_t(this, 0), const_tile_iterator_t(this, tiles_x_*tiles_y_)}; }
+
+	private:
+		static constexpr size_t ElementsPerTile = static_cast<size_t>(T)*T*CC;
+		static constexpr size_t TileStride = static_cast<size_t>(T)*CC*sizeof(K);
+
+		unsigned tileWidth(unsigned tx) const
+		{ return std::min(T, width_ - tx*T); }
+
+		unsigned tileHeight(unsigned ty) const
+		{ return std::min(T, height_ - ty*T); }
+
+		element_t* tile_pointer(unsigned tx, unsigned ty)
+		{
+			assert(tx < tiles_x_ && ty < tiles_y_);
+			return data_.data() + (static_cast<size_t>(ty)*tiles_x_ + tx)*ElementsPerTile;
+		}
+
+		const element_t* tile_pointer(unsigned tx, unsigned ty) const
+		{
+			assert(tx < tiles_x_ && ty < tiles_y_);
+			return data_.data() + (static_cast<size_t>(ty)*tiles_x_ + tx)*ElementsPerTile;
+		}
+
+		size_t offset(unsigned x, unsigned y) const
+		{
+			assert(isValidIndex(x,y));
+			const size_t tile = static_cast<size_t>(y / T)*tiles_x_ + x / T;
+			return tile*ElementsPerTile + (static_cast<size_t>(y % T)*T + x % T)*CC;
+		}
+
+		unsigned width_, height_;
+		unsigned tiles_x_, tiles_y_;
+		std::vector<element_t, detail::AlignedAllocator<element_t>> data_;
+	};
+
+	template<typename K, unsigned CC, unsigned T>
+	constexpr size_t TiledImage<K,CC,T>::ElementsPerTile;
+
+	template<typename K, unsigned CC, unsigned T>
+	constexpr size_t TiledImage<K,CC,T>::TileStride;
+
+	/** Calls fnc(tile) for every tile of the image */
+	template<typename K, unsigned CC, unsigned T, typename F>
+	void ForEachTile(TiledImage<K,CC,T>& img, F fnc)
+	{
+		for(auto t : img.tiles()) {
+			fnc(t);
+		}
+	}
+
+	template<typename K, unsigned CC, unsigned T, typename F>
+	void ForEachTile(const TiledImage<K,CC,T>& img, F fnc)
+	{
+		for(auto t : img.tiles()) {
+			fnc(t);
+		}
+	}
+
+	/** Calls fnc(tile) for every tile with tiles processed in parallel */
+	template<typename K, unsigned CC, unsigned T, typename F>
+	void ForEachTile(const ParallelPolicy& policy, TiledImage<K,CC,T>& img, F fnc)
+	{
+		const unsigned nx = img.numTilesX();
+		policy.threads().run(static_cast<size_t>(nx)*img.numTilesY(), [&img,&fnc,nx](size_t i) {
+			const unsigned tx = i % nx;
+			const unsigned ty = i / nx;
+			typename TiledImage<K,CC,T>::tile_t t{tx*T, ty*T, img.tile(tx, ty)};
+			fnc(t);
+		});
+	}
+
+	/** Converts a linear image into a tiled image */
+	template<unsigned T=64, typename K, unsigned CC>
+	TiledImage<typename std::remove_const<K>::type,CC,T> ConvertToTiled(const ImageView<K,CC>& src)
+	{
+		TiledImage<typename std::remove_const<K>::type,CC,T> dst(src.dimensions());
+		ForEachTile(dst, [&src](const typename TiledImage<typename std::remove_const<K>::type,CC,T>::tile_t& t) {
+			detail::CopyInto(src.sub(t.x, t.y, t.view.width(), t.view.height()), t.view);
+		});
+		return dst;
+	}
+
+	template<unsigned T=64, typename K, unsigned CC>
+	TiledImage<K,CC,T> ConvertToTiled(const Image<K,CC>& src)
+	{ return ConvertToTiled<T>(src.view()); }
+
+	/** Converts a tiled image into a linear image */
+	template<typename K, unsigned CC, unsigned T>
+	Image<K,CC> ConvertToImage(const TiledImage<K,CC,T>& src)
+	{
+		Image<K,CC> dst(src.dimensions());
+		auto dst_view = dst.view();
+		ForEachTile(src, [&dst_view](const typename TiledImage<K,CC,T>::const_tile_t& t) {
+			auto part = dst_view.sub(t.x, t.y, t.view.width(), t.view.height());
+			detail::CopyInto(t.view, part);
+		});
+		return dst;
+	}
+
+	/** Copies a rectangular region of a tiled image into a linear image */
+	template<typename K, unsigned CC, unsigned T>
+	Image<K,CC> SubImage(const TiledImage<K,CC,T>& img, unsigned x, unsigned y, unsigned w, unsigned h)
+	{
+		assert(x + w <= img.width() && y + h <= img.height());
+		Image<K,CC> dst(w, h);
+		auto dst_view = dst.view();
+		// visit the overlapping tiles and copy their intersection with the region
+		for(unsigned ty=y/T; ty*T<y+h; ty++) {
+			for(unsigned tx=x/T; tx*T<x+w; tx++) {
+				const unsigned x0 = std::max(x, tx*T);
+				const unsigned y0 = std::max(y, ty*T);
+				const unsigned x1 = std::min(x + w, (tx+1)*T);
+				const unsigned y1 = std::min(y + h, (ty+1)*T);
+				auto part = dst_view.sub(x0 - x, y0 - y, x1 - x0, y1 - y0);
+				detail::CopyInto(img.tile(tx, ty).sub(x0 - tx*T, y0 - ty*T, x1 - x0, y1 - y0), part);
+			}
+		}
+		return dst;
+	}
+
+	/** Mirrors a tiled image vertically */
+	template<typename K, unsigned CC, unsigned T>
+	TiledImage<K,CC,T> FlipY(const TiledImage<K,CC,T>& img)
+	{
+		TiledImage<K,CC,T> dst(img.dimensions());
+		const unsigned height = img.height();
+		ForEachTile(dst, [&img,height](const typename TiledImage<K,CC,T>::tile_t& t) {
+			for(unsigned y=0; y<t.view.height(); y++) {
+				const K* src = img.pixel_pointer(t.x, height - 1 - (t.y + y));
+				std::copy(src, src + t.view.numElementsScanline(), t.view.pixel_pointer(0,y));
+			}
+		});
+		return dst;
+	}
+
+}
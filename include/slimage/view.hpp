@@ -0,0 +1,158 @@
+#pragma once
+
+#include <slimage/pixel.hpp>
+#include <slimage/iterator.hpp>
+#include <tuple>
+#include <type_traits>
+#include <cassert>
+#include <stdint.h>
+
+namespace slimage
+{
+	/** A non-owning view onto externally managed pixel data
+	 * Rows start every stride() bytes which allows to wrap buffers with row padding
+	 * like cv::Mat or QImage without copying. Use ImageView<const K,CC> for read-only views.
+	 * Like a pointer the view does not propagate constness to the pixels it refers to.
+	 */
+	template<typename K, unsigned CC>
+	class ImageView
+	{
+	public:
+		using element_t = K;
+		using iterator_t = Iterator<K,CC>;
+		using reference_t = typename iterator_t::reference;
+		using dim_t = std::tuple<unsigned,unsigned>;
+
+		ImageView()
+		:	data_(nullptr),
+			width_(0),
+			height_(0),
+			stride_(0)
+		{}
+
+		/** Creates a view onto packed pixel data, i.e. rows without padding */
+		ImageView(element_t* data, unsigned width, unsigned height)
+		:	data_(data),
+			width_(width),
+			height_(height),
+			stride_(static_cast<size_t>(CC)*width)
+		{}
+
+		/** Creates a view onto pixel data where rows start every 'stride' bytes */
+		ImageView(element_t* data, unsigned width, unsigned height, size_t stride)
+		:	data_(data),
+			width_(width),
+			height_(height),
+			stride_(stride / sizeof(K))
+		{
+			assert(stride % sizeof(K) == 0);
+			assert(stride_ >= numElementsScanline());
+		}
+
+		/** A view onto mutable pixels converts to a read-only view */
+		template<typename L, typename = typename std::enable_if<std::is_same<const L, K>::value>::type>
+		ImageView(const ImageView<L,CC>& view)
+		:	data_(view.pixel_pointer()),
+			width_(view.width()),
+			height_(view.height()),
+			stride_(view.stride() / sizeof(K))
+		{}
+
+		bool empty() const
+		{ return width_ == 0 && height_ == 0; }
+
+		/** Width of image */
+		unsigned width() const
+		{ return width_; }
+
+		/** Height of image */
+		unsigned height() const
+		{ return height_; }
+
+		dim_t dimensions() const
+		{ return std::make_tuple(width(), height()); }
+
+		/** Number of elements per pixel */
+		unsigned channelCount() const
+		{ return CC; }
+
+		/** Number of pixels, i.e. width()*height() */
+		size_t size() const
+		{ return static_cast<size_t>(width_)*height_; }
+
+		/** Number of elements in a line, i.e. width()*channelCount() */
+		size_t numElementsScanline() const
+		{ return static_cast<size_t>(CC)*width_; }
+
+		/** Distance in bytes between the beginnings of two consecutive lines */
+		size_t stride() const
+		{ return stride_*sizeof(K); }
+
+		/** True if lines are not padded and the view can be traversed with begin() and end() */
+		bool isContiguous() const
+		{ return stride_ == numElementsScanline() || height_ <= 1; }
+
+		reference_t operator[](size_t i) const
+		{ return *iterator_t{pixel_pointer(i % width_, i / width_)}; }
+
+		reference_t operator()(unsigned x, unsigned y) const
+		{ return *iterator_t{pixel_pointer(x,y)}; }
+
+		iterator_t begin() const
+		{
+			assert(isContiguous());
+			return iterator_t{data_};
+		}
+
+		iterator_t end() const
+		{
+			assert(isContiguous());
+			return iterator_t{data_ + CC*size()};
+		}
+
+		/** Iterator to the first pixel in line y */
+		iterator_t beginScanline(unsigned y) const
+		{ return iterator_t{data_ + y*stride_}; }
+
+		/** Iterator past the last pixel in line y */
+		iterator_t endScanline(unsigned y) const
+		{ return iterator_t{data_ + y*stride_ + numElementsScanline()}; }
+
+		bool isValidIndex(unsigned x, unsigned y) const
+		{ return x < width_ && y < height_; }
+
+		element_t* pixel_pointer(unsigned x, unsigned y) const
+		{
+			assert(isValidIndex(x,y));
+			return data_ + y*stride_ + static_cast<size_t>(CC)*x;
+		}
+
+		element_t* pixel_pointer() const
+		{ return data_; }
+
+		/** A view onto the rectangular region with top left corner (x,y) and size w x h */
+		ImageView sub(unsigned x, unsigned y, unsigned w, unsigned h) const
+		{
+			assert(x + w <= width_ && y + h <= height_);
+			return ImageView(data_ + y*stride_ + static_cast<size_t>(CC)*x, w, h, stride());
+		}
+
+	private:
+		element_t* data_;
+		unsigned width_, height_;
+		size_t stride_; // in elements
+	};
+
+	#define SLIMAGE_CREATE_VIEW_TYPEDEF(K,CC,S)\
+		typedef ImageView<K,CC> ImageView##CC##S;
+
+	SLIMAGE_CREATE_VIEW_TYPEDEF(unsigned char, 1, ub)
+	SLIMAGE_CREATE_VIEW_TYPEDEF(unsigned char, 3, ub)
+	SLIMAGE_CREATE_VIEW_TYPEDEF(unsigned char, 4, ub)
+	SLIMAGE_CREATE_VIEW_TYPEDEF(float, 1, f)
+	SLIMAGE_CREATE_VIEW_TYPEDEF(float, 3, f)
+	SLIMAGE_CREATE_VIEW_TYPEDEF(uint16_t, 1, ui16)
+
+	#undef SLIMAGE_CREATE_VIEW_TYPEDEF
+
+}